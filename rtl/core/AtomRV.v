@@ -128,7 +128,7 @@ module AtomRV # (
         final jump decision signal, determines whether the jump will be taken
         sources of jump - instructions like jal/jalr or traps
     */
-    wire jump_decision = (d_jump_en & comparison_result) `INLINE_IFDEF(EN_EXCEPT, | csru_trap_caught_o, ); 
+    wire jump_decision /*verilator public*/ = (d_jump_en & comparison_result) `INLINE_IFDEF(EN_EXCEPT, | csru_trap_caught_o, ); 
 
 
     ////////////////////////////////////////////////////////////////////
@@ -148,7 +148,7 @@ module AtomRV # (
 
     // core halt logic
     wire got_interrupt = irq_i | timer_int_i;
-    reg halted;
+    reg halted /*verilator public*/;
     always @(posedge clk_i) begin
         if(rst_i)
             halted <= 0;
@@ -171,7 +171,7 @@ module AtomRV # (
         Stall Stage2 in case it has made a memory request and the result has't arrived yet.
     */
     wire waiting_for_dbus_response = (!dmem_handshake && dport_valid_o);
-    wire stall_stage2 = waiting_for_dbus_response;
+    wire stall_stage2 /*verilator public*/ = waiting_for_dbus_response;
 
     /*
         Stall Stage1 in case:
@@ -306,6 +306,45 @@ module AtomRV # (
         end
     end
 
+    `ifdef __ATOMSIM_SIMULATION__
+    /*
+        This register is set when InstructionRegister holds a valid instruction
+        (i.e. not a bubble inserted due to a flush), used by atomsim to track
+        instruction retirement
+    */
+    reg InstructionRegister_Valid  /*verilator public*/ = 1'b0;
+    always @(posedge clk_i) begin
+        if(rst_i)
+            InstructionRegister_Valid <= 1'b0;
+        else begin
+            if(flush_pipeline)
+                InstructionRegister_Valid <= 1'b0;
+
+            else if(!stall_stage1)
+                InstructionRegister_Valid <= 1'b1;
+        end
+    end
+
+    /*
+        This register holds the instruction in InstructionRegister as it was
+        fetched (i.e. the 16-bit encoding of a compressed instruction, which
+        InstructionRegister holds expanded), used by atomsim's commit log
+    */
+    wire [31:0] fetched_instr_raw = `INLINE_IFDEF(EN_RVC, (rvc_decdr_is_compressed_o ? {16'd0, rvc_alignr_data_o[15:0]} : rvc_alignr_data_o), iport_data_i);
+    reg [31:0] InstructionRegister_Raw  /*verilator public*/ = `RV_INSTR_NOP;
+    always @(posedge clk_i) begin
+        if(rst_i)
+            InstructionRegister_Raw <= `RV_INSTR_NOP;
+        else begin
+            if(flush_pipeline)
+                InstructionRegister_Raw <= `RV_INSTR_NOP;
+
+            else if(!stall_stage1)
+                InstructionRegister_Raw <= fetched_instr_raw;
+        end
+    end
+    `endif // __ATOMSIM_SIMULATION__
+
 
 
     ////////////////////////////////////////////////////////////////////
@@ -317,7 +356,7 @@ module AtomRV # (
         signals throughout the pipeline. Is also extracts immediate values 
         from instructions and sign extends them properly.
     */
-    wire    [4:0]   d_rd_sel;
+    wire    [4:0]   d_rd_sel        /*verilator public*/;
     wire    [4:0]   d_rs1_sel;
     wire    [4:0]   d_rs2_sel;
     wire    [31:0]  d_imm;
@@ -325,7 +364,7 @@ module AtomRV # (
     wire            d_jump_en;
     wire            d_wfi;
     wire    [2:0]   d_comparison_type;
-    wire            d_rf_we;
+    wire            d_rf_we         /*verilator public*/;
     wire    [2:0]   d_rf_din_sel;
     wire            d_a_op_sel;
     wire            d_b_op_sel;
@@ -390,7 +429,7 @@ module AtomRV # (
     */
 
     // RF_Din Multiplexer
-    reg    [31:0]  rf_rd_data;
+    reg    [31:0]  rf_rd_data   /*verilator public*/;
     always @(*) begin
         case(d_rf_din_sel)
             3'd0:   rf_rd_data = d_imm;
@@ -86,8 +86,8 @@ module CSR_Unit#
         All asynchronous interrupt are passed through posedge edge detector since they cannot be 
         cleared immediately, and level sensitivity will cause PC to jump to trap_jump_addr_o continously.
     */
-    wire exception      = (csr_mstatus_mie & (except_illegal_instr_i | except_instr_addr_misaligned_i
-                            | except_load_addr_misaligned_i | except_store_addr_misaligned_i));
+    wire exception /*verilator public*/ = (csr_mstatus_mie & (except_illegal_instr_i | except_instr_addr_misaligned_i
+                                            | except_load_addr_misaligned_i | except_store_addr_misaligned_i));
     
     wire intrpt_ext_async   = csr_mstatus_mie & csr_mie_meie & intrpt_external_i; 
     wire intrpt_timer_async = csr_mstatus_mie & csr_mie_mtie & intrpt_timer_i; 
@@ -140,7 +140,7 @@ module CSR_Unit#
     // CSR Registers
 
     //===== MCYCLE & MCYCLEH ================================================
-    reg [63:0]  csr_cycle = 64'd0;
+    reg [63:0]  csr_cycle /*verilator public*/ = 64'd0;
 
     always @(posedge clk_i) begin
         if(rst_i)
@@ -151,7 +151,7 @@ module CSR_Unit#
 
 
     //===== INSTRET & INSTRETH ==============================================
-    reg [63:0]  csr_instret = 64'd0;
+    reg [63:0]  csr_instret /*verilator public*/ = 64'd0;
     always @(posedge clk_i) begin
         if(rst_i)
             csr_instret <= 64'd0;
@@ -195,7 +195,7 @@ module CSR_Unit#
 
     `ifdef EN_EXCEPT
     //===== MSTATUS & MSTATUSH ==============================================
-    reg         csr_mstatus_mie;    // Machine global interrupt Enable
+    reg         csr_mstatus_mie /*verilator public*/;    // Machine global interrupt Enable
 
     wire [31:0] csr_mstatus_readval = {28'd0 , csr_mstatus_mie, 3'd0};
     wire [31:0] csr_mstatush_readval = 32'd0;
@@ -214,8 +214,8 @@ module CSR_Unit#
 
 
     //===== MTVEC ===========================================================
-    reg [31:2]  csr_mtvec_base;     // Base address
-    reg [1:0]   csr_mtvec_mode;     // Mode (Direct/Vectored)
+    reg [31:2]  csr_mtvec_base /*verilator public*/;     // Base address
+    reg [1:0]   csr_mtvec_mode /*verilator public*/;     // Mode (Direct/Vectored)
 
     wire [31:0] csr_mtvec_readval = {csr_mtvec_base, csr_mtvec_mode};
     
@@ -232,9 +232,9 @@ module CSR_Unit#
 
     
     //===== MIE =============================================================
-    reg         csr_mie_meie;    // Machine external interrupt Enable
-    reg         csr_mie_mtie;    // Machine timer interrupt Enable
-    reg         csr_mie_msie;    // Machine software interrupt Enable
+    reg         csr_mie_meie /*verilator public*/;    // Machine external interrupt Enable
+    reg         csr_mie_mtie /*verilator public*/;    // Machine timer interrupt Enable
+    reg         csr_mie_msie /*verilator public*/;    // Machine software interrupt Enable
     
     wire [31:0] csr_mie_readval = {20'd0, csr_mie_meie, 3'd0, csr_mie_mtie, 3'd0, csr_mie_msie, 3'd0};
     
@@ -253,9 +253,9 @@ module CSR_Unit#
 
 
     //===== MIP =============================================================
-    reg         csr_mip_meip;    // Machine external interrupt Pending
-    reg         csr_mip_mtip;    // Machine timer interrupt Pending
-    reg         csr_mip_msip;    // Machine software interrupt Pending
+    reg         csr_mip_meip /*verilator public*/;    // Machine external interrupt Pending
+    reg         csr_mip_mtip /*verilator public*/;    // Machine timer interrupt Pending
+    reg         csr_mip_msip /*verilator public*/;    // Machine software interrupt Pending
     
     wire [31:0] csr_mip_readval = {20'd0, csr_mip_meip, 3'd0, csr_mip_mtip, 3'd0, csr_mip_msip, 3'd0};
     
@@ -280,7 +280,7 @@ module CSR_Unit#
 
 
     //===== MEPC ============================================================
-    reg     [31:1]  csr_mepc;       // Machine exception program counter
+    reg     [31:1]  csr_mepc /*verilator public*/;       // Machine exception program counter
     wire    [31:0]  csr_mepc_readval = {csr_mepc, 1'b0};
     
     always @(posedge clk_i) begin
@@ -298,8 +298,8 @@ module CSR_Unit#
 
 
     //===== MCAUSE ==========================================================
-    reg             csr_mcause_intr;
-    reg     [3:0]   csr_mcause_cause;    // Note: Actual size as per spec is 31 bits
+    reg             csr_mcause_intr /*verilator public*/;
+    reg     [3:0]   csr_mcause_cause /*verilator public*/;    // Note: Actual size as per spec is 31 bits
 
     wire    [31:0]  csr_mcause_readval = {csr_mcause_intr, 27'd0, csr_mcause_cause};
     
@@ -164,4 +164,10 @@ SPI_core spi_core (
     .cs_o           (core_cs_o)
 );
 
+`ifdef __ATOMSIM_SIMULATION__
+// Spi is idle (no transfer in progress); used by atomsim to decide whether
+// cycles can be skipped
+wire sim_idle /* verilator public */ = (spi_core.state == 0);
+`endif
+
 endmodule
@@ -56,8 +56,8 @@ end
 wire    [3:0]   we  = {4{wb_we_i & wb_stb_i}} & wb_sel_i;
 
 
-reg     [63:0]  mtime;
-reg     [63:0]  mtimecmp;
+reg     [63:0]  mtime       /*verilator public*/;
+reg     [63:0]  mtimecmp    /*verilator public*/;
 
 assign int_o = mtime >= mtimecmp;
 
@@ -134,6 +134,76 @@ wire            core_err_framing;
 wire            core_err_parity;
 wire            core_rx_parity_bit;        
 
+wire    [7:0]   uc_reg_data;
+wire            uc_send_buf_empty;
+wire            uc_recv_buf_valid;
+wire            uc_err_framing;
+wire            uc_err_parity;
+wire            uc_rx_parity_bit;
+wire            uc_dat_we;
+wire            uc_dat_re;
+
+wire            core_dat_we = FIFO_EN ? ~txfifo_empty_o : reg_data_we;
+wire            core_dat_re = FIFO_EN ? ~rxfifo_full_o : reg_data_re;
+wire    [7:0]   core_dat_di = FIFO_EN ? txfifo_data_o : wb_dat_i[7:0];
+
+`ifdef __ATOMSIM_SIMULATION__
+// Transaction level model:
+// When tlm_en is set by atomsim, bytes are exchanged with the simulator 
+// directly instead of being serialized on tx_o/rx_i. A byte written by 
+// software is presented on tlm_tx_data for one cycle (tlm_tx_valid), and
+// atomsim delivers a byte by setting tlm_rx_data & tlm_rx_valid, which is
+// cleared once the byte has been consumed.
+reg             tlm_en          /* verilator public */ = 1'b0;
+reg     [7:0]   tlm_tx_data     /* verilator public */ = 8'd0;
+reg             tlm_tx_valid    /* verilator public */ = 1'b0;
+reg     [7:0]   tlm_rx_data     /* verilator public */ = 8'd0;
+reg             tlm_rx_valid    /* verilator public */ = 1'b0;
+
+// a non-fifo data register access takes effect when it is acked
+wire tlm_tx_fire = reg_lcr[1] & (FIFO_EN ? core_dat_we : (reg_data_we & wb_ack_o));
+wire tlm_rx_fire = reg_lcr[0] & (FIFO_EN ? core_dat_re : (reg_data_re & wb_ack_o));
+
+always @(posedge wb_clk_i) begin
+    if (wb_rst_i) begin
+        tlm_tx_valid <= 1'b0;
+        tlm_rx_valid <= 1'b0;
+    end else begin
+        tlm_tx_valid <= tlm_en & tlm_tx_fire;
+        if (tlm_en & tlm_tx_fire)
+            tlm_tx_data <= core_dat_di;
+        if (tlm_rx_fire)
+            tlm_rx_valid <= 1'b0;
+    end
+end
+
+// Uart is idle (nothing left to send, not receiving); used by atomsim to
+// decide whether idle cycles can be skipped
+wire sim_idle /* verilator public */ = uc_send_buf_empty & (FIFO_EN ? txfifo_empty_o : 1'b1) & !tlm_tx_valid
+                                        & (uart_core_i.recv_state == 0);
+
+assign core_reg_data        = tlm_en ? tlm_rx_data : uc_reg_data;
+assign core_send_buf_empty  = tlm_en ? 1'b1 : uc_send_buf_empty;
+assign core_recv_buf_valid  = tlm_en ? (tlm_rx_valid & reg_lcr[0]) : uc_recv_buf_valid;
+assign core_err_framing     = tlm_en ? 1'b0 : uc_err_framing;
+assign core_err_parity      = tlm_en ? 1'b0 : uc_err_parity;
+assign core_rx_parity_bit   = tlm_en ? 1'b0 : uc_rx_parity_bit;
+
+// keep uart core out of it in tlm mode, else it would still shift out every
+// written byte and keep sim_idle low
+assign uc_dat_we            = core_dat_we & ~tlm_en;
+assign uc_dat_re            = core_dat_re & ~tlm_en;
+`else
+assign core_reg_data        = uc_reg_data;
+assign core_send_buf_empty  = uc_send_buf_empty;
+assign core_recv_buf_valid  = uc_recv_buf_valid;
+assign core_err_framing     = uc_err_framing;
+assign core_err_parity      = uc_err_parity;
+assign core_rx_parity_bit   = uc_rx_parity_bit;
+assign uc_dat_we            = core_dat_we;
+assign uc_dat_re            = core_dat_re;
+`endif
+
 // Core Instance
 UART_core uart_core_i
 (
@@ -142,10 +212,10 @@ UART_core uart_core_i
     .ser_tx                 (tx_o),
     .ser_rx                 (reg_lcr[7] ? tx_o : rx_i), // loopback
     .divisor                (reg_div),
-    .reg_dat_we             (FIFO_EN ? ~txfifo_empty_o : reg_data_we),
-    .reg_dat_re             (FIFO_EN ? ~rxfifo_full_o : reg_data_re),
-    .reg_dat_di             (FIFO_EN ? txfifo_data_o : wb_dat_i[7:0]),
-    .reg_dat_do             (core_reg_data),
+    .reg_dat_we             (uc_dat_we),
+    .reg_dat_re             (uc_dat_re),
+    .reg_dat_di             (core_dat_di),
+    .reg_dat_do             (uc_reg_data),
     
     .rx_en                  (reg_lcr[0]),
     .tx_en                  (reg_lcr[1]),
@@ -154,11 +224,11 @@ UART_core uart_core_i
     .even_parity            (reg_lcr[4]),
 
 
-    .tx_buf_empty           (core_send_buf_empty),
-    .rx_buf_valid           (core_recv_buf_valid),
-    .err_framing            (core_err_framing),
-    .err_parity             (core_err_parity),
-    .rx_parity              (core_rx_parity_bit)
+    .tx_buf_empty           (uc_send_buf_empty),
+    .rx_buf_valid           (uc_recv_buf_valid),
+    .err_framing            (uc_err_framing),
+    .err_parity             (uc_err_parity),
+    .rx_parity              (uc_rx_parity_bit)
 );
 
 
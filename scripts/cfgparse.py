@@ -373,7 +373,8 @@ if __name__ == "__main__":
             txt = cfgp.get_hierarcy()
         
         if args.get_attr:
-            txt = str(cfgp.cfg.get_attr(args.get_attr))
+            attr = cfgp.cfg.get_attr(args.get_attr)
+            txt = list2str(attr, args.one_per_line) if isinstance(attr, list) else str(attr)
 
         # Dump requested info
         if args.output:
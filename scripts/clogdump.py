@@ -0,0 +1,129 @@
+#!/usr/bin/python3
+####################################################################################
+# CLogDump : Decode binary commit log generated by AtomSim (--commit-log) to text
+####################################################################################
+
+import argparse
+import sys
+
+MAGIC       = b'ATOMCLOG'
+VERSION     = 2
+
+# Record flags (see sim/commitlog.hpp)
+CLOG_NONSEQ_PC  = 0x01
+CLOG_IR_LITERAL = 0x02
+CLOG_RD         = 0x04
+CLOG_MEM        = 0x08
+CLOG_CYCLE      = 0x10
+
+IRCACHE_SIZE    = 4096
+
+
+def throwerr(msg, code=1):
+    """
+    Throw error and exit
+    """
+    print(f"CLOGDUMP ERROR: {msg}", file=sys.stderr)
+    sys.exit(code)
+
+
+class Reader:
+    def __init__(self, data: bytes):
+        self.data = data
+        self.pos = 0
+
+    def eof(self):
+        return self.pos >= len(self.data)
+
+    def byte(self):
+        b = self.data[self.pos]
+        self.pos += 1
+        return b
+
+    def varint(self):
+        v = 0
+        shift = 0
+        while True:
+            b = self.byte()
+            v |= (b & 0x7f) << shift
+            shift += 7
+            if b < 0x80:
+                return v
+
+    def zigzag(self):
+        v = self.varint()
+        return (v >> 1) ^ -(v & 1)
+
+
+def decode(data: bytes):
+    """
+    Generator yielding (cycle, pc, ir, rd, rd_val, mem, mem_addr, mem_data) tuples
+    """
+    if data[:len(MAGIC)] != MAGIC:
+        throwerr('not an atomsim commit log')
+    if data[len(MAGIC)] != VERSION:
+        throwerr(f'unsupported commit log version: {data[len(MAGIC)]}')
+
+    r = Reader(data)
+    r.pos = len(MAGIC) + 1
+
+    cycle = 0
+    next_pc = 0
+    regs = [0] * 32
+    mem_addr = 0
+    ircache = {}
+
+    while not r.eof():
+        flags = r.byte()
+
+        cycle += r.varint() if flags & CLOG_CYCLE else 1
+        pc = (next_pc + r.zigzag()) & 0xffffffff if flags & CLOG_NONSEQ_PC else next_pc
+
+        if flags & CLOG_IR_LITERAL:
+            ir = r.byte() | (r.byte() << 8)
+            if ir & 0b11 == 0b11:
+                ir |= (r.byte() << 16) | (r.byte() << 24)
+            ircache[(pc >> 1) & (IRCACHE_SIZE-1)] = ir
+        else:
+            ir = ircache[(pc >> 1) & (IRCACHE_SIZE-1)]
+
+        rd, rd_val = 0, 0
+        if flags & CLOG_RD:
+            rd = r.byte()
+            rd_val = (regs[rd & 0x1f] + r.zigzag()) & 0xffffffff
+            regs[rd & 0x1f] = rd_val
+
+        mem, data_ = 0, 0
+        if flags & CLOG_MEM:
+            mem = r.byte()
+            mem_addr = (mem_addr + r.zigzag()) & 0xffffffff
+            data_ = r.varint()
+
+        next_pc = (pc + (4 if ir & 0b11 == 0b11 else 2)) & 0xffffffff
+        yield cycle, pc, ir, rd, rd_val, mem, mem_addr, data_
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description='Decode AtomSim binary commit log')
+    parser.add_argument('logfile', help='commit log file')
+    parser.add_argument('-o', '--output', default='', help='output file (default: stdout)')
+    args = parser.parse_args()
+
+    with open(args.logfile, 'rb') as f:
+        data = f.read()
+
+    out = open(args.output, 'w') if args.output else sys.stdout
+    try:
+        for cycle, pc, ir, rd, rd_val, mem, mem_addr, mem_data in decode(data):
+            line = f'{cycle:>12} 0x{pc:08x} (0x{ir:0{8 if ir & 0b11 == 0b11 else 4}x})'
+            if rd:
+                line += f' x{rd:<2} 0x{rd_val:08x}'
+            if mem:
+                op = 'W' if mem & 0x10 else 'R'
+                line += f' mem{op} 0x{mem_addr:08x} 0x{mem_data:08x} ({mem & 0xf:x})'
+            out.write(line + '\n')
+    except BrokenPipeError:
+        pass
+    finally:
+        if out is not sys.stdout:
+            out.close()
@@ -0,0 +1,153 @@
+#!/usr/bin/python3
+####################################################################################
+# SimBench : Measure AtomSim simulation throughput on a set of ELF files and
+# compare it against a stored baseline
+####################################################################################
+
+import json, re, argparse
+import os, sys, subprocess, time
+
+RED     = "\033[0;31m"
+GREEN   = "\033[0;32m"
+YELLOW  = "\033[1;33m"
+RESET   = "\033[0m"
+
+# Printed by atomsim (in verbose mode) at exit
+SIMSPEED_REGEX = re.compile(r'Simulation speed: (\d+) cycles in ([\d.]+) s')
+# Printed by atomsim at startup with --mem-bench (atombones only)
+MEMSPEED_REGEX = re.compile(r'Memory access: ([\d.]+) ns/access')
+
+
+def throwerr(msg, code=1):
+    """
+    Throw error and exit
+    """
+    print(f"{RED}SIMBENCH ERROR:{RESET} {msg}", file=sys.stderr)
+    sys.exit(code)
+
+
+def run_bench(atomsim: str, elf: str, maxitr: int, extra_args: list):
+    """
+    Run an elf under atomsim and collect throughput stats
+    """
+    cmd = [atomsim, '--no-banner', '--no-color', '-v', f'--maxitr={maxitr}'] + extra_args + [elf]
+
+    tstart = time.perf_counter()
+    proc = subprocess.Popen(cmd, stdin=subprocess.DEVNULL, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    output = proc.stdout.read()
+    # reap child ourselves: wait4 gives us the resource usage of this particular child
+    _, status, rusage = os.wait4(proc.pid, 0)
+    wall_time = time.perf_counter() - tstart
+    proc.returncode = os.waitstatus_to_exitcode(status)
+    proc.stdout.close()
+
+    output = output.decode(errors='replace')
+    m = SIMSPEED_REGEX.search(output)
+    if m is None:
+        print(output, file=sys.stderr)
+        throwerr(f'could not find simulation speed in atomsim output for {elf}')
+
+    cycles = int(m.group(1))
+    sim_time = float(m.group(2))
+
+    m = MEMSPEED_REGEX.search(output)
+    mem_ns = float(m.group(1)) if m else None
+
+    return {
+        'example':              os.path.splitext(os.path.basename(elf))[0],
+        'elf':                  elf,
+        'exitcode':             proc.returncode,
+        'wall_time_s':          round(wall_time, 4),
+        'sim_time_s':           sim_time,
+        'cycles':               cycles,
+        'sim_khz':              round((cycles / sim_time) / 1000.0, 2) if sim_time > 0 else 0.0,
+        'host_ns_per_cycle':    round((sim_time * 1e9) / cycles, 2) if cycles > 0 else 0.0,
+        'peak_rss_kb':          rusage.ru_maxrss,
+        'mem_ns_per_access':    mem_ns,
+    }
+
+
+def compare(results: dict, baseline: dict, threshold: float):
+    """
+    Compare sim_khz of each example with baseline, returns number of regressions
+    """
+    base = {r['example']: r for r in baseline['results']}
+    nregressions = 0
+
+    print(f"{'example':<16} {'baseline kHz':>14} {'current kHz':>14} {'change':>9}")
+    for r in results['results']:
+        if r['example'] not in base:
+            print(f"{r['example']:<16} {'-':>14} {r['sim_khz']:>14.2f} {'new':>9}")
+            continue
+
+        b = base[r['example']]['sim_khz']
+        change = ((r['sim_khz'] - b) / b) * 100.0 if b > 0 else 0.0
+        regressed = change < -threshold
+        nregressions += regressed
+        clr = RED if regressed else GREEN
+        print(f"{r['example']:<16} {b:>14.2f} {r['sim_khz']:>14.2f} {clr}{change:>+8.1f}%{RESET}")
+    return nregressions
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description='Measure AtomSim simulation throughput')
+    parser.add_argument('elfs', nargs='+', help='ELF files to simulate')
+    parser.add_argument('--atomsim', default='atomsim', help='atomsim executable')
+    parser.add_argument('--soctarget', default='', help='soctarget (recorded in results; atombones runs also measure memory access time)')
+    parser.add_argument('--maxitr', type=int, default=999999999, help='max simulation iterations')
+    parser.add_argument('-o', '--output', default='', help='write results to json file')
+    parser.add_argument('--baseline', default='', help='baseline json file to compare against')
+    parser.add_argument('--threshold', type=float, default=10.0, help='max allowed throughput drop (in %%)')
+    parser.add_argument('--update-baseline', action='store_true', help='write results to baseline file')
+    parser.add_argument('--require-baseline', action='store_true', help='fail if baseline file does not exist')
+    parser.add_argument('--atomsim-args', default='', help='additional arguments for atomsim')
+    args = parser.parse_args()
+
+    # check before spending time on the runs
+    if args.require_baseline and not args.update_baseline and not os.path.isfile(args.baseline or ''):
+        throwerr(f'baseline not found: {args.baseline or "(none specified)"}; record one with --update-baseline (make bench-baseline)')
+
+    results = {
+        'soctarget': args.soctarget,
+        'atomsim': args.atomsim,
+        'date': time.strftime('%Y-%m-%d %H:%M:%S'),
+        'results': []
+    }
+
+    # skipped cycles aren't simulated, don't let them count towards throughput
+    atomsim_args = ['--busywait-skip=false'] + args.atomsim_args.split()
+    if args.soctarget == 'atombones':
+        atomsim_args.append('--mem-bench')
+    elif args.soctarget == 'hydrogensoc':
+        atomsim_args.append('--idle-skip=false')
+
+    for elf in args.elfs:
+        if not os.path.isfile(elf):
+            throwerr(f'file not found: {elf}')
+        print(f'Running {elf} ...', flush=True)
+        r = run_bench(args.atomsim, elf, args.maxitr, atomsim_args)
+        if r['exitcode'] != 0:
+            throwerr(f'atomsim exited with code {r["exitcode"]} for {elf}')
+        results['results'].append(r)
+
+    out = json.dumps(results, indent=4)
+    print(out)
+
+    if args.output:
+        with open(args.output, 'w') as f:
+            f.write(out+'\n')
+
+    if args.baseline:
+        if args.update_baseline:
+            with open(args.baseline, 'w') as f:
+                f.write(out+'\n')
+            print(f'Baseline updated: {args.baseline}')
+        elif not os.path.isfile(args.baseline):
+            print(f'{YELLOW}WARN:{RESET} baseline not found: {args.baseline}; skipping comparison')
+        else:
+            with open(args.baseline, 'r') as f:
+                baseline = json.load(f)
+            nreg = compare(results, baseline, args.threshold)
+            if nreg > 0:
+                throwerr(f'{nreg} example(s) regressed by more than {args.threshold}%')
+            print(f'{GREEN}No throughput regressions (threshold: {args.threshold}%){RESET}')
@@ -1,23 +1,45 @@
 #include "atomsim.hpp"
 #include <iostream>
+#include <chrono>
 #include "util.hpp"
 
 #include TARGET_HEADER
-#define RV_INSTR_EBREAK 0x100073
 
 Atomsim::Atomsim(Atomsim_config sim_config, Backend_config bk_config):
     sim_config_(sim_config),
-    backend_(this, bk_config)  // create backend
+    backend_(this, bk_config),  // create backend
+    disassembler_([this](uint32_t addr, uint32_t size, uint32_t &data) -> bool {
+        uint8_t buf[4] = {0};
+        try {
+            backend_.fetch(addr, buf, size);
+        } catch(Atomsim_exception &e) {
+            return false;   // not mapped
+        }
+        data = buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+        return true;
+    }),
+    semihost_([this](uint32_t addr, uint8_t *buf, uint32_t sz) { backend_.fetch(addr, buf, sz); },
+              [this](uint32_t addr, uint8_t *buf, uint32_t sz) { backend_.store(addr, buf, sz); })
 {   
-    // get input file disassembly   
-    getDisassembly(&disassembly_, sim_config_.ifile);
-
     // clear breakpoints
     for(int i=0; i<NUM_MAX_BREAKPOINTS; i++) {
         breakpoints_[i].active = false;
     }
+    update_breakpoint_map();
+
+    // resolve register handles used in the simulation loop
+    refresh_reg_handles();
+
+    // Restore checkpoint if specified at CLI
+    if (sim_config_.restore_file != "")
+    {
+        load_checkpoint(sim_config_.restore_file);
+        if (sim_config_.verbose_flag)
+            std::cout << "Restored checkpoint : \"" << sim_config_.restore_file << "\" (" << backend_.get_total_tick_count() << " ticks)\n";
+    }
     
-    // Open trace if specified at CLI
+    // Set trace window & open trace if specified at CLI
+    backend_.set_trace_window(parse_trace_trigger(sim_config_.trace_start), parse_trace_trigger(sim_config_.trace_stop));
     if (sim_config_.trace_flag)
     {
         backend_.open_trace(sim_config.trace_file.c_str());
@@ -25,14 +47,200 @@ Atomsim::Atomsim(Atomsim_config sim_config, Backend_config bk_config):
         if (sim_config_.verbose_flag)
             std::cout << "Trace enabled : \"" << sim_config.trace_file << "\" opened for output.\n";
     }
+
+    // Enable commit log if specified at CLI
+    if (sim_config_.commitlog_file != "")
+    {
+        backend_.enable_commitlog(sim_config_.commitlog_file);
+        if (sim_config_.verbose_flag)
+            std::cout << "Commit log enabled : \"" << sim_config_.commitlog_file << "\" opened for output.\n";
+    }
+
+    // Enable profiler if specified at CLI
+    if (sim_config_.profile_file != "")
+    {
+        backend_.enable_profiler(sim_config_.ifile, sim_config_.profile_file, sim_config_.profile_interval);
+        if (sim_config_.verbose_flag)
+            std::cout << "Profiler enabled : sampling pc every " << sim_config_.profile_interval << " cycles, profile is written to \"" << sim_config_.profile_file << "\" at exit\n";
+    }
+
+    // Enable flight recorder if specified at CLI
+    if (sim_config_.flightrec_depth > 0)
+    {
+        backend_.enable_flightrec(sim_config_.flightrec_depth, sim_config_.flightrec_file);
+        if (sim_config_.verbose_flag)
+            std::cout << "Flight recorder enabled : last " << sim_config_.flightrec_depth << " cycles are kept\n";
+    }
+}
+
+
+TraceTrigger_t Atomsim::parse_trace_trigger(const std::string &spec)
+{
+    TraceTrigger_t t;
+    if(spec == "")
+        return t;
+
+    if(spec.find_first_not_of("0123456789") == std::string::npos)
+    {
+        t.type = TraceTrigger_t::CYCLE;
+        t.value = std::stoull(spec);
+        return t;
+    }
+
+    uint32_t addr;
+    if(spec.substr(0, 2) == "0x")
+        addr = std::stoul(spec, nullptr, 16);
+    else if(!getSymbolAddr(sim_config_.ifile, spec, addr))
+        throw Atomsim_exception("symbol not found in input file: "+spec);
+
+    t.type = TraceTrigger_t::PC;
+    t.value = addr;
+    return t;
+}
+
+
+void Atomsim::update_breakpoint_map()
+{
+    breakpoint_map_.clear();
+    for(int i=0; i<NUM_MAX_BREAKPOINTS; i++) {
+        // if multiple breakpoints share an address, report the lowest numbered one
+        if(breakpoints_[i].active && breakpoint_map_.count(breakpoints_[i].addr) == 0)
+            breakpoint_map_[breakpoints_[i].addr] = i;
+    }
+}
+
+
+void Atomsim::refresh_reg_handles()
+{
+    pc_handle_ = backend_.get_reg_handle32("pc");
+    for(Watchpoint_t &wp: watchpoints_)
+        wp.handle = backend_.get_reg_handle32(wp.reg);
+}
+
+
+void Atomsim::switch_engine(const std::string &engine)
+{
+    backend_.switch_engine(engine);
+    refresh_reg_handles();
+}
+
+
+// Checkpoint file header
+#define CHECKPOINT_MAGIC    "atomsim-checkpoint"
+#define CHECKPOINT_VERSION  4
+
+void Atomsim::save_checkpoint(const std::string &file)
+{
+#ifdef ATOMSIM_SAVABLE
+    VerilatedSave os;
+    os.open(file.c_str());
+    if (!os.isOpen())
+        throw Atomsim_exception("can't open checkpoint file for writing: "+file);
+
+    std::string magic = CHECKPOINT_MAGIC;
+    uint32_t version = CHECKPOINT_VERSION;
+    std::string target = backend_.get_target_name();
+    std::string engine = backend_.using_iss() ? "iss" : "rtl";    // state of active engine is saved
+    os << magic << version << target << engine;
+
+    backend_.save_state(os);
+    os.close();
+#else
+    throw Atomsim_exception("checkpoints are not supported in this build of atomsim (rebuild with SAVABLE=1)");
+#endif
+}
+
+
+void Atomsim::load_checkpoint(const std::string &file)
+{
+#ifdef ATOMSIM_SAVABLE
+    VerilatedRestore is;
+    is.open(file.c_str());
+    if (!is.isOpen())
+        throw Atomsim_exception("can't open checkpoint file for reading: "+file);
+
+    std::string magic, target, engine;
+    uint32_t version = 0;
+    is >> magic;
+    if (magic != CHECKPOINT_MAGIC)
+        throw Atomsim_exception("not an atomsim checkpoint: "+file);
+    
+    is >> version >> target;
+    if (version != CHECKPOINT_VERSION)
+        throw Atomsim_exception("unsupported checkpoint version ("+std::to_string(version)+"): "+file);
+    if (target != backend_.get_target_name())
+        throw Atomsim_exception("checkpoint was created for a different soctarget ("+target+"): "+file);
+    
+    is >> engine;
+    std::string cur_engine = backend_.using_iss() ? "iss" : "rtl";
+    if (engine != cur_engine)
+        throw Atomsim_exception("checkpoint was created with "+engine+" engine, but "+cur_engine+" engine is active (use --engine="+engine+"): "+file);
+
+    backend_.restore_state(is);
+    is.close();
+#else
+    throw Atomsim_exception("checkpoints are not supported in this build of atomsim (rebuild with SAVABLE=1)");
+#endif
+}
+
+
+void Atomsim::print_perf_info()
+{
+    const PerfCounters_t &perf = backend_.get_perf_counters();
+    uint64_t cycles = perf.total();
+    if(cycles == 0)
+    {
+        printf("No RTL cycles simulated\n");
+        return;
+    }
+
+    static const char * const desc[PERF_NCLASSES] = {
+        "Retiring", "Ibus wait", "Dbus wait", "Branch flush", "Halted", "Other"
+    };
+    printf("RTL cycles         : %ld\n", cycles);
+    printf("Instructions       : %ld\n", perf.retired());
+    printf("CPI                : %.3f\n", perf.retired() ? (double)cycles / perf.retired() : 0.0);
+    for(int c=0; c<PERF_NCLASSES; c++)
+        printf("  %-16s : %12ld (%6.2f%%)\n", desc[c], perf.cycles[c], 100.0 * perf.cycles[c] / cycles);
+    backend_.print_memsys_info();
+}
+
+
+bool Atomsim::service_semihosting(uint32_t pc)
+{
+    // reference ISS can't step over the call
+    if(backend_.using_lockstep())
+        return false;
+
+    uint32_t prev, next;
+    try {
+        backend_.fetch(pc-4, (uint8_t *)&prev, 4);
+        backend_.fetch(pc+4, (uint8_t *)&next, 4);
+    } catch(Atomsim_exception &e) {
+        return false;   // ebreak at edge of memory
+    }
+    if(!Semihosting::is_call(prev, next))
+        return false;
+
+    uint32_t ret = semihost_.service(backend_.read_reg("a0"), backend_.read_reg("a1"));
+    backend_.write_reg("a0", ret);
+    backend_.skip_insn();
+    return true;
 }
 
 
-void Atomsim::step()
+TickResult_t Atomsim::step(uint64_t ncycles)
 {
+    StopConditions_t conds;
+    conds.breakpoints = &breakpoint_map_;
+    conds.watchpoints = &watchpoints_;
+    conds.maxitr = sim_config_.maxitr;
+    conds.ctrl_c = &CTRL_C_PRESSED;
+
     // tick backend and update backend status
-    int rcode = backend_.tick();
-    bkend_running_ = (rcode == 0) ? true : false;
+    TickResult_t res = backend_.tick_n(ncycles, conds);
+    bkend_running_ = (res.reason != STOP_FINISH);
+    return res;
 }
 
 
@@ -52,36 +260,54 @@ int Atomsim::run()
         pending_steps = 0;
 
         init_interactive_mode();
+
+        // used to report simulation speed (time spent in interactive mode is excluded)
+        auto sim_start_time = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::duration interactive_time(0);
+        uint64_t sim_start_ticks = backend_.get_total_tick_count();
+
+        // result of last step
+        TickResult_t res;
         
         // *** Simulation Loop ***
         while (bkend_running_)
         {
-            int breakpoint_hit = -1;
-
-            // Evaluate breakpoints (early)
-            for(int i=0; i<NUM_MAX_BREAKPOINTS; i++) {
-                if(breakpoints_[i].active && breakpoints_[i].addr == backend_.read_reg("pc")){
-                    breakpoint_hit = i;
-                    break;
-                }
-            }
+            uint32_t pc = *pc_handle_;
 
             // Display debug screen
-            // if we are in debug mode OR we'll be in debug mode due to CTRL_C OR breakpoint occured
-            if(in_debug_mode_ || CTRL_C_PRESSED || breakpoint_hit != -1) {
+            // if we are in debug mode OR we'll be in debug mode due to CTRL_C OR breakpoint/watchpoint occured
+            if(in_debug_mode_ || CTRL_C_PRESSED || res.reason == STOP_BREAKPOINT || res.reason == STOP_WATCHPOINT) {
                 display_dbg_screen();
             }
             
-            if(breakpoint_hit != -1) {
+            if(res.reason == STOP_BREAKPOINT) {
                 // Make sure we enter debug mode after breakpoint hit
-                printf("Breakpoint %d hit %s0x%08lx%s\n", breakpoint_hit, ansicode(FG_BLUE), backend_.read_reg("pc"), ansicode(FG_RESET));
+                printf("Breakpoint %d hit %s0x%08x%s\n", res.id, ansicode(FG_BLUE), pc, ansicode(FG_RESET));
+                in_debug_mode_ = true;
+                pending_steps = 0;
+            }
+            else if(res.reason == STOP_WATCHPOINT) {
+                // Make sure we enter debug mode after watchpoint hit
+                printf("Watchpoint %d hit %s%s%s = 0x%08x\n", res.id, ansicode(FG_BLUE), watchpoints_[res.id].reg.c_str(), ansicode(FG_RESET), watchpoints_[res.id].value);
                 in_debug_mode_ = true;
                 pending_steps = 0;
             }
 
+            // check semihosting call
+            if(res.reason == STOP_EBREAK && service_semihosting(pc)) {
+                if(semihost_.exited()) {
+                    if(sim_config_.verbose_flag)
+                        printf("Semihosting exit (code %d) at %ld ticks\n", semihost_.exit_code(), backend_.get_total_tick_count());
+                    exitcode = semihost_.exit_code();
+                    break;
+                }
+                res.reason = STOP_NONE;
+            }
+
             // check ebreak
-            if(backend_.read_reg("ir") == RV_INSTR_EBREAK) {
-                printf("EBreak hit at %ld ticks, PC=%s0x%08lx%s\n", backend_.get_total_tick_count() , ansicode(FG_BLUE), backend_.read_reg("pc"), ansicode(FG_RESET));
+            if(res.reason == STOP_EBREAK) {
+                printf("EBreak hit at %ld ticks, PC=%s0x%08x%s\n", backend_.get_total_tick_count() , ansicode(FG_BLUE), pc, ansicode(FG_RESET));
+                backend_.dump_flightrec("ebreak");
 
                 if(sim_config_.dump_on_ebreak_flag){  // For SCAR
                     // Temporarily redirect stdout to file
@@ -110,23 +336,45 @@ int Atomsim::run()
                 }
             }
 
+            // check lockstep divergence
+            if(res.reason == STOP_DIVERGENCE) {
+                printf("%s", backend_.get_divergence().c_str());
+                backend_.dump_flightrec("lockstep divergence");
+
+                // divergence while debug mode was enabled through cli
+                if(sim_config_.debug_flag) {
+                    in_debug_mode_ = true;
+                    pending_steps = 0;
+                } else {
+                    throwError("SIM1", "RTL diverged from reference ISS at "+std::to_string(backend_.get_total_tick_count())+" ticks\n");
+                    exitcode = EXIT_FAILURE;
+                    break;
+                }
+            }
+
             // check sim iterations
-            if(backend_.get_total_tick_count() > sim_config_.maxitr) {
+            if(res.reason == STOP_MAXITR) {
+                backend_.dump_flightrec("maxitr");
                 throwError("SIM0", "Simulation iterations exceeded maxitr("+std::to_string(sim_config_.maxitr)+")\n");
                 exitcode = EXIT_FAILURE;
                 break;
             }
             
+            if(res.reason == STOP_CTRL_C) {
+                backend_.dump_flightrec("ctrl+c");
+            }
+
             // Enter interactive mode if we aren's stepping and we are already in debug mode or run mode
             // was interrupted by user (CTRL_C)
-            Rcode rval = RC_NONE;
             if((pending_steps == 0) && (in_debug_mode_ || CTRL_C_PRESSED)) {
                 // explictly set: since we can also enter if CTRL_C_PRESSED
                 in_debug_mode_ = true;
                 pending_steps = 0;
 
                 // run interactive mode
-                rval = run_interactive_mode();
+                auto interactive_start_time = std::chrono::steady_clock::now();
+                Rcode rval = run_interactive_mode();
+                interactive_time += std::chrono::steady_clock::now() - interactive_start_time;
 
                 // if we return, that's either for exiting simulation, single/multi steping, or 
                 // switching to run mode
@@ -144,14 +392,31 @@ int Atomsim::run()
                 }
             }
 
-            // Step
-            this->step();
+            // Step: one cycle at a time in debug mode (debug screen is displayed every 
+            // cycle), otherwise run until one of the stop conditions fires
+            res = this->step(in_debug_mode_ ? 1 : ULLONG_MAX);
             
             // Decrement pending_steps if we are in Step mode
-            if(rval == RC_STEP && pending_steps > 0) {
+            if(pending_steps > 0) {
                 pending_steps--;
             }
         }
+
+        // Report simulation speed
+        if(sim_config_.verbose_flag) {
+            double sim_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - sim_start_time - interactive_time).count();
+            uint64_t sim_ticks = backend_.get_total_tick_count() - sim_start_ticks;
+            printf("Simulation speed: %ld cycles in %.3f s (%.2f kHz)\n", sim_ticks, sim_time, (sim_time > 0) ? (sim_ticks / sim_time) / 1000.0 : 0.0);
+            if(sim_config_.print_info_topdown)
+                print_perf_info();
+        }
+
+        // Report fast-forwarded cycles (always, as they were not simulated)
+        if(backend_.get_skipped_cycles() > 0)
+            printf("Idle cycles skipped: %ld\n", backend_.get_skipped_cycles());
+        if(backend_.get_busywait_skips() > 0)
+            printf("Busy-wait cycles skipped: %ld (%ld loops, %ld approximate)\n", backend_.get_busywait_cycles(), 
+                backend_.get_busywait_skips(), backend_.get_busywait_approx_cycles());
     }
     catch(std::exception &e)
     {
@@ -164,3 +429,116 @@ int Atomsim::run()
 
     return exitcode;
 }
+
+
+int Atomsim::run_sampled()
+{
+    int exitcode = EXIT_SUCCESS;
+
+    try
+    {
+        if(sim_config_.samples == 0 || sim_config_.sample_window == 0)
+            throw Atomsim_exception("number of samples and sample window must be non-zero");
+
+        // maxitr limits instructions in both engines (cycles aren't known in ISS)
+        StopConditions_t conds;
+        conds.maxitr = sim_config_.maxitr;
+        conds.maxitr_instret = true;
+        conds.ctrl_c = &CTRL_C_PRESSED;
+
+        // Resolve start of first sample: instruction count, pc or symbol
+        const std::string &at = sim_config_.sample_at;
+        uint64_t ff_insns = 0;
+        std::unordered_map<uint32_t, int> start_bp;
+        if(at.find_first_not_of("0123456789") == std::string::npos)
+        {
+            ff_insns = std::stoull(at);
+        }
+        else
+        {
+            uint32_t addr;
+            if(at.substr(0, 2) == "0x")
+                addr = std::stoul(at, nullptr, 16);
+            else if(!getSymbolAddr(sim_config_.ifile, at, addr))
+                throw Atomsim_exception("symbol not found in input file: "+at);
+
+            // breakpoints are only checked when pc changes
+            if(backend_.read_reg("pc") != addr)
+            {
+                start_bp[addr] = 0;
+                conds.breakpoints = &start_bp;
+                ff_insns = ULLONG_MAX;
+            }
+        }
+
+        // Fast-forward to start of first sample
+        TickResult_t res;
+        uint64_t total_insns = 0;
+        if(ff_insns > 0)
+        {
+            res = backend_.tick_n(ff_insns, conds);
+            total_insns += res.cycles;
+            if(res.reason == STOP_BREAKPOINT)
+                res.reason = STOP_NONE;
+        }
+        conds.breakpoints = nullptr;
+
+        struct Sample_t {
+            uint64_t start;     // instructions executed before sample
+            uint64_t cycles;    // cycles simulated in RTL
+            uint64_t insns;     // instructions retired in RTL
+        };
+        std::vector<Sample_t> samples;
+
+        while(res.reason == STOP_NONE && samples.size() < sim_config_.samples)
+        {
+            // Simulate window cycle accurately
+            switch_engine("rtl");
+            uint64_t instret = backend_.get_rtl_instret();
+            res = backend_.tick_n(sim_config_.sample_window, conds);
+            samples.push_back({total_insns, res.cycles, backend_.get_rtl_instret() - instret});
+            total_insns += samples.back().insns;
+            switch_engine("iss");
+
+            // Fast-forward to next sample (or till the end, after last sample)
+            if(res.reason == STOP_NONE)
+            {
+                res = backend_.tick_n(samples.size() < sim_config_.samples ? sim_config_.sample_interval : ULLONG_MAX, conds);
+                total_insns += res.cycles;
+            }
+        }
+
+        if(res.reason == STOP_EBREAK)
+            printf("EBreak hit at %ld instructions, PC=%s0x%08x%s\n", total_insns, ansicode(FG_BLUE), (uint32_t)backend_.read_reg("pc"), ansicode(FG_RESET));
+        else if(res.reason == STOP_CTRL_C)
+            printf("Interrupted at %ld instructions\n", total_insns);
+        else if(res.reason == STOP_MAXITR)
+        {
+            throwError("SIM0", "Simulation iterations exceeded maxitr("+std::to_string(sim_config_.maxitr)+")\n");
+            exitcode = EXIT_FAILURE;
+        }
+
+        // Report CPI of each sample & extrapolate total cycles
+        uint64_t win_cycles = 0, win_insns = 0;
+        printf("Sampled simulation: %ld samples of %ld cycles\n", samples.size(), sim_config_.sample_window);
+        printf("  %-4s %14s %10s %10s %7s\n", "#", "start insn", "cycles", "insns", "CPI");
+        for(unsigned i=0; i<samples.size(); i++)
+        {
+            const Sample_t &s = samples[i];
+            win_cycles += s.cycles;
+            win_insns += s.insns;
+            printf("  %-4u %14ld %10ld %10ld %7.3f\n", i, s.start, s.cycles, s.insns, s.insns ? (double)s.cycles / s.insns : 0.0);
+        }
+        double cpi = win_insns ? (double)win_cycles / win_insns : 0.0;
+        printf("Total instructions : %ld (%ld in RTL)\n", total_insns, win_insns);
+        printf("Sampled CPI        : %.3f\n", cpi);
+        printf("Estimated cycles   : %.0f\n", cpi * total_insns);
+    }
+    catch(std::exception &e)
+    {
+        std::cerr << "Runtime exception: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return exitcode;
+}
@@ -2,9 +2,12 @@
 
 #include <string>
 #include <vector>
+#include <unordered_map>
 // #include <memory>
 
 #include TARGET_HEADER
+#include "disasm.hpp"
+#include "semihosting.hpp"
 
 enum Rcode{
     RC_NONE, RC_OK, RC_STEP, RC_RUN, RC_EXIT
@@ -16,7 +19,6 @@ enum Rcode{
 // class Backend_atomsim;
 // class Simstate;
 struct Backend_config;
-struct DisassembledLine;
 
 /**
  * @brief Configuration struct for Atomsim class
@@ -36,11 +38,30 @@ struct Atomsim_config
     std::string ifile       = "";
     
     unsigned long int maxitr    = 1000000;
-    std::string trace_file      = "trace.vcd";  //  default loc: curr directory
+    std::string trace_file      = DEFAULT_TRACE_FILE;  //  default loc: curr directory
+    std::string trace_start     = "";   // start trace capture at: cycle, pc (0x..) or symbol
+    std::string trace_stop      = "";   // stop trace capture at: cycle, pc (0x..) or symbol
     std::string dump_file       = "dump.txt";
     std::string signature_file  = "";
+    std::string restore_file    = "";   // checkpoint to restore at start
 
-    bool print_info_topdown = true;
+    std::string commitlog_file  = "";   // binary commit log (decode with scripts/clogdump.py)
+
+    // sampling profiler
+    std::string profile_file            = "";       // flat profile (& <file>.folded call stacks) written at exit
+    unsigned long int profile_interval  = 1000;     // cycles between samples
+
+    // flight recorder
+    unsigned long int flightrec_depth   = 0;                // cycles kept by flight recorder (0: disabled)
+    std::string flightrec_file          = "flightrec.vcd";  // dumped at ebreak/exception/maxitr/ctrl+c
+
+    // sampled simulation
+    std::string sample_at               = "";       // start of first sample: instruction count, pc (0x..) or symbol
+    unsigned long int sample_window     = 100000;   // cycles simulated in RTL per sample
+    unsigned long int sample_interval   = 1000000;  // instructions fast-forwarded in ISS between samples
+    unsigned long int samples           = 10;       // number of samples
+
+    bool print_info_topdown = true;     // print cycle breakdown at exit (verbose mode)
 };
 
 struct Breakpoint_t {
@@ -66,6 +87,15 @@ public:
      */
     int run();
 
+    /**
+     * @brief run sampled simulation until finished
+     * @details fast-forwards in ISS to the start of first sample, then 
+     * alternates between cycle accurate windows in RTL and fast-forwarding 
+     * in ISS. CPI measured in the windows is used to estimate total cycles.
+     * @return int return code
+     */
+    int run_sampled();
+
 private:
     /**
      * @brief config struct object for sim
@@ -90,22 +120,103 @@ private:
     bool in_debug_mode_ = false;
 
     /**
-     * @brief Disassembly of input file
+     * @brief Disassembler (reads instructions from target memory)
+     */
+    Disassembler disassembler_;
+
+    /**
+     * @brief Semihosting host (services slli/ebreak/srai calls)
      */
-	std::map<uint32_t, DisassembledLine> disassembly_;
+    Semihosting semihost_;
 
 
     friend class Backend_atomsim;
     
     Breakpoint_t breakpoints_[NUM_MAX_BREAKPOINTS];
 
+    /**
+     * @brief Lookup table of active breakpoints (addr -> breakpoint number)
+     */
+    std::unordered_map<uint32_t, int> breakpoint_map_;
+
+    /**
+     * @brief Active watchpoints
+     */
+    std::vector<Watchpoint_t> watchpoints_;
+
+    /**
+     * @brief Direct handle to PC register (resolved at construction & after
+     * every engine switch, see refresh_reg_handles())
+     */
+    const uint32_t * pc_handle_ = nullptr;
+
     // used to provide cycles for step command
     long long pending_steps = 0;
 
     /**
-     * @brief step simulation by a cycle
+     * @brief step simulation by upto ncycles cycles
+     * @details returns early if ebreak, breakpoint, watchpoint, $finish, 
+     * maxitr or ctrl+c is encountered
+     * 
+     * @param ncycles max number of cycles
+     * @return TickResult_t reason for returning
+     */
+    TickResult_t step(uint64_t ncycles);
+
+    /**
+     * @brief Service semihosting call if ebreak in IR is part of one
+     * @details On success, result is written to a0 & the ebreak is 
+     * skipped, so that simulation can be resumed.
+     * @param pc pc of ebreak
+     * @return true if ebreak was a semihosting call
+     */
+    bool service_semihosting(uint32_t pc);
+
+    /**
+     * @brief rebuild breakpoint lookup table from breakpoints_ array
+     */
+    void update_breakpoint_map();
+
+    /**
+     * @brief Re-resolve register handles held by simulator (pc & watched
+     * registers); they point into storage of the active engine
+     */
+    void refresh_reg_handles();
+
+    /**
+     * @brief Switch simulation engine of backend & refresh register handles
+     * @param engine engine to switch to (rtl/iss)
+     */
+    void switch_engine(const std::string &engine);
+
+    /**
+     * @brief Parse a trace trigger specification
+     * 
+     * @param spec cycle (decimal), pc (0x..) or symbol; empty for no trigger
+     * @return TraceTrigger_t trigger
+     */
+    TraceTrigger_t parse_trace_trigger(const std::string &spec);
+
+    /**
+     * @brief Save full simulation state to a checkpoint file
+     * @param file checkpoint file
+     */
+    void save_checkpoint(const std::string &file);
+
+    /**
+     * @brief Restore full simulation state from a checkpoint file
+     * @details checkpoint must have been created by the same build of atomsim 
+     * with same backend configuration.
+     * @param file checkpoint file
+     */
+    void load_checkpoint(const std::string &file);
+
+    /**
+     * @brief Print cycle breakdown of RTL simulation (retired instructions,
+     * CPI & cycles lost to bus waits, flushes & sleep), followed by 
+     * statistics of memory system models
      */
-    void step();
+    void print_perf_info();
 
     /**
      * @brief initialize interactive mode
@@ -133,6 +244,7 @@ private:
     Rcode cmd_quit(const std::vector<std::string>&);
     Rcode cmd_verbose(const std::vector<std::string>&);
     Rcode cmd_trace(const std::vector<std::string>&);
+    Rcode cmd_checkpoint(const std::vector<std::string>&);
     
     // Control Commands
     Rcode cmd_reset(const std::vector<std::string>&);
@@ -141,6 +253,7 @@ private:
     Rcode cmd_rst(const std::vector<std::string>&);
     Rcode cmd_while(const std::vector<std::string>&);
     Rcode cmd_break(const std::vector<std::string>&);
+    Rcode cmd_watch(const std::vector<std::string>&);
     Rcode cmd_info(const std::vector<std::string>&);
 
     // Query Commands
@@ -1,10 +1,22 @@
 #pragma once
 
 #include "testbench.hpp"
+#include "iss.hpp"
+#include "flightrec.hpp"
+#include "commitlog.hpp"
+#include "busywait.hpp"
+#include "profiler.hpp"
+#include "perfcounters.hpp"
 #include "util.hpp"
 #include "except.hpp"
+#include "rvdefs.hpp"
 
 #include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <climits>
+#include <memory>
 
 enum Regwidth_t {
     R8=8, 
@@ -21,6 +33,60 @@ struct ArchReg_t {
     bool is_arch_reg;
 };
 
+struct Watchpoint_t {
+    bool active = false;
+    std::string reg;
+    const uint32_t * handle = nullptr;
+    uint32_t value = 0;         // last observed value
+};
+
+/**
+ * @brief Reason for which Backend::tick_n() returned
+ */
+enum StopReason_t {
+    STOP_NONE,          // ran for requested number of cycles
+    STOP_EBREAK,        // ebreak instruction reached IR
+    STOP_BREAKPOINT,    // PC reached a breakpoint
+    STOP_WATCHPOINT,    // watched register changed value
+    STOP_FINISH,        // verilator encountered $finish
+    STOP_MAXITR,        // total tick count exceeded maxitr
+    STOP_CTRL_C,        // user pressed Ctrl+C
+    STOP_DIVERGENCE     // target diverged from reference ISS (lockstep mode)
+};
+
+/**
+ * @brief Conditions checked after every cycle by Backend::tick_n()
+ */
+struct StopConditions_t {
+    bool on_ebreak = true;
+    const std::unordered_map<uint32_t, int> * breakpoints = nullptr;  // addr -> breakpoint number
+    std::vector<Watchpoint_t> * watchpoints = nullptr;
+    uint64_t maxitr = ULLONG_MAX;
+    bool maxitr_instret = false;    // maxitr limits total instructions retired (ISS + RTL) instead of ticks
+    const volatile bool * ctrl_c = nullptr;
+};
+
+/**
+ * @brief Event which starts/stops trace capture
+ */
+struct TraceTrigger_t {
+    enum Type_t {
+        NONE,       // no trigger
+        CYCLE,      // total tick count reached value
+        PC          // PC equals value
+    } type = NONE;
+    uint64_t value = 0;
+};
+
+/**
+ * @brief Result of Backend::tick_n()
+ */
+struct TickResult_t {
+    StopReason_t reason = STOP_NONE;
+    int id = -1;            // breakpoint/watchpoint number (if any)
+    uint64_t cycles = 0;    // number of cycles run
+};
+
 // Forward declaration
 class Atomsim;
 
@@ -58,6 +124,117 @@ public:
 	 */
 	int tick();
 
+	/**
+	 * @brief Tick for up to max_cycles cycles in a tight loop
+	 * @details Returns early if any of the stop conditions fires, or if the 
+	 * simulation has finished
+	 * 
+	 * @param max_cycles maximum number of cycles to run
+	 * @param conds stop conditions
+	 * @return TickResult_t reason for returning & number of cycles run
+	 */
+	TickResult_t tick_n(uint64_t max_cycles, const StopConditions_t &conds);
+
+    /**
+     * @brief Drive/service target signals before every cycle [** MAY OVERRIDE **]
+     */
+    virtual void pre_tick() {}
+
+    /**
+     * @brief Fast-forward over cycles in which target is idle [** MAY OVERRIDE **]
+     * @details Called before every cycle while idle_skip_ is set (and trace
+     * is not being dumped). Overriding methods may advance the model by up
+     * to max_cycles cycles at once without evaluating it, as long as the 
+     * result is identical to simulating them.
+     * @param max_cycles maximum number of cycles to skip
+     * @return uint64_t number of cycles skipped (0: cycle must be simulated)
+     */
+    virtual uint64_t skip_idle(uint64_t max_cycles) { return 0; }
+
+    /**
+     * @brief Get number of cycles fast-forwarded by skip_idle()
+     * @return uint64_t
+     */
+    uint64_t get_skipped_cycles()   { return skipped_cycles_; }
+
+    /**
+     * @brief Fast-forward over iterations of a busy-wait loop [** MAY OVERRIDE **]
+     * @details Called before every cycle (that isn't skipped by skip_idle())
+     * while busywait_ is set, unless something observes individual cycles or
+     * instructions (trace, flight recorder, commit log, lockstep, breakpoints
+     * & watchpoints). Overriding methods should feed the cycle to busywait_
+     * and apply the iterations it returns, advancing counters outside the
+     * register file accordingly.
+     * @param max_cycles maximum number of cycles to skip
+     * @return uint64_t number of cycles skipped (0: cycle must be simulated)
+     */
+    virtual uint64_t skip_busywait(uint64_t max_cycles) { return 0; }
+
+    /**
+     * @brief Get number of busy-wait loop skips
+     * @return uint64_t
+     */
+    uint64_t get_busywait_skips()   { return busywait_ ? busywait_->get_skips() : 0; }
+
+    /**
+     * @brief Get number of cycles fast-forwarded by skip_busywait()
+     * @return uint64_t
+     */
+    uint64_t get_busywait_cycles()  { return busywait_ ? busywait_->get_skipped_cycles() : 0; }
+
+    /**
+     * @brief Get number of cycles fast-forwarded by skip_busywait() in loops
+     * whose exit couldn't be predicted (approximate, see --busywait-approx)
+     * @return uint64_t
+     */
+    uint64_t get_busywait_approx_cycles()   { return busywait_ ? busywait_->get_approx_cycles() : 0; }
+
+    /**
+     * @brief Get cycle breakdown of RTL simulation (counted by backends 
+     * that call count_perf())
+     * @return const PerfCounters_t& 
+     */
+    const PerfCounters_t & get_perf_counters()  { return perf_; }
+
+    /**
+     * @brief Compare target against reference ISS after every cycle (lockstep mode) [** MAY OVERRIDE **]
+     * @details Only called if ref_iss_ is set. On divergence, overriding 
+     * methods should describe it in divergence_.
+     * @return false if target diverged from reference ISS
+     */
+    virtual bool lockstep_check() { return true; }
+
+    /**
+     * @brief Register target signals with flight recorder [** MAY OVERRIDE **]
+     * @details Overriding methods may also point exception_flag_ to a signal
+     * which is set in cycles in which an exception is taken.
+     * @param fr flight recorder
+     */
+    virtual void setup_flightrec(FlightRecorder &fr);
+
+    /**
+     * @brief Prepare target for logging committed instructions [** MAY OVERRIDE **]
+     * @details Overriding methods should push a record to commitlog_ for 
+     * every instruction retired (while commitlog_ is set).
+     */
+    virtual void setup_commitlog();
+
+#ifdef ATOMSIM_SAVABLE
+    /**
+     * @brief Save backend state to a checkpoint         [** MAY OVERRIDE **]
+     * @details Overriding methods should save the state of backend models 
+     * (memories, uart etc.) after calling this.
+     * @param os serializer to write to
+     */
+    virtual void save_state(VerilatedSerialize &os);
+
+    /**
+     * @brief Restore backend state from a checkpoint    [** MAY OVERRIDE **]
+     * @param is deserializer to read from
+     */
+    virtual void restore_state(VerilatedDeserialize &is);
+#endif
+
 	/**
 	 * @brief check if simulation is done
 	 * @return true 
@@ -65,6 +242,53 @@ public:
 	 */
 	bool done();
 
+    /**
+     * @brief Check if backend simulates using the functional ISS instead of RTL
+     * @return true if using ISS
+     */
+    bool using_iss()    { return iss_ != nullptr; }
+
+    /**
+     * @brief Switch simulation engine, transferring architectural state [** MAY OVERRIDE **]
+     * @details Register map is rebuilt, so handles returned by 
+     * get_reg_handle32() before the switch must be resolved again.
+     * @param engine engine to switch to (rtl/iss)
+     */
+    virtual void switch_engine(const std::string &engine);
+
+    /**
+     * @brief Step over instruction in IR without executing it [** MAY OVERRIDE **]
+     * @details Used to resume after the ebreak of a semihosting call. RTL 
+     * targets get the instruction replaced with a nop in the pipeline.
+     */
+    virtual void skip_insn();
+
+    /**
+     * @brief Get number of instructions retired by RTL   [** MAY OVERRIDE **]
+     * @return uint64_t instructions retired (in total)
+     */
+    virtual uint64_t get_rtl_instret();
+
+    /**
+     * @brief Get number of instructions retired by ISS and RTL together [** MAY OVERRIDE **]
+     * @details Unlike get_total_tick_count(), counts the same unit whichever
+     * engine is active.
+     * @return uint64_t instructions retired (in total)
+     */
+    virtual uint64_t get_total_instret();
+
+    /**
+     * @brief Check if backend runs the RTL in lockstep with a reference ISS
+     * @return true if in lockstep mode
+     */
+    bool using_lockstep()   { return ref_iss_ != nullptr; }
+
+    /**
+     * @brief Get description of last divergence (lockstep mode)
+     * @return const std::string& 
+     */
+    const std::string & get_divergence()    { return divergence_; }
+
     /**
      * @brief Open trace file 
      * @param file 
@@ -72,11 +296,56 @@ public:
     void open_trace(std::string file);
 
     /**
-     * @brief Open trace file 
-     * @param file 
+     * @brief Close trace file 
      */
     void close_trace();
 
+    /**
+     * @brief Set window of simulation captured in trace file
+     * @details Dumping to trace file is paused until start trigger fires, 
+     * and stops (for good) when stop trigger fires. Triggers are evaluated 
+     * after every cycle.
+     * 
+     * @param start start trigger (NONE: start of simulation)
+     * @param stop stop trigger (NONE: end of simulation)
+     */
+    void set_trace_window(const TraceTrigger_t &start, const TraceTrigger_t &stop);
+
+    /**
+     * @brief Enable flight recorder
+     * @param depth number of cycles to keep
+     * @param file file to dump recorded cycles to
+     */
+    void enable_flightrec(uint64_t depth, const std::string &file);
+
+    /**
+     * @brief Enable binary commit log
+     * @param file output file
+     */
+    void enable_commitlog(const std::string &file);
+
+    /**
+     * @brief Enable sampling profiler
+     * @param elf_file ELF file to read symbols from
+     * @param file output file (folded call stacks go to <file>.folded)
+     * @param interval cycles between samples
+     */
+    void enable_profiler(const std::string &elf_file, const std::string &file, uint64_t interval);
+
+    /**
+     * @brief Get number of profiler samples taken (0 if not enabled)
+     * @return uint64_t
+     */
+    uint64_t get_profiler_samples()     { return profiler_ ? profiler_->get_samples() : 0; }
+
+    /**
+     * @brief Dump flight recorder to file (if enabled)
+     * @param reason event which triggered the dump
+     * @param suffix inserted before extension of flight recorder file (to 
+     * keep dumps of different events apart)
+     */
+    void dump_flightrec(const std::string &reason, const std::string &suffix="");
+
     /**
      * @brief Get the total tick count from tb
      * @return uint64_t 
@@ -107,6 +376,18 @@ public:
      */
     virtual void store(const uint32_t start_addr, uint8_t *buf, const uint32_t buf_sz);
 
+    /**
+     * @brief Print memory map of target, with host memory used by each 
+     * memory block                                     [** MAY OVERRIDE **]
+     */
+    virtual void print_mem_info();
+
+    /**
+     * @brief Print configuration & statistics of memory system timing 
+     * models (caches, memory regions), if any          [** MAY OVERRIDE **]
+     */
+    virtual void print_memsys_info() {}
+
     /**
      * @brief read register value                       [** MAY OVERRIDE **]
      * 
@@ -122,6 +403,16 @@ public:
     */
     virtual void write_reg(const std::string name, uint64_t value);
 
+    /**
+     * @brief Get a direct handle to a 32-bit register
+     * @details Resolves the register once, so that callers in the simulation 
+     * loop can dereference it every cycle without going through read_reg()
+     * 
+     * @param name register name
+     * @return const uint32_t* handle to register value
+     */
+    const uint32_t * get_reg_handle32(const std::string name);
+
 protected:
 	/**
      * @brief Pointer to Atomsim object
@@ -134,6 +425,157 @@ protected:
 	 */
 	Testbench<VTarget> *tb;
 
+    /**
+     * @brief Pointer to ISS object (only if using the iss engine); when set, 
+     * it is ticked instead of testbench
+     * NOTE: To be initialized and deleted by child class
+     */
+    ISS *iss_ = nullptr;
+
+    /**
+     * @brief Pointer to reference ISS (only in lockstep mode); when set, it is
+     * stepped along with the RTL and compared against it by lockstep_check()
+     * NOTE: To be initialized and deleted by child class
+     */
+    ISS *ref_iss_ = nullptr;
+
+    /**
+     * @brief Description of last divergence (lockstep mode)
+     */
+    std::string divergence_;
+
+    /**
+     * @brief Flight recorder (if enabled); records target signals before 
+     * every clock edge
+     */
+    std::unique_ptr<FlightRecorder> flightrec_;
+    std::string flightrec_file_;
+
+    /**
+     * @brief Commit log (if enabled)
+     */
+    std::unique_ptr<CommitLog> commitlog_;
+
+    /**
+     * @brief Sampling profiler (if enabled); sees pc & ir after every cycle
+     */
+    std::unique_ptr<Profiler> profiler_;
+
+    /**
+     * @brief Signal which is set in cycles in which an exception is taken
+     * (used to trigger a flight recorder dump); set by setup_flightrec()
+     */
+    const uint8_t *exception_flag_ = nullptr;
+
+    /**
+     * @brief Set once flight recorder has been dumped on an exception
+     */
+    bool flightrec_exception_dumped_ = false;
+
+    /**
+     * @brief Record a cycle in flight recorder; dumps it on first exception
+     */
+    void record_flightrec();
+
+    /**
+     * @brief Trace window triggers
+     */
+    TraceTrigger_t trace_start_;
+    TraceTrigger_t trace_stop_;
+
+    /**
+     * @brief True while trace triggers need to be evaluated
+     */
+    bool trace_window_ = false;
+
+    /**
+     * @brief True once start trigger has fired
+     */
+    bool trace_started_ = true;
+
+    /**
+     * @brief Handles to pc & ir read by tick() for profiler & trace window 
+     * (resolved when either is enabled, see resolve_tick_handles())
+     */
+    const uint32_t * tick_pc_ = nullptr;
+    const uint32_t * tick_ir_ = nullptr;
+
+    /**
+     * @brief Resolve tick_pc_ & tick_ir_; must be called again whenever 
+     * the register map is rebuilt (e.g. by switch_engine())
+     */
+    void resolve_tick_handles()
+    {
+        tick_pc_ = get_reg_handle32("pc");
+        tick_ir_ = get_reg_handle32("ir");
+    }
+
+    /**
+     * @brief Evaluate trace triggers & pause/resume dumping accordingly
+     * @param pc current PC
+     */
+    void update_trace_window(uint32_t pc);
+
+    /**
+     * @brief Enables skip_idle() (set by backends that implement it)
+     */
+    bool idle_skip_ = false;
+
+    /**
+     * @brief Cycles fast-forwarded by skip_idle()
+     */
+    uint64_t skipped_cycles_ = 0;
+
+    /**
+     * @brief Busy-wait loop detector (set by backends that implement 
+     * skip_busywait())
+     */
+    std::unique_ptr<BusyWait> busywait_;
+
+    /**
+     * @brief Cycle breakdown of RTL simulation
+     */
+    PerfCounters_t perf_;
+
+    /**
+     * @brief Class of last counted cycle
+     */
+    PerfClass_t perf_class_ = PERF_OTHER;
+
+    /**
+     * @brief Reason for bubble (if any) entering stage2 in next cycle
+     */
+    PerfClass_t bubble_class_ = PERF_OTHER;
+
+    /**
+     * @brief Account current cycle in perf_ (call from pre_tick(), once 
+     * inputs of the cycle are set)
+     * @details Samples pipeline control signals of the core, which must be
+     * public in the verilated model. Whether stage2 is stalled on dbus is 
+     * passed by the caller, since combinational signals depending on inputs 
+     * set in pre_tick() are only settled at the next eval.
+     * 
+     * @param core verilated AtomRV instance
+     * @param dbus_wait stage2 waits for dbus response in this cycle
+     */
+    template <class Core>
+    void count_perf(const Core *core, bool dbus_wait)
+    {
+        if(dbus_wait)
+            perf_class_ = PERF_DBUS;
+        else if(core->InstructionRegister_Valid)
+            perf_class_ = PERF_RETIRE;
+        else if(core->halted)
+            perf_class_ = PERF_HALT;
+        else
+            perf_class_ = bubble_class_;
+        perf_.cycles[perf_class_]++;
+
+        // a bubble entering stage2 at the upcoming clock edge is due to a 
+        // jump, sleep, or else stage1 not having received an instruction
+        bubble_class_ = core->jump_decision ? PERF_FLUSH : core->halted ? PERF_HALT : PERF_IBUS;
+    }
+
     /**
      * @brief Map or architectural registers
     */
@@ -151,7 +593,16 @@ Backend<VTarget>::Backend(Atomsim *sim_ptr):
 template <class VTarget>
 void Backend<VTarget>::reset()
 {
-    tb->reset();
+    if(iss_)
+        iss_->reset();
+    else
+        tb->reset();
+
+    if(ref_iss_)
+        ref_iss_->reset();
+
+    // pipeline is empty after reset
+    bubble_class_ = PERF_OTHER;
 }
 
 template <class VTarget>
@@ -160,20 +611,221 @@ int Backend<VTarget>::tick()
     if(done())
         return 1;
 
+    if(iss_) {
+        iss_->step();
+        if(profiler_)
+            profiler_->tick(get_total_tick_count(), *tick_pc_, *tick_ir_, PERF_RETIRE);
+        return 0;
+    }
+
+    // busy-wait detector can't see this cycle
+    if(busywait_)
+        busywait_->reset();
+
+    pre_tick();
+    if(flightrec_)
+        record_flightrec();
     tb->tick();
+
+    if(profiler_)
+        profiler_->tick(get_total_tick_count(), *tick_pc_, *tick_ir_, perf_class_);
+
+    if(trace_window_)
+        update_trace_window(*tick_pc_);
     return 0;
 }
 
+template <class VTarget>
+TickResult_t Backend<VTarget>::tick_n(uint64_t max_cycles, const StopConditions_t &conds)
+{
+    TickResult_t res;
+    if(done()) {
+        res.reason = STOP_FINISH;
+        return res;
+    }
+
+    const uint32_t * pc = get_reg_handle32("pc");
+    const uint32_t * ir = get_reg_handle32("ir");
+    uint32_t last_pc = *pc;
+
+    const bool check_breakpoints = conds.breakpoints && !conds.breakpoints->empty();
+    const bool check_watchpoints = conds.watchpoints && !conds.watchpoints->empty();
+
+    const bool check_trace_window = trace_window_ && !iss_;
+
+    // counter limited by maxitr
+    auto itr_count = [&]() -> uint64_t {
+        return conds.maxitr_instret ? get_total_instret() : get_total_tick_count();
+    };
+
+    auto stop = [&]() -> bool {
+        // ISS executes an instruction in every cycle
+        if(profiler_)
+            profiler_->tick(get_total_tick_count(), *pc, *ir, iss_ ? PERF_RETIRE : perf_class_);
+
+        if(check_trace_window && trace_window_)
+            update_trace_window(*pc);
+
+        if(ref_iss_ && !lockstep_check()) {
+            res.reason = STOP_DIVERGENCE;
+            return true;
+        }
+
+        if(conds.on_ebreak && *ir == RV_INSTR_EBREAK) {
+            res.reason = STOP_EBREAK;
+            return true;
+        }
+
+        // breakpoints only need to be evaluated when PC changes
+        if(check_breakpoints && *pc != last_pc) {
+            last_pc = *pc;
+            auto bp = conds.breakpoints->find(last_pc);
+            if(bp != conds.breakpoints->end()) {
+                res.reason = STOP_BREAKPOINT;
+                res.id = bp->second;
+                return true;
+            }
+        }
+
+        if(check_watchpoints) {
+            // update all watchpoints, report the first one that changed
+            for(unsigned i=0; i<conds.watchpoints->size(); i++) {
+                Watchpoint_t &wp = (*conds.watchpoints)[i];
+                if(wp.active && *wp.handle != wp.value) {
+                    wp.value = *wp.handle;
+                    if(res.reason == STOP_NONE) {
+                        res.reason = STOP_WATCHPOINT;
+                        res.id = i;
+                    }
+                }
+            }
+            if(res.reason == STOP_WATCHPOINT)
+                return true;
+        }
+
+        if(itr_count() > conds.maxitr) {
+            res.reason = STOP_MAXITR;
+            return true;
+        }
+
+        if(conds.ctrl_c && *conds.ctrl_c) {
+            res.reason = STOP_CTRL_C;
+            return true;
+        }
+        return false;
+    };
+
+    // idle cycles are not skipped while trace or flight recorder is on, so 
+    // that they record every cycle; skips are limited to maxitr, so that 
+    // runs end at the same cycle
+    const bool can_skip = !iss_ && !tb->isTraceOpen() && !flightrec_;
+    const bool check_idle = idle_skip_ && can_skip;
+
+    // busy-wait loops are also run through while anything needs to see 
+    // every instruction
+    const bool check_busywait = busywait_ && can_skip && !ref_iss_ && !commitlog_ 
+                                && !check_breakpoints && !check_watchpoints && !check_trace_window;
+    if(busywait_ && !check_busywait)
+        busywait_->reset();
+
+    auto skip = [&](uint64_t n) -> uint64_t {
+        // a skipped cycle retires at most one instruction, so this also 
+        // bounds skips when maxitr counts instructions
+        uint64_t t = itr_count();
+        if((!check_idle && !check_busywait) || t > conds.maxitr)
+            return 0;
+        n = std::min(n, conds.maxitr + 1 - t);
+        uint64_t skipped = check_idle ? skip_idle(n) : 0;
+        skipped_cycles_ += skipped;
+        perf_.cycles[PERF_HALT] += skipped;
+        if(!skipped && check_busywait)
+            skipped = skip_busywait(n);
+        return skipped;
+    };
+
+    if(iss_)
+        res.cycles = iss_->run(max_cycles, stop);
+    else if(flightrec_)
+        res.cycles = tb->tick_n(max_cycles, [this]() { pre_tick(); record_flightrec(); }, skip, stop);
+    else
+        res.cycles = tb->tick_n(max_cycles, [this]() { pre_tick(); }, skip, stop);
+
+    if(res.reason == STOP_NONE && done())
+        res.reason = STOP_FINISH;
+
+    // trace is flushed in batches while ticking, make sure it is 
+    // complete when we return to user
+    if(!iss_ && tb->isTraceOpen())
+        tb->flushTrace();
+
+    return res;
+}
+
+#ifdef ATOMSIM_SAVABLE
+template <class VTarget>
+void Backend<VTarget>::save_state(VerilatedSerialize &os)
+{
+    if(ref_iss_)
+        throw Atomsim_exception("checkpoints are not supported in lockstep mode");
+
+    if(iss_)
+        os.write(&iss_->state(), sizeof(ISS_state_t));
+    else
+        tb->save(os);
+
+    // statistics, so that they continue from the restored timeline
+    os.write(&perf_, sizeof(PerfCounters_t));
+    uint64_t bw_skips = get_busywait_skips(), bw_cycles = get_busywait_cycles(), bw_approx = get_busywait_approx_cycles();
+    os << skipped_cycles_ << bw_skips << bw_cycles << bw_approx;
+}
+
+template <class VTarget>
+void Backend<VTarget>::restore_state(VerilatedDeserialize &is)
+{
+    if(ref_iss_)
+        throw Atomsim_exception("checkpoints are not supported in lockstep mode");
+
+    if(iss_) {
+        is.read(&iss_->state(), sizeof(ISS_state_t));
+        iss_->flush_icache();
+    }
+    else
+        tb->restore(is);
+
+    is.read(&perf_, sizeof(PerfCounters_t));
+    uint64_t bw_skips, bw_cycles, bw_approx;
+    is >> skipped_cycles_ >> bw_skips >> bw_cycles >> bw_approx;
+    if(busywait_)
+        busywait_->set_stats(bw_skips, bw_cycles, bw_approx);
+
+    // recorded cycles don't belong to restored timeline
+    if(flightrec_)
+        flightrec_->clear();
+    if(busywait_)
+        busywait_->reset();
+}
+#endif
+
 template <class VTarget>
 bool Backend<VTarget>::done()
 {
+    if(iss_)
+        return false;   // ISS never encounters $finish
     return tb->done();
 }
 
 template <class VTarget>
 void Backend<VTarget>::open_trace(std::string file)
 {
+    if(iss_)
+        throw Atomsim_exception("tracing is not supported with iss engine");
     tb->openTrace(file.c_str());
+
+    // hold off dumping until start trigger fires
+    if(!trace_started_) {
+        tb->setTraceDump(false);
+        update_trace_window(*get_reg_handle32("pc"));
+    }
 }
 
 template <class VTarget>
@@ -182,18 +834,173 @@ void Backend<VTarget>::close_trace()
     tb->closeTrace();
 }
 
+template <class VTarget>
+void Backend<VTarget>::setup_flightrec(FlightRecorder &/*fr*/)
+{
+    throw Atomsim_exception("flight recorder is not supported for current target");
+}
+
+template <class VTarget>
+void Backend<VTarget>::enable_flightrec(uint64_t depth, const std::string &file)
+{
+    if(iss_)
+        throw Atomsim_exception("flight recorder is not supported with iss engine");
+
+    flightrec_.reset(new FlightRecorder(depth));
+    flightrec_file_ = file;
+    setup_flightrec(*flightrec_);
+}
+
+template <class VTarget>
+void Backend<VTarget>::setup_commitlog()
+{
+    throw Atomsim_exception("commit log is not supported for current target");
+}
+
+template <class VTarget>
+void Backend<VTarget>::enable_commitlog(const std::string &file)
+{
+    if(iss_)
+        throw Atomsim_exception("commit log is not supported with iss engine");
+
+    setup_commitlog();
+    commitlog_.reset(new CommitLog(file));
+}
+
+template <class VTarget>
+void Backend<VTarget>::enable_profiler(const std::string &elf_file, const std::string &file, uint64_t interval)
+{
+    profiler_.reset(new Profiler(elf_file, file, interval));
+    resolve_tick_handles();
+}
+
+template <class VTarget>
+void Backend<VTarget>::record_flightrec()
+{
+    flightrec_->record(tb->get_total_tickcount());
+
+    if(exception_flag_ && *exception_flag_ && !flightrec_exception_dumped_) {
+        flightrec_exception_dumped_ = true;
+        // separate file, so that a later dump (e.g. at exit) doesn't overwrite it
+        dump_flightrec("exception", ".exception");
+    }
+}
+
+template <class VTarget>
+void Backend<VTarget>::dump_flightrec(const std::string &reason, const std::string &suffix)
+{
+    if(!flightrec_ || flightrec_->get_count() == 0)
+        return;
+
+    std::string file = flightrec_file_;
+    size_t dot = file.find_last_of("./");
+    if(dot == std::string::npos || file[dot] == '/')
+        dot = file.size();
+    file.insert(dot, suffix);
+
+    flightrec_->dump(file);
+    printf("Flight recorder: last %lu cycles dumped to \"%s\" (%s)\n", (unsigned long)flightrec_->get_count(), 
+        file.c_str(), reason.c_str());
+}
+
+template <class VTarget>
+void Backend<VTarget>::set_trace_window(const TraceTrigger_t &start, const TraceTrigger_t &stop)
+{
+    trace_start_ = start;
+    trace_stop_ = stop;
+    trace_started_ = (start.type == TraceTrigger_t::NONE);
+    trace_window_ = (start.type != TraceTrigger_t::NONE) || (stop.type != TraceTrigger_t::NONE);
+    if(trace_window_)
+        resolve_tick_handles();
+}
+
+template <class VTarget>
+void Backend<VTarget>::update_trace_window(uint32_t pc)
+{
+    if(!tb->isTraceOpen())
+        return;
+
+    auto fired = [&](const TraceTrigger_t &t) -> bool {
+        switch(t.type) {
+            case TraceTrigger_t::CYCLE: return tb->get_total_tickcount() >= t.value;
+            case TraceTrigger_t::PC:    return pc == t.value;
+            default:                    return false;
+        }
+    };
+
+    if(!trace_started_) {
+        if(fired(trace_start_)) {
+            tb->setTraceDump(true);
+            trace_started_ = true;
+            trace_window_ = (trace_stop_.type != TraceTrigger_t::NONE);
+        }
+    }
+    else if(fired(trace_stop_)) {
+        tb->setTraceDump(false);
+        tb->flushTrace();
+        trace_window_ = false;
+    }
+}
+
 template <class VTarget>
 uint64_t Backend<VTarget>::get_total_tick_count()
 {
+    if(iss_)
+        return iss_->state().instret_total;
     return tb->get_total_tickcount();
 }
 
 template <class VTarget>
 uint64_t Backend<VTarget>::get_tick_count()
 {
+    if(iss_)
+        return iss_->state().instret;
     return tb->get_tickcount();
 }
 
+template <class VTarget>
+void Backend<VTarget>::switch_engine(const std::string &/*engine*/)
+{
+    throw Atomsim_exception("switching simulation engine is not supported for current target");
+}
+
+template <class VTarget>
+void Backend<VTarget>::skip_insn()
+{
+    if(ref_iss_)
+        throw Atomsim_exception("skipping instructions is not supported in lockstep mode");
+
+    uint32_t *ir = (uint32_t *)get_reg_handle32("ir");
+    if(iss_) {
+        // ISS holds the next instruction in IR (expanded); move past it
+        uint32_t pc = *get_reg_handle32("pc");
+        iss_->set_pc(pc + (((iss_->state().ir_raw & 0b11) == 0b11) ? 4 : 2));
+    } else {
+        *ir = RV_INSTR_NOP;
+        tb->eval();
+    }
+}
+
+template <class VTarget>
+uint64_t Backend<VTarget>::get_rtl_instret()
+{
+    throw Atomsim_exception("counting retired instructions is not supported for current target");
+}
+
+template <class VTarget>
+uint64_t Backend<VTarget>::get_total_instret()
+{
+    if(iss_)
+        return iss_->state().instret_total;
+    return get_rtl_instret();
+}
+
+template <class VTarget>
+void Backend<VTarget>::print_mem_info()
+{
+    throw Atomsim_exception("memory info is not supported for current target");
+}
+
 template <class VTarget>
 void Backend<VTarget>::fetch(const uint32_t /*start_addr*/, uint8_t */*buf*/, const uint32_t /*buf_sz*/)
 {
@@ -230,6 +1037,20 @@ uint64_t Backend<VTarget>::read_reg(const std::string name)
     throw Atomsim_exception("Invalid register: " + name);
 }
 
+template <class VTarget>
+const uint32_t * Backend<VTarget>::get_reg_handle32(const std::string name)
+{
+    for(auto it = regs_.begin(); it != regs_.end(); it++){
+        if(it->name == name || it->alt_name == name) {
+            if(it->width != R32)
+                throw Atomsim_exception("Register is not 32-bit wide: " + name);
+            return (const uint32_t *) it->ptr;
+        }
+    }
+
+    throw Atomsim_exception("Invalid register: " + name);
+}
+
 template <class VTarget>
 void Backend<VTarget>::write_reg(const std::string name, uint64_t value)
 {
@@ -246,6 +1067,7 @@ void Backend<VTarget>::write_reg(const std::string name, uint64_t value)
                 default:
                     *((uint64_t*)it->ptr) = value; break;
             }
+            return;
         }
     }
 
@@ -2,14 +2,17 @@
 
 #include "atomsim.hpp"
 #include "memory.hpp"
+#include "loader.hpp"
 #include "vuart.hpp"
 #include "except.hpp"
 #include "util.hpp"
 #include "rvdefs.hpp"
 
-#include "build/verilated/VAtomBones_headers.h"
+#include "VAtomBones_headers.h"
 
-#include "elfio/elfio.hpp"
+#include <algorithm>
+#include <string.h>
+#include <unistd.h>
 
 #define UART_ADDR 0x40000000
 
@@ -25,19 +28,103 @@ Backend_atomsim::Backend_atomsim(Atomsim * sim, Backend_config config):
     try
     {
         mem_["bootrom"] = std::shared_ptr<Memory> (new Memory(config_.bootrom_size_kb * 1024, config_.bootrom_offset, true));
-        mem_["ram"] = std::shared_ptr<Memory> (new Memory(config_.ram_size_kb * 1024, config_.ram_offset, false));
+        mem_["ram"] = std::shared_ptr<Memory> (new Memory(config_.ram_size_kb * 1024, config_.ram_offset, false, config_.sparse_ram));
     }
     catch(const std::exception& e)
     {
         std::cerr << e.what() << '\n';
     }
 
+    for (auto &mem_block: mem_)
+        memmap_.add(mem_block.second.get());
+
+    // Construct cache models (if enabled)
+    if(config_.icache != "")
+        icache_.reset(new Cache(parse_cache_config(config_.icache)));
+    if(config_.dcache != "")
+        dcache_.reset(new Cache(parse_cache_config(config_.dcache)));
+
+    // Construct memory timing model (if any regions are timed)
+    memtiming_.reset(new MemTiming(config_.mem_timing, mem_));
+    if(memtiming_->empty())
+        memtiming_.reset();
+
+    // Construct ISS object (if using iss engine)
+    if(config_.engine == "iss")
+    {
+        iss_ = new ISS(config_.bootrom_offset);
+        iss_->add_region(mem_["bootrom"].get());
+        iss_->add_region(mem_["ram"].get());
+
+        iss_->mmio_load = [this](uint32_t addr, uint32_t &data) -> bool {
+            if(addr != UART_ADDR)
+                return false;
+            data = uart_read();
+            return true;
+        };
+        iss_->mmio_store = [this](uint32_t addr, uint32_t data, uint8_t sel) -> bool {
+            if(addr != UART_ADDR)
+                return false;
+            if(sel & 0b0001)
+                uart_write(data & 0xff);
+            return true;
+        };
+    }
+    else if(config_.engine != "rtl")
+        throw Atomsim_exception("invalid engine: "+config_.engine+" (expected rtl/iss)");
+
+    // Construct reference ISS (if running in lockstep mode). It shares memories 
+    // with the RTL, and mmio reads return the data seen by RTL on dport.
+    if(config_.lockstep)
+    {
+        if(iss_)
+            throw Atomsim_exception("lockstep mode requires rtl engine");
+
+        ref_iss_ = new ISS(config_.bootrom_offset);
+        ref_iss_->add_region(mem_["bootrom"].get());
+        ref_iss_->add_region(mem_["ram"].get());
+
+        ref_iss_->mmio_load = [this](uint32_t addr, uint32_t &data) -> bool {
+            if(addr != UART_ADDR)
+                return false;
+            data = ls_.uart_rdata;
+            return true;
+        };
+        ref_iss_->mmio_store = [](uint32_t addr, uint32_t /*data*/, uint8_t /*sel*/) -> bool {
+            return addr == UART_ADDR;   // only compared against RTL store
+        };
+    }
+
     // Construct reg map
-    regs_.push_back({.name="pc", .alt_name="", .width=R32, .ptr=(void *)&tb->m_core->AtomBones->atom_core->ProgramCounter_Old, .is_arch_reg=false});
-    regs_.push_back({.name="ir", .alt_name="", .width=R32, .ptr=(void *)&tb->m_core->AtomBones->atom_core->InstructionRegister, .is_arch_reg=false});
-    for (int i=0; i<32; i++) {
-        std::string regname = "x"+std::to_string(i);
-        regs_.push_back({.name=regname, .alt_name=rv_abi_regnames[i], .width=R32, .ptr=(void *)&tb->m_core->AtomBones->atom_core->rf->regs[i], .is_arch_reg=true});
+    build_regmap();
+
+    // Construct busy-wait loop detector (watches RTL register file & counters)
+    if(config_.busywait_skip)
+    {
+        auto core = tb->m_core->AtomBones->atom_core;
+        std::vector<uint32_t *> rf;
+        for (int i=0; i<32; i++)
+            rf.push_back(&core->rf->regs[i]);
+        std::vector<uint64_t *> counters = {&rtl_instret_};
+        for (int i=0; i<PERF_NCLASSES; i++)
+            counters.push_back(&perf_.cycles[i]);
+        for (Cache *c: {icache_.get(), dcache_.get()})
+        {
+            if(!c)
+                continue;
+            Cache::Stats_t &st = c->get_stats();
+            counters.insert(counters.end(), {&st.reads, &st.read_misses, &st.writes, &st.write_misses, &st.writebacks});
+        }
+        if(memtiming_)
+        {
+            std::vector<uint64_t *> c = memtiming_->get_counters();
+            counters.insert(counters.end(), c.begin(), c.end());
+        }
+        #ifdef EN_RVZICSR
+        counters.push_back(&core->csr_unit->csr_cycle);
+        counters.push_back(&core->csr_unit->csr_instret);
+        #endif
+        busywait_.reset(new BusyWait(rf, counters, config_.busywait_approx));
     }
     
     // ====== Initialize ========
@@ -77,6 +164,9 @@ Backend_atomsim::Backend_atomsim(Atomsim * sim, Backend_config config):
             std::cout << "Relaying uart-rx to stdout (Note: This mode does not support uart-tx)" << std::endl;
     }
 
+    if (config_.mem_bench)
+        printf("Memory access: %.2f ns/access\n", memmap_.benchmark());
+
     if (sim_->sim_config_.verbose_flag)
         std::cout << "Initialization complete!\n";
     
@@ -94,11 +184,44 @@ Backend_atomsim::~Backend_atomsim()
             delete vuart_;
     }
 
+    // log last retired instruction
+    if(commitlog_)
+        log_commit(false);
+    commitlog_.reset();
+
+    delete iss_;
+    delete idle_iss_;
+    delete ref_iss_;
     delete tb;
     mem_.clear();
 }
 
 
+void Backend_atomsim::build_regmap()
+{
+    regs_.clear();
+    if(iss_)
+    {
+        ISS_state_t &st = iss_->state();
+        regs_.push_back({.name="pc", .alt_name="", .width=R32, .ptr=(void *)&st.pc, .is_arch_reg=false});
+        regs_.push_back({.name="ir", .alt_name="", .width=R32, .ptr=(void *)&st.ir, .is_arch_reg=false});
+        for (int i=0; i<32; i++) {
+            std::string regname = "x"+std::to_string(i);
+            regs_.push_back({.name=regname, .alt_name=rv_abi_regnames[i], .width=R32, .ptr=(void *)&st.x[i], .is_arch_reg=true});
+        }
+    }
+    else
+    {
+        regs_.push_back({.name="pc", .alt_name="", .width=R32, .ptr=(void *)&tb->m_core->AtomBones->atom_core->ProgramCounter_Old, .is_arch_reg=false});
+        regs_.push_back({.name="ir", .alt_name="", .width=R32, .ptr=(void *)&tb->m_core->AtomBones->atom_core->InstructionRegister, .is_arch_reg=false});
+        for (int i=0; i<32; i++) {
+            std::string regname = "x"+std::to_string(i);
+            regs_.push_back({.name=regname, .alt_name=rv_abi_regnames[i], .width=R32, .ptr=(void *)&tb->m_core->AtomBones->atom_core->rf->regs[i], .is_arch_reg=true});
+        }
+    }
+}
+
+
 void Backend_atomsim::service_mem_req()
 {    
     // Clear all ack signals
@@ -107,42 +230,46 @@ void Backend_atomsim::service_mem_req()
 
     // ===== Imem Port Reads =====
     uint32_t iaddr = tb->m_core->iport_addr_o & 0xfffffffc;
-    if(tb->m_core->iport_valid_o == 1)
+    if(!tb->m_core->iport_valid_o)
+        iwait_.busy = false;
+    else if(hold_ack(iwait_, icache_.get(), iaddr, false))
+        ;   // waiting for memory
+    else
     {   
-        Word_alias i_w;
-        this->fetch(iaddr, i_w.byte, 4);
-        tb->m_core->iport_data_i = i_w.word;
+        uint32_t idata;
+        if(!memmap_.read<uint32_t>(iaddr, idata))
+            this->fetch(iaddr, (uint8_t *)&idata, 4);   // throws
+        tb->m_core->iport_data_i = idata;
         tb->m_core->iport_ack_i = 1;
     }
 
     // ===== Dmem Port Reads/Writes =====
     uint32_t daddr = tb->m_core->dport_addr_o & 0xfffffffc;
-    if(tb->m_core->dport_valid_o)
+    if(!tb->m_core->dport_valid_o)
+        dwait_.busy = false;
+    else if(daddr != UART_ADDR && hold_ack(dwait_, dcache_.get(), daddr, tb->m_core->dport_we_o))
+        ;   // waiting for memory (uart has no wait states)
+    else
     {
         if(tb->m_core->dport_we_o)	// *** Writes ***
         {
             Word_alias data_w = {.word = (uint32_t)tb->m_core->dport_data_o};
+            if(ref_iss_)
+                ls_.store = {true, daddr, data_w.word, (uint8_t)tb->m_core->dport_sel_o};
+
             if(daddr == UART_ADDR)  // Handle Writes to UART
             {
                 if(tb->m_core->dport_sel_o & 0b0001)
-                {
-                    if(using_vuart_)
-                        vuart_->send(data_w.byte[0]);   // Redirect to Virtual UART
-                    
-                    if(config_.enable_uart_dump)
-                        std::cout << data_w.byte[0] << std::flush; // Echo on stdout
-                }
+                    uart_write(data_w.byte[0]);
             }
             else                    // Handle Writes
             {
-                if(tb->m_core->dport_sel_o & 0b0001) 
-                    this->store(daddr, &data_w.byte[0], 1);
-                if(tb->m_core->dport_sel_o & 0b0010) 
-                    this->store(daddr+1, &data_w.byte[1], 1);
-                if(tb->m_core->dport_sel_o & 0b0100) 
-                    this->store(daddr+2, &data_w.byte[2], 1);
-                if(tb->m_core->dport_sel_o & 0b1000) 
-                    this->store(daddr+3, &data_w.byte[3], 1);
+                if(!memmap_.write_word(daddr, data_w.word, tb->m_core->dport_sel_o))
+                    this->store(daddr, data_w.byte, 4);     // throws
+
+                // memory modified behind the back of ISS
+                if(iss_)
+                    iss_->flush_icache();
             }
         }
         else
@@ -150,15 +277,13 @@ void Backend_atomsim::service_mem_req()
             Word_alias data_w;
             if(daddr == UART_ADDR)  // Handle Reads from Uart
             {
-                if(using_vuart_)
-                    data_w.word = 0xff & (uint32_t) vuart_->recieve();
-                else
-                    data_w.word = (uint32_t) -1;
+                data_w.word = uart_read();
+                ls_.uart_rdata = data_w.word;
             }
             else                    // Handle reads
             {
-                
-                this->fetch(daddr, data_w.byte, 4);
+                if(!memmap_.read<uint32_t>(daddr, data_w.word))
+                    this->fetch(daddr, data_w.byte, 4);     // throws
             }
             tb->m_core->dport_data_i = data_w.word;
         }
@@ -167,41 +292,287 @@ void Backend_atomsim::service_mem_req()
 }
 
 
-int Backend_atomsim::tick()
+bool Backend_atomsim::hold_ack(PortWait_t &w, Cache *cache, uint32_t addr, bool write)
 {
-    // return if backend finished
-    if(this->done()) {
-        return 1;
+    if(!cache && !memtiming_)
+        return false;
+
+    if(!w.busy)
+    {
+        w.busy = true;
+        if(cache)
+        {
+            // memory is accessed only for transfers made by the cache
+            Cache::Access_t a = cache->access(addr, write);
+            uint32_t line = cache->get_config().line_size;
+            uint64_t t = mem_cycle_;
+            if(a.writeback)
+                t = cache_transfer(t, a.wb_addr, line);
+            if(a.fill)
+                t = cache_transfer(t, addr & ~(line-1), line);
+            if(a.write_through)
+                t = cache_transfer(t, addr, 4);
+            w.done = t;
+        }
+        else
+            w.done = memtiming_->request(mem_cycle_, addr, 4);
     }
+    if(mem_cycle_ < w.done)
+        return true;
+    w.busy = false;     // acked in this cycle
+    return false;
+}
+
+
+uint64_t Backend_atomsim::cache_transfer(uint64_t t, uint32_t addr, uint32_t bytes)
+{
+    if(memtiming_ && memtiming_->covers(addr))
+        return memtiming_->request(t, addr, bytes);
+    return t + config_.cache_miss_penalty;
+}
+
+
+void Backend_atomsim::print_memsys_info()
+{
+    auto print = [](const char *name, Cache *c) {
+        if(!c)
+            return;
+        const Cache::Stats_t &st = c->get_stats();
+        auto pct = [](uint64_t hits, uint64_t n) { return n ? 100.0 * hits / n : 0.0; };
+        printf("%s (%s):\n", name, c->describe().c_str());
+        printf("  reads  : %12ld, %12ld misses (%6.2f%% hits)\n", st.reads, st.read_misses, pct(st.reads - st.read_misses, st.reads));
+        if(st.writes)
+            printf("  writes : %12ld, %12ld misses (%6.2f%% hits), %ld writebacks\n", st.writes, st.write_misses, pct(st.writes - st.write_misses, st.writes), st.writebacks);
+    };
+    print("I-cache", icache_.get());
+    print("D-cache", dcache_.get());
+    if(memtiming_)
+        memtiming_->print_info();
+}
+
+
+void Backend_atomsim::uart_write(uint8_t c)
+{
+    if(using_vuart_)
+        vuart_->send(c);    // Redirect to Virtual UART
+    
+    if(config_.enable_uart_dump)
+        std::cout << c << std::flush; // Echo on stdout
+}
+
+
+uint32_t Backend_atomsim::uart_read()
+{
+    if(using_vuart_)
+        return 0xff & (uint32_t) vuart_->recieve();
+    else
+        return (uint32_t) -1;
+}
+
+
+void Backend_atomsim::pre_tick()
+{
+    if(ref_iss_)
+        ls_.store.valid = false;
 
     // Service Memory Request
     service_mem_req();
-    
-    // Tick clock once
-    tb->tick();
+    mem_cycle_++;
+
+    // Note the instruction in stage2; it retires at the upcoming clock edge 
+    // unless it's a bubble or stage2 is stalled
+    auto core = tb->m_core->AtomBones->atom_core;
+    bool dbus_wait = tb->m_core->dport_valid_o && !tb->m_core->dport_ack_i;
+    bool retiring = core->InstructionRegister_Valid && !dbus_wait;
+    rtl_instret_ += retiring;
+    count_perf(core, dbus_wait);
+
+    if(commitlog_)
+        log_commit(retiring);
 
-    return 0;
+    if(ref_iss_)
+    {
+        ls_.retiring = retiring;
+        ls_.pc = core->ProgramCounter_Old;
+        ls_.ir = core->InstructionRegister;
+    }
 }
 
 
-void Backend_atomsim::fetch(const uint32_t start_addr, uint8_t *buf, const uint32_t buf_sz)
+uint64_t Backend_atomsim::skip_busywait(uint64_t max_cycles)
 {
-    bool success = false;
-    for (auto mem_block: mem_)  // search for mem blk
+    auto core = tb->m_core->AtomBones->atom_core;
+    uint64_t iters = busywait_->detect(core->ProgramCounter_Old, core->InstructionRegister, core->InstructionRegister_Valid, max_cycles);
+    if(!iters)
+        return 0;
+
+    busywait_->skip(iters);
+    tb->m_core->eval();
+    return iters * busywait_->iter_cycles();
+}
+
+
+void Backend_atomsim::setup_flightrec(FlightRecorder &fr)
+{
+    auto top = tb->m_core;
+    auto core = top->AtomBones->atom_core;
+
+    fr.add_signal("pc",             32, &core->ProgramCounter_Old);
+    fr.add_signal("ir",             32, &core->InstructionRegister);
+    fr.add_signal("ir_valid",       1,  &core->InstructionRegister_Valid);
+
+    fr.add_signal("iport_addr",     32, &top->iport_addr_o);
+    fr.add_signal("iport_data",     32, &top->iport_data_i);
+    fr.add_signal("iport_valid",    1,  &top->iport_valid_o);
+    fr.add_signal("iport_ack",      1,  &top->iport_ack_i);
+
+    fr.add_signal("dport_addr",     32, &top->dport_addr_o);
+    fr.add_signal("dport_wdata",    32, &top->dport_data_o);
+    fr.add_signal("dport_rdata",    32, &top->dport_data_i);
+    fr.add_signal("dport_sel",      4,  &top->dport_sel_o);
+    fr.add_signal("dport_we",       1,  &top->dport_we_o);
+    fr.add_signal("dport_valid",    1,  &top->dport_valid_o);
+    fr.add_signal("dport_ack",      1,  &top->dport_ack_i);
+
+    fr.add_signal("rf_we",          1,  &core->d_rf_we);
+    fr.add_signal("rf_rd",          5,  &core->d_rd_sel);
+    fr.add_signal("rf_wdata",       32, &core->rf_rd_data);
+
+#ifdef EN_EXCEPT
+    fr.add_signal("exception",      1,  &core->csr_unit->exception);
+    exception_flag_ = &core->csr_unit->exception;
+#endif
+}
+
+
+void Backend_atomsim::setup_commitlog()
+{
+    clog_pending_ = false;
+}
+
+
+void Backend_atomsim::log_commit(bool retiring)
+{
+    auto top = tb->m_core;
+    auto core = top->AtomBones->atom_core;
+
+    // register written by last instruction is visible after the clock edge
+    if(clog_pending_)
     {
-        std::shared_ptr<Memory> m = mem_block.second;
-        if(m->addr_in_range(start_addr))
+        if(clog_.rd)
+            clog_.rd_val = core->rf->regs[clog_.rd];
+        commitlog_->push(clog_);
+        clog_pending_ = false;
+    }
+
+    if(!retiring)
+        return;
+
+    clog_.cycle = tb->get_total_tickcount()+1;
+    clog_.pc = core->ProgramCounter_Old;
+    clog_.ir = core->InstructionRegister_Raw;     // as fetched (InstructionRegister holds compressed instructions expanded)
+    clog_.rd = core->d_rf_we ? core->d_rd_sel : 0;
+    clog_.mem = 0;
+    if(top->dport_valid_o && top->dport_ack_i)
+    {
+        clog_.mem = top->dport_sel_o | (top->dport_we_o << 4);
+        clog_.mem_addr = top->dport_addr_o;
+        clog_.mem_data = top->dport_we_o ? top->dport_data_o : top->dport_data_i;
+    }
+    clog_pending_ = true;
+}
+
+
+/**
+ * @brief Check if instruction reads an implementation specific CSR (counters, 
+ * misa, machine information registers); ISS can't predict these values
+ */
+static bool reads_impl_csr(uint32_t ir)
+{
+    if((ir & 0x7f) != 0x73 || ((ir >> 12) & 0b111) == 0)   // not a csr instruction
+        return false;
+
+    uint32_t csr = ir >> 20;
+    return (csr >= 0xC00 && csr <= 0xC02) || (csr >= 0xC80 && csr <= 0xC82)    // cycle, time, instret (+h)
+        || csr == 0xB00 || csr == 0xB02 || csr == 0xB80 || csr == 0xB82         // mcycle, minstret (+h)
+        || csr == 0x301 || (csr >= 0xF11 && csr <= 0xF14);                      // misa, mvendorid..mhartid
+}
+
+
+/**
+ * @brief Format a store for divergence report
+ */
+static std::string fmt_store(const ISS_store_t &s)
+{
+    if(!s.valid)
+        return "-";
+    char buf[48];
+    sprintf(buf, "[0x%08x]=0x%08x/%x", s.addr, s.data, s.sel);
+    return buf;
+}
+
+
+bool Backend_atomsim::lockstep_check()
+{
+    if(!ls_.retiring)
+        return true;
+
+    ISS_state_t &st = ref_iss_->state();
+    auto core = tb->m_core->AtomBones->atom_core;
+    uint64_t ninstr = st.instret;
+    uint32_t iss_pc = st.pc;
+    char buf[128];
+    std::string diff;
+
+    // RTL must retire the instruction which ISS executes next
+    if(ls_.pc != iss_pc)
+    {
+        sprintf(buf, "  %-5s 0x%08x  0x%08x\n", "pc", ls_.pc, iss_pc);
+        diff += buf;
+    }
+    else
+    {
+        ref_iss_->last_store.valid = false;
+        ref_iss_->step();
+
+        // take implementation specific CSR values from RTL
+        uint32_t rd = (ls_.ir >> 7) & 0x1f;
+        if(rd != 0 && reads_impl_csr(ls_.ir))
+            st.x[rd] = core->rf->regs[rd];
+
+        // compare register file
+        for(int i=1; i<32; i++)
         {
-            if(!m->block_in_range(start_addr, buf_sz))
-                throw Atomsim_exception("can't fetch; bufsize too large for mem");
-            
-            m->fetch(start_addr, buf, buf_sz);
-            success = true;
-            break;  // exit search loop
+            if(core->rf->regs[i] != st.x[i])
+            {
+                sprintf(buf, "  %-5s 0x%08x  0x%08x\n", ("x"+std::to_string(i)).c_str(), (uint32_t)core->rf->regs[i], st.x[i]);
+                diff += buf;
+            }
         }
+
+        // compare stores (only enabled bytes)
+        const ISS_store_t &rs = ls_.store, &is = ref_iss_->last_store;
+        uint32_t mask = 0;
+        for(int b=0; b<4; b++)
+            if(rs.sel & (1 << b))
+                mask |= 0xffu << (b*8);
+
+        if(rs.valid != is.valid || (rs.valid && (rs.addr != is.addr || rs.sel != is.sel || (rs.data & mask) != (is.data & mask))))
+            diff += "  store " + fmt_store(rs) + "  " + fmt_store(is) + "\n";
     }
 
-    if (!success)
+    if(diff.empty())
+        return true;
+
+    sprintf(buf, "Lockstep divergence at instruction %ld (pc=0x%08x, ir=0x%08x):\n", ninstr, ls_.pc, ls_.ir);
+    divergence_ = std::string(buf) + "        rtl         iss\n" + diff;
+    return false;
+}
+
+
+void Backend_atomsim::fetch(const uint32_t start_addr, uint8_t *buf, const uint32_t buf_sz)
+{
+    if (!memmap_.fetch(start_addr, buf, buf_sz))
     {
         char hx[10];
         sprintf(hx, "%08x", start_addr);
@@ -212,25 +583,220 @@ void Backend_atomsim::fetch(const uint32_t start_addr, uint8_t *buf, const uint3
 
 void Backend_atomsim::store(const uint32_t start_addr, uint8_t *buf, const uint32_t buf_sz)
 {
-    bool success = false;
-    for (auto mem_block: mem_)  // search for mem blk
+    if (!memmap_.store(start_addr, buf, buf_sz))
+    {
+        char hx[10];
+        sprintf(hx, "%08x", start_addr);
+        throw Atomsim_exception("memory store failed: no mem block at given address (0x"+std::string(hx)+")");
+    }
+
+    // memory modified behind the back of ISS
+    if(iss_)
+        iss_->flush_icache();
+}
+
+
+void Backend_atomsim::print_mem_info()
+{
+    const uint64_t pgsz = sysconf(_SC_PAGESIZE);
+    uint64_t total_mapped = 0, total_resident = 0;
+
+    printf("Name        Base        Size (KB)   Backing  Mapped pg   Resident pg   Resident (KB)\n");
+    for (auto &mem_block: mem_)
     {
         std::shared_ptr<Memory> m = mem_block.second;
-        if(m->addr_in_range(start_addr))
+        uint64_t mapped = (m->get_size() + pgsz-1) / pgsz;
+        uint64_t resident = m->get_resident_size();
+        total_mapped += mapped;
+        total_resident += resident;
+
+        printf("%-10s  %s0x%08x%s  %9u   %-7s  %9lu   %11lu   %13lu\n", mem_block.first.c_str(), 
+            ansicode(FG_BLUE), m->get_base_addr(), ansicode(FG_RESET), m->get_size() / 1024, 
+            m->is_sparse() ? "sparse" : "heap", mapped, (resident + pgsz-1) / pgsz, resident / 1024);
+    }
+    printf("Total: %lu pages mapped, %lu pages resident (%lu KB, %lu KB host pages)\n", 
+        total_mapped, (total_resident + pgsz-1) / pgsz, total_resident / 1024, pgsz / 1024);
+}
+
+
+void Backend_atomsim::switch_engine(const std::string &engine)
+{
+    if(engine != "rtl" && engine != "iss")
+        throw Atomsim_exception("invalid engine: "+engine+" (expected rtl/iss)");
+    if(!iss_ && !idle_iss_)
+        throw Atomsim_exception("switching engines requires backend to be started with iss engine");
+
+    auto core = tb->m_core->AtomBones->atom_core;
+
+    if(engine == "rtl" && iss_)
+    {
+        ISS_state_t &st = iss_->state();
+
+        // reset to flush the pipeline, then fetch from pc of ISS
+        tb->reset();
+        core->ProgramCounter = st.pc;
+        for(int i=1; i<32; i++)
+            core->rf->regs[i] = st.x[i];
+
+        #ifdef EN_RVZICSR
+        auto csr = core->csr_unit;
+        csr->csr_cycle = st.instret;    // ISS executes one instruction per cycle
+        csr->csr_instret = st.instret;
+        #ifdef EN_EXCEPT
+        csr->csr_mstatus_mie = (st.mstatus >> 3) & 1;
+        csr->csr_mtvec_base = st.mtvec >> 2;
+        csr->csr_mtvec_mode = st.mtvec & 0b11;
+        csr->csr_mie_meie = (st.mie >> 11) & 1;
+        csr->csr_mie_mtie = (st.mie >> 7) & 1;
+        csr->csr_mie_msie = (st.mie >> 3) & 1;
+        csr->csr_mip_meip = (st.mip >> 11) & 1;
+        csr->csr_mip_mtip = (st.mip >> 7) & 1;
+        csr->csr_mip_msip = (st.mip >> 3) & 1;
+        csr->csr_mepc = st.mepc >> 1;
+        csr->csr_mcause_intr = st.mcause >> 31;
+        csr->csr_mcause_cause = st.mcause & 0xf;
+        #endif
+        #endif
+
+        // propagate new pc to iport
+        tb->m_core->eval();
+        iwait_ = dwait_ = PortWait_t();
+        if(memtiming_)
+            memtiming_->reset();
+
+        switch_instret_ = rtl_instret_;
+        idle_iss_ = iss_;
+        iss_ = nullptr;
+    }
+    else if(engine == "iss" && !iss_)
+    {
+        iss_ = idle_iss_;
+        idle_iss_ = nullptr;
+        ISS_state_t &st = iss_->state();
+
+        for(int i=1; i<32; i++)
+            st.x[i] = core->rf->regs[i];
+
+        st.instret += rtl_instret_ - switch_instret_;
+        st.instret_total += rtl_instret_ - switch_instret_;
+
+        #if defined(EN_RVZICSR) && defined(EN_EXCEPT)
+        auto csr = core->csr_unit;
+        st.mstatus = (uint32_t)csr->csr_mstatus_mie << 3;
+        st.mtvec = ((uint32_t)csr->csr_mtvec_base << 2) | csr->csr_mtvec_mode;
+        st.mie = ((uint32_t)csr->csr_mie_meie << 11) | ((uint32_t)csr->csr_mie_mtie << 7) | ((uint32_t)csr->csr_mie_msie << 3);
+        st.mip = ((uint32_t)csr->csr_mip_meip << 11) | ((uint32_t)csr->csr_mip_mtip << 7) | ((uint32_t)csr->csr_mip_msip << 3);
+        st.mepc = (uint32_t)csr->csr_mepc << 1;
+        st.mcause = ((uint32_t)csr->csr_mcause_intr << 31) | csr->csr_mcause_cause;
+        #endif
+
+        // memory was modified by RTL; next instruction is the one in stage2 
+        // (if valid), otherwise the one being fetched
+        iss_->flush_icache();
+        iss_->set_pc(core->InstructionRegister_Valid ? core->ProgramCounter_Old : core->ProgramCounter);
+    }
+    build_regmap();
+    if(profiler_ || trace_window_)
+        resolve_tick_handles();
+}
+
+
+uint64_t Backend_atomsim::get_total_instret()
+{
+    if(iss_)
+        return iss_->state().instret_total;
+    if(idle_iss_)
+        return idle_iss_->state().instret_total + rtl_instret_ - switch_instret_;
+    return rtl_instret_;
+}
+
+
+#ifdef ATOMSIM_SAVABLE
+#define CKPT_CHUNK_SZ (64*1024)
+
+void Backend_atomsim::save_state(VerilatedSerialize &os)
+{
+    Backend::save_state(os);
+    os << rtl_instret_ << switch_instret_ << mem_cycle_;
+
+    // save memory contents (chunk by chunk); each chunk is preceded by a 
+    // flag byte, and all-zero chunks (e.g. untouched pages of sparse 
+    // memories) are not written
+    uint32_t nblocks = mem_.size();
+    os << nblocks;
+    static const uint8_t zeros[CKPT_CHUNK_SZ] = {0};
+    for (auto mem_block: mem_)
+    {
+        std::string name = mem_block.first;
+        std::shared_ptr<Memory> m = mem_block.second;
+        uint32_t base = m->get_base_addr();
+        uint32_t size = m->get_size();
+        os << name << base << size;
+
+        for (uint32_t off = 0; off < size; off += CKPT_CHUNK_SZ)
         {
-            if(!m->block_in_range(start_addr, buf_sz))
-                throw Atomsim_exception("can't store; bufsize too large for mem");
-            
-            m->store(start_addr, buf, buf_sz);
-            success = true;
-            break;  // exit search loop
+            uint32_t n = std::min<uint32_t>(CKPT_CHUNK_SZ, size - off);
+            const uint8_t *data = m->get_data_ptr() + off;
+            uint8_t nonzero = memcmp(data, zeros, n) != 0;
+            os << nonzero;
+            if (nonzero)
+                os.write(data, n);
         }
     }
+}
+
 
-    if (!success)
+void Backend_atomsim::restore_state(VerilatedDeserialize &is)
+{
+    Backend::restore_state(is);
+    is >> rtl_instret_ >> switch_instret_ >> mem_cycle_;
+
+    // restore memory contents (chunk by chunk)
+    uint32_t nblocks;
+    is >> nblocks;
+    if (nblocks != mem_.size())
+        throw Atomsim_exception("checkpoint restore failed: memory configuration mismatch");
+    
+    std::vector<uint8_t> chunk(CKPT_CHUNK_SZ);
+    for (uint32_t i = 0; i < nblocks; i++)
     {
-        char hx[10];
-        sprintf(hx, "%08x", start_addr);
-        throw Atomsim_exception("memory store failed: no mem block at given address (0x"+std::string(hx)+")");
+        std::string name;
+        uint32_t base, size;
+        is >> name >> base >> size;
+
+        if (mem_.count(name) == 0 || mem_[name]->get_base_addr() != base || mem_[name]->get_size() != size)
+            throw Atomsim_exception("checkpoint restore failed: memory block \""+name+"\" does not match current configuration");
+        
+        std::shared_ptr<Memory> m = mem_[name];
+        bool write_protect = m->is_write_protected();
+        m->set_write_protect(false);
+        for (uint32_t off = 0; off < size; off += CKPT_CHUNK_SZ)
+        {
+            uint32_t n = std::min<uint32_t>(CKPT_CHUNK_SZ, size - off);
+            uint8_t nonzero;
+            is >> nonzero;
+            if (nonzero)
+                is.read(chunk.data(), n);
+            else
+                memset(chunk.data(), 0, n);
+
+            // leave unchanged chunks alone, so that untouched pages of 
+            // sparse memories don't materialize
+            if(memcmp(m->get_data_ptr() + off, chunk.data(), n) != 0)
+                m->store(base + off, chunk.data(), n);
+        }
+        m->set_write_protect(write_protect);
     }
+
+    if(iss_)
+        iss_->flush_icache();
+
+    // cache models are not saved; they restart cold
+    for (Cache *c: {icache_.get(), dcache_.get()})
+        if(c)
+            c->invalidate();
+    iwait_ = dwait_ = PortWait_t();
+    if(memtiming_)
+        memtiming_->reset();
 }
+#endif
@@ -1,7 +1,10 @@
 #pragma once
 
 #include "backend.hpp"
-#include "build/verilated/VAtomBones.h"
+#include "memory.hpp"
+#include "cache.hpp"
+#include "memtiming.hpp"
+#include "VAtomBones.h"
 
 #include <memory>
 
@@ -10,7 +13,11 @@
 
 #define DEFAULT_BOOTROM_IMAGE "${RVATOM}/sw/bootloader/bootloader.hex"
 
-class Memory;
+// Memory timing from target config (set by Makefile)
+#ifndef DEFAULT_MEM_TIMING
+#define DEFAULT_MEM_TIMING ""
+#endif
+
 class Vuart;
 
 struct Backend_config
@@ -21,10 +28,22 @@ struct Backend_config
     
     uint32_t ram_offset         = 0x20000000;
     uint32_t ram_size_kb        = (80*1024);    // default: 80 MB
+    bool sparse_ram             = true;         // demand paged ram backing
 
     std::string vuart_portname  = "";
     uint32_t vuart_baudrate     = 115200;
     bool enable_uart_dump       = false;
+
+    std::string engine          = "rtl";        // simulation engine (rtl/iss)
+    bool lockstep               = false;        // run rtl in lockstep with reference iss
+    bool busywait_skip          = true;         // fast-forward over busy-wait loops
+    bool busywait_approx        = false;        // ...also those whose exit can't be predicted (inexact)
+
+    std::string icache          = "";           // i-cache model: <size>:<ways>:<line size>[:repl] ("": none)
+    std::string dcache          = "";           // d-cache model: <size>:<ways>:<line size>[:repl][:wb|wt] ("": none)
+    uint32_t cache_miss_penalty = 10;           // cycles to fill/write back a cache line (outside timed regions)
+    std::string mem_timing      = DEFAULT_MEM_TIMING;   // latency/bandwidth/outstanding limits of memory regions
+    bool mem_bench              = false;        // measure host time per memory access at startup
 };
 
 
@@ -54,12 +73,78 @@ public:
 
     void UART();
 
-    int tick();
+    /**
+     * @brief Handle a byte written to UART (by software)
+     * @param c byte
+     */
+    void uart_write(uint8_t c);
+
+    /**
+     * @brief Handle a read from UART (by software)
+     * @return uint32_t received byte, -1 if none available
+     */
+    uint32_t uart_read();
+
+    void pre_tick();
+
+    uint64_t skip_busywait(uint64_t max_cycles);
+
+    /**
+     * @brief Step reference ISS if an instruction retired in last cycle, and 
+     * compare its pc, register file & store with the RTL
+     * @return false if RTL diverged from reference ISS
+     */
+    bool lockstep_check();
+
+    /**
+     * @brief Register pc, ir, iport, dport & register file write port with 
+     * flight recorder
+     * @param fr flight recorder
+     */
+    void setup_flightrec(FlightRecorder &fr);
+
+    /**
+     * @brief Prepare for logging committed instructions
+     */
+    void setup_commitlog();
+
+    /**
+     * @brief Switch simulation engine, transferring architectural state 
+     * (pc, register file & CSRs) between ISS and RTL
+     * @details Memories are shared by both engines, so they need not be 
+     * transferred. Requires the backend to be constructed with iss engine.
+     * @param engine engine to switch to (rtl/iss)
+     */
+    void switch_engine(const std::string &engine);
+
+    /**
+     * @brief Get number of instructions retired by RTL
+     * @return uint64_t instructions retired (in total)
+     */
+    uint64_t get_rtl_instret()  { return rtl_instret_; }
+
+    /**
+     * @brief Get number of instructions retired by ISS and RTL together
+     * @details The ISS count already includes RTL windows it has been 
+     * switched back from; only the current window is added while RTL is active.
+     * @return uint64_t instructions retired (in total)
+     */
+    uint64_t get_total_instret();
    
     void fetch(const uint32_t start_addr, uint8_t *buf, const uint32_t buf_sz);
 
     void store(const uint32_t start_addr, uint8_t *buf, const uint32_t buf_sz);
 
+    void print_mem_info();
+
+    void print_memsys_info();
+
+#ifdef ATOMSIM_SAVABLE
+    void save_state(VerilatedSerialize &os);
+
+    void restore_state(VerilatedDeserialize &is);
+#endif
+
 private:
     /**
      * @brief Backend configuration parameters
@@ -71,6 +156,11 @@ private:
      */
     std::map<std::string, std::shared_ptr<Memory>> mem_;
 
+    /**
+     * @brief Address decoded map of memory devices (used for all accesses)
+     */
+    MemoryMap memmap_;
+
     /**
 	 * @brief Pointer to Vuart object
 	 */
@@ -80,4 +170,103 @@ private:
      * @brief Are we using vuart?
      */
     bool using_vuart_ = false;
+
+    /**
+     * @brief ISS object while RTL is the active engine (see switch_engine())
+     */
+    ISS *idle_iss_ = nullptr;
+
+    /**
+     * @brief Cache models (if enabled); acks of iport/dport are held back 
+     * for the extra cycles taken by each access
+     */
+    std::unique_ptr<Cache> icache_;
+    std::unique_ptr<Cache> dcache_;
+
+    /**
+     * @brief Memory timing model (if any regions are timed)
+     */
+    std::unique_ptr<MemTiming> memtiming_;
+
+    /**
+     * @brief Cycles simulated in RTL; time base of memory timing (cycles 
+     * fast-forwarded over busy-wait loops are not counted, so that the 
+     * state of requests in flight is unaffected by skips)
+     */
+    uint64_t mem_cycle_ = 0;
+
+    /**
+     * @brief Request in progress on a port
+     */
+    struct PortWait_t {
+        bool busy = false;      // request seen, not yet acked
+        uint64_t done = 0;      // cycle (mem_cycle_) in which it is acked
+    };
+    PortWait_t iwait_;
+    PortWait_t dwait_;
+
+    /**
+     * @brief Check if ack of request on a port must be held back in this cycle
+     * @details Latency of a request is decided by the cache & memory timing 
+     * in its first cycle. If its address changes before it is acked (pc 
+     * changes after a jump), the wait is still completed and the ack is 
+     * ignored by the core.
+     * 
+     * @param w port state
+     * @param cache cache model of port (nullptr: no cache)
+     * @param addr address of request
+     * @param write true for store
+     * @return true if ack must be held back
+     */
+    bool hold_ack(PortWait_t &w, Cache *cache, uint32_t addr, bool write);
+
+    /**
+     * @brief Time a transfer made by a cache (line fill/write back or write 
+     * through) 
+     * @param t cycle in which it is issued
+     * @param addr address
+     * @param bytes size of transfer
+     * @return uint64_t cycle in which it completes
+     */
+    uint64_t cache_transfer(uint64_t t, uint32_t addr, uint32_t bytes);
+
+    /**
+     * @brief Number of instructions retired by RTL
+     */
+    uint64_t rtl_instret_ = 0;
+
+    /**
+     * @brief Value of rtl_instret_ when RTL became the active engine
+     */
+    uint64_t switch_instret_ = 0;
+
+    /**
+     * @brief (Re)build register map for active engine
+     */
+    void build_regmap();
+
+    /**
+     * @brief Instruction which retired at last clock edge; pushed to commit
+     * log once its register write is visible
+     */
+    CommitRec_t clog_;
+    bool clog_pending_ = false;
+
+    /**
+     * @brief Push pending record to commit log, and note the instruction 
+     * retiring at upcoming clock edge
+     * @param retiring true if instruction in stage2 retires
+     */
+    void log_commit(bool retiring);
+
+    /**
+     * @brief RTL activity in current cycle, as observed by lockstep mode
+     */
+    struct {
+        bool retiring = false;  // instruction in stage2 retires at next clock edge
+        uint32_t pc = 0;        // pc of instruction in stage2
+        uint32_t ir = 0;        // instruction in stage2
+        ISS_store_t store;      // store made on dport
+        uint32_t uart_rdata = 0;// data read from uart
+    } ls_;
 };
\ No newline at end of file
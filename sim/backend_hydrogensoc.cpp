@@ -2,12 +2,13 @@
 
 #include "atomsim.hpp"
 #include "memory.hpp"
+#include "loader.hpp"
 #include "vuart.hpp"
 #include "bitbang_uart.hpp"
 #include "except.hpp"
 #include "rvdefs.hpp"
 
-#include "build/verilated/VHydrogenSoC_headers.h"
+#include "VHydrogenSoC_headers.h"
 
 #ifdef DBG
 #define D(x) x
@@ -15,7 +16,7 @@
 #define D(x)
 #endif
 
-#include "elfio/elfio.hpp"
+#include <string.h>
 
 // ROM
 #define ROM_ADDR 0x00010000
@@ -28,33 +29,30 @@
 #define BBUART_FRATIO 3
 #define BOOTMODE_PIN_OFFSET 8
 
+#define IDLE_SETTLE_CYCLES  4   // cycles soc must stay idle before skipping (lets bus cycles in flight finish)
+#define IDLE_SKIP_MIN       16  // don't bother skipping fewer cycles
+
 
 Backend_atomsim::Backend_atomsim(Atomsim *sim, Backend_config config) : Backend(sim),
                                                                         config_(config),
-                                                                        using_vuart_(config.vuart_portname != "")
+                                                                        using_vuart_(config.vuart_portname != ""),
+                                                                        uart_tlm_(config.uart_model == "tlm")
 {
-    // generate image file by converting ELF file
-    char *varval = getenv("RVATOM");
-    if (!varval)
-        throw Atomsim_exception("cant find $RVATOM env variable");
-    std::string rvatom(varval);
-
-    std::string tmp_bin_file = ".atomsim_ram_img.bin";
-    std::string cmd_output = GetStdoutFromCommand("python3 " + rvatom + "/scripts/convelf.py -t elf -m=ram:"+std::to_string(RAM_ADDR)+":"+std::to_string(RAM_SIZE)+":b:"+tmp_bin_file+" "+sim_->sim_config_.ifile, true);
-    if (cmd_output.length() > 0) {
-        throw Atomsim_exception(cmd_output);
-    }
-    
-    std::vector<char> imgcontents = fReadBin(tmp_bin_file);
-
-    std::string cmd_output1 = GetStdoutFromCommand("rm -f "+tmp_bin_file, true);
-    if (cmd_output1.length() > 0) {
-        throw Atomsim_exception(cmd_output1);
-    }
+    // ISS does not model the peripherals of hydrogensoc
+    if (config_.engine != "rtl")
+        throw Atomsim_exception("engine \""+config_.engine+"\" is not supported for "+std::string(ATOMSIM_TARGETNAME)+" (only rtl)");
+    if (config_.lockstep)
+        throw Atomsim_exception("lockstep mode is not supported for "+std::string(ATOMSIM_TARGETNAME));
+    if (config_.uart_model != "bitbang" && config_.uart_model != "tlm")
+        throw Atomsim_exception("invalid uart model \""+config_.uart_model+"\" (expected bitbang or tlm)");
 
     // Construct Testbench object
     tb = new Testbench<VHydrogenSoC>();
 
+    #if defined(EN_EXCEPT) && defined(SOC_EN_TIMER)
+    idle_skip_ = config_.idle_skip;     // core can only be woken up by timer
+    #endif
+
     // Construct reg map
     regs_.push_back({.name="pc", .alt_name="", .width=R32, .ptr=(void *)&tb->m_core->HydrogenSoC->atom_wb_core->atom_core->ProgramCounter_Old, .is_arch_reg=false});
     regs_.push_back({.name="ir", .alt_name="", .width=R32, .ptr=(void *)&tb->m_core->HydrogenSoC->atom_wb_core->atom_core->InstructionRegister, .is_arch_reg=false});
@@ -63,11 +61,31 @@ Backend_atomsim::Backend_atomsim(Atomsim *sim, Backend_config config) : Backend(
         regs_.push_back({.name=regname, .alt_name=rv_abi_regnames[i], .width=R32, .ptr=(void *)&tb->m_core->HydrogenSoC->atom_wb_core->atom_core->rf->regs[i], .is_arch_reg=true});
     }
 
+    // Construct busy-wait loop detector (watches register file & counters)
+    if(config_.busywait_skip)
+    {
+        auto core = tb->m_core->HydrogenSoC->atom_wb_core->atom_core;
+        std::vector<uint32_t *> rf;
+        for (int i=0; i<32; i++)
+            rf.push_back(&core->rf->regs[i]);
+        std::vector<uint64_t *> counters;
+        for (int i=0; i<PERF_NCLASSES; i++)
+            counters.push_back(&perf_.cycles[i]);
+        #ifdef EN_RVZICSR
+        counters.push_back(&core->csr_unit->csr_cycle);
+        counters.push_back(&core->csr_unit->csr_instret);
+        #endif
+        #ifdef SOC_EN_TIMER
+        counters.push_back(&tb->m_core->HydrogenSoC->timer->mtime);
+        #endif
+        busywait_.reset(new BusyWait(rf, counters, config_.busywait_approx));
+    }
+
     // ====== Initialize ========
     // init ram
     if(sim_->sim_config_.verbose_flag) 
         std::cout << "Initializing ram" << std::endl;
-    store(RAM_ADDR, (uint8_t*)imgcontents.data(), imgcontents.size());
+    load_elf(sim_->sim_config_.ifile);
 
     // Initialize CPU state by resetting
     reset();
@@ -92,6 +110,9 @@ Backend_atomsim::Backend_atomsim(Atomsim *sim, Backend_config config) : Backend(
             std::cout << "Relaying uart-tx to stdout (Note: This mode does not support uart-rx)" << std::endl;
     }
 
+    if (uart_tlm_ && sim_->sim_config_.verbose_flag)
+        std::cout << "Using transaction level UART model" << std::endl;
+
     if (sim_->sim_config_.verbose_flag)
         std::cout << "Initialization complete!\n";
     
@@ -113,18 +134,53 @@ Backend_atomsim::~Backend_atomsim()
 }
 
 
+void Backend_atomsim::uart_putc(char c)
+{
+    if (using_vuart_)
+        vuart_->send(c); // Redirect to Virtual UART
+    
+    if (config_.enable_uart_dump)
+        std::cout << c << std::flush; // Echo on stdout
+}
+
+
+void Backend_atomsim::UART_tlm()
+{
+    auto uart = tb->m_core->HydrogenSoC->uart;  // verilated class name depends on uart parameters
+
+    // (re)assert every cycle, so that model initialization & checkpoints 
+    // taken in bitbang mode can't switch it off
+    uart->tlm_en = 1;
+
+    // RX: byte written by software in the last cycle
+    if (uart->tlm_tx_valid)
+        uart_putc((char)uart->tlm_tx_data);
+
+    // TX: hand over next byte once the previous one has been consumed
+    if (using_vuart_ && !uart->tlm_rx_valid)
+    {
+        int rchar = vuart_->recieve();
+        if (rchar != (int)-1)
+        {
+            uart->tlm_rx_data = (uint8_t)rchar;
+            uart->tlm_rx_valid = 1;
+        }
+    }
+}
+
+
 void Backend_atomsim::UART()
 {
+    if (uart_tlm_)
+    {
+        UART_tlm();
+        return;
+    }
+
     // RX
     if (!bb_uart_->rx_fifo.empty())
     {
-        char tchar = bb_uart_->rx_fifo.front();
-        if (using_vuart_)
-            vuart_->send(tchar); // Redirect to Virtual UART
-        
-        if (config_.enable_uart_dump)
-            std::cout << tchar << std::flush; // Echo on stdout
-
+        uart_putc(bb_uart_->rx_fifo.front());
         bb_uart_->rx_fifo.pop();
     }
 
@@ -140,92 +196,219 @@ void Backend_atomsim::UART()
     bb_uart_->eval();
 }
 
-int Backend_atomsim::tick()
+void Backend_atomsim::pre_tick()
 {
-    // return if backend finished
-    if (this->done()) {
-        return 1;
-    }
-
     // Force the bootmode switch value
     tb->m_core->gpio_io = (0b11 & config_.bootmode) << BOOTMODE_PIN_OFFSET;
 
     // perform uart transaction (if any)
     UART();
 
-    // Tick clock once
-    tb->tick();
+    auto core = tb->m_core->HydrogenSoC->atom_wb_core->atom_core;
+    count_perf(core, core->stall_stage2);
+}
+
 
+uint64_t Backend_atomsim::skip_idle(uint64_t max_cycles)
+{
+#if defined(EN_EXCEPT) && defined(SOC_EN_TIMER)
+    auto soc = tb->m_core->HydrogenSoC;
+    auto core = soc->atom_wb_core->atom_core;
+
+    // Core must be sleeping in WFI with stage2 drained (timer interrupt is its only
+    // wake up source) & uart/spi must not be transferring anything
+    bool idle = core->halted && !core->InstructionRegister_Valid && soc->uart->sim_idle
+                && (uart_tlm_ || bb_uart_->idle());
+    #ifdef SOC_EN_SPI
+    idle = idle && soc->spi->sim_idle;
+    #endif
+    if (!idle)
+    {
+        idle_cycles_ = 0;
+        return 0;
+    }
+    if (++idle_cycles_ < IDLE_SETTLE_CYCLES)
+        return 0;
+
+    // Jump to the cycle before mtime reaches mtimecmp, the remaining cycles 
+    // (interrupt & wake up) are simulated
+    auto timer = soc->timer;
+    if (timer->mtime >= timer->mtimecmp)
+        return 0;
+    uint64_t n = std::min<uint64_t>(timer->mtimecmp - timer->mtime - 1, max_cycles);
+    if (n < IDLE_SKIP_MIN)
+        return 0;
+
+    // advance free running counters as if n cycles were simulated
+    timer->mtime += n;
+    #ifdef EN_RVZICSR
+    core->csr_unit->csr_cycle += n;
+    #endif
+    tb->m_core->eval();
+    return n;
+#else
     return 0;
+#endif
+}
+
+
+uint64_t Backend_atomsim::skip_busywait(uint64_t max_cycles)
+{
+    auto soc = tb->m_core->HydrogenSoC;
+    auto core = soc->atom_wb_core->atom_core;
+
+    // peripherals other than the timer are not advanced, so they must not be 
+    // doing anything (the cycle is still observed)
+    bool idle = soc->uart->sim_idle && (uart_tlm_ || bb_uart_->idle());
+    #ifdef SOC_EN_SPI
+    idle = idle && soc->spi->sim_idle;
+    #endif
+    if (!idle)
+        max_cycles = 0;
+
+    // stop before the timer interrupt becomes pending
+    #ifdef SOC_EN_TIMER
+    auto timer = soc->timer;
+    if (timer->mtime < timer->mtimecmp)
+        max_cycles = std::min<uint64_t>(max_cycles, timer->mtimecmp - timer->mtime - 1);
+    #endif
+
+    uint64_t iters = busywait_->detect(core->ProgramCounter_Old, core->InstructionRegister, core->InstructionRegister_Valid, max_cycles);
+    if (!iters)
+        return 0;
+
+    busywait_->skip(iters);
+    tb->m_core->eval();
+    return iters * busywait_->iter_cycles();
 }
 
-void Backend_atomsim::fetch(const uint32_t start_addr, uint8_t *buf, const uint32_t buf_sz) {
+
+#ifdef ATOMSIM_SAVABLE
+// Helpers to (de)serialize a fifo queue
+static void save_fifo(VerilatedSerialize &os, std::queue<char> q)
+{
+    uint32_t n = q.size();
+    os << n;
+    for (; !q.empty(); q.pop())
+        os.write(&q.front(), 1);
+}
+
+static void restore_fifo(VerilatedDeserialize &is, std::queue<char> &q)
+{
+    uint32_t n;
+    is >> n;
+    q = std::queue<char>();
+    for (uint32_t i = 0; i < n; i++)
+    {
+        char c;
+        is.read(&c, 1);
+        q.push(c);
+    }
+}
+
+
+void Backend_atomsim::save_state(VerilatedSerialize &os)
+{
+    // RAM & ROM contents are part of the verilated model
+    Backend::save_state(os);
+
+    // save bitbang uart state
+    os.write(&bb_uart_->rx_sm, sizeof(bb_uart_->rx_sm));
+    os.write(&bb_uart_->tx_sm, sizeof(bb_uart_->tx_sm));
+    save_fifo(os, bb_uart_->rx_fifo);
+    save_fifo(os, bb_uart_->tx_fifo);
+}
+
+
+void Backend_atomsim::restore_state(VerilatedDeserialize &is)
+{
+    Backend::restore_state(is);
+
+    // restore bitbang uart state
+    is.read(&bb_uart_->rx_sm, sizeof(bb_uart_->rx_sm));
+    is.read(&bb_uart_->tx_sm, sizeof(bb_uart_->tx_sm));
+    restore_fifo(is, bb_uart_->rx_fifo);
+    restore_fifo(is, bb_uart_->tx_fifo);
+}
+#endif
+
+uint8_t * Backend_atomsim::mem_ptr(const uint32_t start_addr, const uint32_t buf_sz)
+{
+    // Verilated memories are arrays of 32-bit words; on a little endian host, 
+    // byte k of word i lies at byte offset 4*i+k of the array. So byte ranges 
+    // map directly onto it & are copied word-wide instead of byte by byte.
+    static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "host must be little endian");
+
+    uint32_t *mem;
+    uint32_t off;
     if (start_addr >= ROM_ADDR && start_addr < (ROM_ADDR + ROM_SIZE)) 
     {
-        if(!(start_addr + buf_sz - 1 < ROM_ADDR + ROM_SIZE))
-            throw Atomsim_exception("can't fetch; bufsize too large for mem");
-
-        // Copy mem to buf
-        for(unsigned buf_indx = 0; buf_indx < buf_sz; buf_indx++){
-            uint32_t mem_addr = start_addr + buf_indx;
-            uint32_t mem_indx = (mem_addr-ROM_ADDR) / 4;
-            uint32_t line_offset = 8 * ((mem_addr-ROM_ADDR) % 4);
-            buf[buf_indx] = 0xff & (tb->m_core->HydrogenSoC->bootrom->mem[mem_indx] >> line_offset);
-        }
+        mem = &tb->m_core->HydrogenSoC->bootrom->mem[0];
+        off = start_addr - ROM_ADDR;
+        if(buf_sz > ROM_SIZE - off)
+            return nullptr;
     }
     else if (start_addr >= RAM_ADDR && start_addr < (RAM_ADDR + RAM_SIZE)) 
     {
-        if(!(start_addr + buf_sz - 1 < RAM_ADDR + RAM_SIZE))
-            throw Atomsim_exception("can't fetch; bufsize too large for mem");
-
-        // Copy mem to buf
-        for(unsigned buf_indx = 0; buf_indx < buf_sz; buf_indx++){
-            uint32_t mem_addr = start_addr + buf_indx;
-            uint32_t mem_indx = (mem_addr-RAM_ADDR) / 4;
-            uint32_t line_offset = 8 * ((mem_addr-RAM_ADDR) % 4);
-            buf[buf_indx] = 0xff & (tb->m_core->HydrogenSoC->ram->mem[mem_indx] >> line_offset);
-        }
-    }
-    else {
-        char hx[10];
-        sprintf(hx, "%08x", start_addr);
-        throw Atomsim_exception("memory fetch failed: no mem block at given address (0x"+std::string(hx)+")");
+        mem = &tb->m_core->HydrogenSoC->ram->mem[0];
+        off = start_addr - RAM_ADDR;
+        if(buf_sz > RAM_SIZE - off)
+            return nullptr;
     }
+    else
+        return nullptr;
+    
+    return (uint8_t *)mem + off;
 }
 
-void Backend_atomsim::store(const uint32_t start_addr, uint8_t *buf, const uint32_t buf_sz)     // TODO: Use these
+
+void Backend_atomsim::load_elf(const std::string &file)
 {
-    if (start_addr >= ROM_ADDR && start_addr < (ROM_ADDR + ROM_SIZE)) 
+    // zero fill ram, so that gaps between segments & bss start out cleared
+    memset(&tb->m_core->HydrogenSoC->ram->mem[0], 0, RAM_SIZE);
+
+    ElfImage elf(file);
+    for (const ElfSegment_t &seg: elf.get_segments())
     {
-        if(!(start_addr + buf_sz - 1 < ROM_ADDR + ROM_SIZE))
-            throw Atomsim_exception("can't store; bufsize too large for mem");
+        if (seg.filesz == 0)
+            continue;
         
-        // Copy mem to buf
-        for(unsigned buf_indx = 0; buf_indx < buf_sz; buf_indx++){
-            uint32_t mem_addr = start_addr + buf_indx;
-            uint32_t mem_indx = (mem_addr-ROM_ADDR) / 4;
-            uint32_t line_offset = 8 * ((mem_addr-ROM_ADDR) % 4);
-            tb->m_core->HydrogenSoC->bootrom->mem[mem_indx] = (tb->m_core->HydrogenSoC->bootrom->mem[mem_indx] & ~(0xff << line_offset)) 
-                                                            | (((uint32_t) buf[buf_indx]) << line_offset);
+        uint8_t *p = mem_ptr(seg.addr, seg.filesz);
+        if (!p)
+        {
+            char except_buf[100];
+            sprintf(except_buf, "segment [base=0x%08x, sz=%u bytes] does not fit in rom/ram", seg.addr, seg.filesz);
+            throw Atomsim_exception(file+": "+except_buf);
         }
+
+        if(sim_->sim_config_.verbose_flag)
+            printf("Loading segment [base=0x%08x, sz=% 6d bytes]\n", seg.addr, seg.filesz);
+        memcpy(p, seg.data, seg.filesz);
     }
-    else if (start_addr >= RAM_ADDR && start_addr < (RAM_ADDR + RAM_SIZE)) 
+}
+
+
+void Backend_atomsim::fetch(const uint32_t start_addr, uint8_t *buf, const uint32_t buf_sz) 
+{
+    uint8_t *p = mem_ptr(start_addr, buf_sz);
+    if (!p)
     {
-        if(!(start_addr + buf_sz - 1 < RAM_ADDR + RAM_SIZE))
-            throw Atomsim_exception("can't store; bufsize too large for mem");
-
-        // Copy mem to buf
-        for(unsigned buf_indx = 0; buf_indx < buf_sz; buf_indx++){
-            uint32_t mem_addr = start_addr + buf_indx;
-            uint32_t mem_indx = (mem_addr-RAM_ADDR) / 4;
-            uint32_t line_offset = 8 * ((mem_addr-RAM_ADDR) % 4);
-            tb->m_core->HydrogenSoC->ram->mem[mem_indx] = (tb->m_core->HydrogenSoC->ram->mem[mem_indx] & ~(0xff << line_offset)) 
-                                                        | (((uint32_t) buf[buf_indx]) << line_offset);
-        }
+        char hx[10];
+        sprintf(hx, "%08x", start_addr);
+        throw Atomsim_exception("memory fetch failed: no mem block at given address (0x"+std::string(hx)+") or bufsize too large for mem");
     }
-    else {
+    memcpy(buf, p, buf_sz);
+}
+
+
+void Backend_atomsim::store(const uint32_t start_addr, uint8_t *buf, const uint32_t buf_sz)
+{
+    uint8_t *p = mem_ptr(start_addr, buf_sz);
+    if (!p)
+    {
         char hx[10];
         sprintf(hx, "%08x", start_addr);
-        throw Atomsim_exception("memory store failed: no mem block at given address (0x"+std::string(hx)+")");
+        throw Atomsim_exception("memory store failed: no mem block at given address (0x"+std::string(hx)+") or bufsize too large for mem");
     }
-}
\ No newline at end of file
+    memcpy(p, buf, buf_sz);
+}
@@ -1,7 +1,7 @@
 #pragma once
 
 #include "backend.hpp"
-#include "build/verilated/VHydrogenSoC.h"
+#include "VHydrogenSoC.h"
 
 #include <memory>
 
@@ -17,6 +17,13 @@ struct Backend_config
     uint32_t vuart_baudrate     = 115200;
     bool enable_uart_dump       = false;
     int bootmode                = 1;    // Jump to RAM
+    std::string uart_model      = "bitbang";    // uart model: bitbang / tlm
+    bool idle_skip              = true;     // fast-forward while core sleeps in WFI
+    bool busywait_skip          = true;     // fast-forward over busy-wait loops
+    bool busywait_approx        = false;    // ...also those whose exit can't be predicted (inexact)
+
+    std::string engine          = "rtl";    // simulation engine (only rtl supported)
+    bool lockstep               = false;    // run rtl in lockstep with reference iss (not supported)
 };
 
 
@@ -44,13 +51,49 @@ public:
 
     void UART();
 
-    int tick();
+    void pre_tick();
+
+    uint64_t skip_idle(uint64_t max_cycles);
+
+    uint64_t skip_busywait(uint64_t max_cycles);
    
     void fetch(const uint32_t start_addr, uint8_t *buf, const uint32_t buf_sz);
 
     void store(const uint32_t start_addr, uint8_t *buf, const uint32_t buf_sz);
 
+#ifdef ATOMSIM_SAVABLE
+    void save_state(VerilatedSerialize &os);
+
+    void restore_state(VerilatedDeserialize &is);
+#endif
+
 private:
+    /**
+     * @brief Relay a byte sent by the soc to vuart/stdout
+     * @param c character
+     */
+    void uart_putc(char c);
+
+    /**
+     * @brief Exchange uart bytes with the transaction level model in the
+     * uart (bypasses serial pins)
+     */
+    void UART_tlm();
+
+    /**
+     * @brief Get pointer to given block in rom/ram
+     * @param start_addr block address
+     * @param buf_sz block size
+     * @return uint8_t* pointer (nullptr if block is not entirely in rom or ram)
+     */
+    uint8_t * mem_ptr(const uint32_t start_addr, const uint32_t buf_sz);
+
+    /**
+     * @brief Load loadable segments of an ELF file into rom/ram
+     * @param file ELF file
+     */
+    void load_elf(const std::string &file);
+
     /**
      * @brief Backend configuration parameters
      */
@@ -66,6 +109,16 @@ private:
      */
     bool using_vuart_ = false;
 
+    /**
+     * @brief Number of consecutive cycles the soc has been idle
+     */
+    uint64_t idle_cycles_ = 0;
+
+    /**
+     * @brief Use transaction level uart model?
+     */
+    bool uart_tlm_ = false;
+
     /**
      * @brief UART btbang drver
      */
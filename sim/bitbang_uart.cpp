@@ -14,17 +14,19 @@ BitbangUART::BitbangUART(bool * rx_pin, bool * tx_pin, unsigned fr):
     rx_pin(rx_pin),
     tx_pin(tx_pin),
     FR(fr)
-{}
+{
+    tx_sm.pin = true;   // idle line is high
+}
 
 
 void BitbangUART::rx_eval()
 {
     // Vars
-    static bool prev_rx = false;       // prev tx pin value
-    static UART_State state = IDLE;    // current state
-    static int wait_cyc = 0;           // number of cycles to wait
-    static int got_bits = 0;           // number of bits received
-    static uint8_t byte = 0;           // data byte
+    bool &prev_rx = rx_sm.pin;         // prev tx pin value
+    UART_State &state = rx_sm.state;   // current state
+    int &wait_cyc = rx_sm.wait_cyc;    // number of cycles to wait
+    int &got_bits = rx_sm.nbits;       // number of bits received
+    uint8_t &byte = rx_sm.byte;        // data byte
 
     // Sample rx
     bool rx = *rx_pin;
@@ -97,12 +99,12 @@ void BitbangUART::rx_eval()
 
 void BitbangUART::tx_eval()
 {
-    static uint8_t byte = 0;
-    static int wait_cyc = 0;           // number of cycles to wait
-    static UART_State state = IDLE;    // current state
-    static int sent_bits = 0;          // number of bits sent
+    uint8_t &byte = tx_sm.byte;
+    int &wait_cyc = tx_sm.wait_cyc;    // number of cycles to wait
+    UART_State &state = tx_sm.state;   // current state
+    int &sent_bits = tx_sm.nbits;      // number of bits sent
 
-    static bool txval = true;
+    bool &txval = tx_sm.pin;
 
     if(wait_cyc){
         D(printf("tx: wait %d\n", wait_cyc);)
@@ -1,5 +1,6 @@
 #pragma once
 #include <stddef.h>
+#include <stdint.h>
 #include <queue>
 
 
@@ -7,10 +8,30 @@
 class BitbangUART
 {
     public:
+    enum UART_State {
+        IDLE,
+        START_BIT,
+        DATA_BITS,
+        STOP_BIT
+    };
+
+    // state of rx/tx state machines
+    struct SM_State {
+        UART_State state = IDLE;    // current state
+        int wait_cyc = 0;           // number of cycles to wait
+        int nbits = 0;              // number of bits received/sent
+        uint8_t byte = 0;           // data byte
+        bool pin = false;           // rx: prev pin value, tx: current pin value
+    };
+
     // publickly accessible fifo queues
     std::queue<char> rx_fifo;
     std::queue<char> tx_fifo;
 
+    // publickly accessible state (used for checkpointing)
+    SM_State rx_sm;
+    SM_State tx_sm;
+
     // settings
 
     BitbangUART(bool * rx_pin, bool * tx_pin, unsigned FR);
@@ -21,13 +42,12 @@ class BitbangUART
         tx_eval();
     }
 
+    // true if nothing is being sent or received
+    bool idle() {
+        return rx_sm.state == IDLE && tx_sm.state == IDLE && rx_fifo.empty() && tx_fifo.empty();
+    }
+
     private:
-    enum UART_State {
-        IDLE,
-        START_BIT,
-        DATA_BITS,
-        STOP_BIT
-    };
 
     void rx_eval();
     void tx_eval();
@@ -0,0 +1,296 @@
+#include "busywait.hpp"
+
+#include <string.h>
+
+#include <algorithm>
+
+#define FNV_PRIME   0x100000001b3ULL
+
+// RV32 opcodes/funct3 of interest
+#define OPC_LOAD    0x03
+#define OPC_STORE   0x23
+#define OPC_AMO     0x2f
+#define OPC_BRANCH  0x63
+#define OPC_SYSTEM  0x73
+
+#define F3_BEQ      0
+#define F3_BNE      1
+#define F3_BLT      4
+#define F3_BGE      5
+
+
+/**
+ * @brief Max number of times a value can be advanced by delta without
+ * wrapping around, in either unsigned or signed interpretation
+ */
+static uint64_t wrap_limit(uint32_t val, uint32_t delta)
+{
+    int64_t d = (int32_t)delta;
+    if (d == 0)
+        return UINT64_MAX;
+
+    int64_t u = val;
+    int64_t s = (int32_t)val;
+    if (d > 0)
+        return std::min<int64_t>((0xffffffffLL - u) / d, (0x7fffffffLL - s) / d);
+    else
+        return std::min<int64_t>(u / -d, (s + 0x80000000LL) / -d);
+}
+
+
+BusyWait::BusyWait(const std::vector<uint32_t *> &regs, const std::vector<uint64_t *> &counters, bool approx):
+    regs_(regs),
+    counters_(counters),
+    approx_(approx),
+    ctr_snap_(counters.size()),
+    ctr_delta_(counters.size())
+{}
+
+
+void BusyWait::reset()
+{
+    have_head_ = false;
+    started_ = false;
+    nmatch_ = 0;
+    skipped_ = false;
+}
+
+
+uint64_t BusyWait::detect(uint32_t pc, uint32_t ir, bool valid, uint64_t max_cycles)
+{
+    // this cycle was observed before the skip
+    if (skipped_)
+    {
+        skipped_ = false;
+        return 0;
+    }
+
+    // an instruction stays in ir while stage2 is stalled
+    bool new_insn = valid && !(last_valid_ && pc == last_pc_);
+    last_pc_ = pc;
+    last_valid_ = valid;
+
+    uint64_t iters = 0;
+    if (new_insn)
+    {
+        // target of a backward jump is a candidate loop head
+        if (!have_head_ && pc < prev_insn_pc_)
+        {
+            have_head_ = true;
+            head_ = pc;
+        }
+
+        if (have_head_ && pc == head_)
+        {
+            if (started_ && complete_iter())
+                iters = safe_iters(max_cycles);
+
+            // start next iteration
+            for (int i = 1; i < 32; i++)
+                snap_[i] = *regs_[i];
+            for (unsigned i = 0; i < counters_.size(); i++)
+                ctr_snap_[i] = *counters_[i];
+            cur_ = Iter_t();
+            started_ = true;
+        }
+
+        if (started_ && !add_insn(pc, ir))
+        {
+            reset();
+            iters = 0;
+        }
+        prev_insn_pc_ = pc;
+    }
+
+    if (started_ && ++cur_.cycles > BUSYWAIT_MAX_CYCLES)
+        reset();
+
+    skipped_ = iters > 0;
+    return iters;
+}
+
+
+bool BusyWait::add_insn(uint32_t pc, uint32_t ir)
+{
+    if (++cur_.insns > BUSYWAIT_MAX_INSNS)
+        return false;
+    cur_.hash = (cur_.hash ^ pc) * FNV_PRIME;
+
+    uint32_t funct3 = (ir >> 12) & 0x7;
+    uint32_t rs1 = (ir >> 15) & 0x1f;
+    uint32_t rs2 = (ir >> 20) & 0x1f;
+    uint32_t v1 = rs1 ? *regs_[rs1] : 0;
+    uint32_t v2 = rs2 ? *regs_[rs2] : 0;
+
+    switch (ir & 0x7f)
+    {
+        case OPC_STORE:
+        case OPC_AMO:
+            return false;
+
+        case OPC_SYSTEM:
+            // only csr reads (csrrs/csrrc with rs1=x0, csrrsi/csrrci with uimm=0);
+            // no ecall, ebreak, mret, wfi or csr writes
+            return (funct3 == 2 || funct3 == 3 || funct3 == 6 || funct3 == 7) && rs1 == 0;
+
+        case OPC_LOAD:
+        {
+            // same address must be polled in every iteration
+            uint32_t addr = v1 + ((int32_t)ir >> 20);
+            cur_.hash = (cur_.hash ^ addr) * FNV_PRIME;
+            return true;
+        }
+
+        case OPC_BRANCH:
+            if (cur_.nbr == BUSYWAIT_MAX_BRANCHES)
+                return false;
+            cur_.br[cur_.nbr].a = v1;
+            cur_.br[cur_.nbr].b = v2;
+            cur_.br[cur_.nbr].funct3 = funct3;
+            cur_.nbr++;
+            return true;
+
+        default:
+            return true;
+    }
+}
+
+
+bool BusyWait::complete_iter()
+{
+    uint32_t delta[32];
+    for (int i = 1; i < 32; i++)
+        delta[i] = *regs_[i] - snap_[i];
+
+    // counters must advance by the same amount in every iteration
+    bool steady = true;
+    for (unsigned i = 0; i < counters_.size(); i++)
+    {
+        uint64_t d = *counters_[i] - ctr_snap_[i];
+        steady &= d == ctr_delta_[i];
+        ctr_delta_[i] = d;
+    }
+
+    bool same = nmatch_ > 0 && cur_.cycles == last_.cycles && cur_.insns == last_.insns
+                && cur_.hash == last_.hash && cur_.nbr == last_.nbr;
+    if (!same)
+        nmatch_ = 1;
+    else
+    {
+        // registers & branch operands must change linearly
+        bool linear = steady && memcmp(&delta[1], &reg_delta_[1], 31 * sizeof(uint32_t)) == 0;
+        for (unsigned j = 0; j < cur_.nbr; j++)
+        {
+            uint32_t da = cur_.br[j].a - last_.br[j].a;
+            uint32_t db = cur_.br[j].b - last_.br[j].b;
+            if (nmatch_ >= 2 && (da != br_delta_[j][0] || db != br_delta_[j][1]))
+                linear = false;
+            br_delta_[j][0] = da;
+            br_delta_[j][1] = db;
+        }
+        nmatch_ = linear ? nmatch_ + 1 : 1;
+    }
+
+    memcpy(&reg_delta_[1], &delta[1], 31 * sizeof(uint32_t));
+    last_ = cur_;
+    return nmatch_ >= BUSYWAIT_CONFIRM_ITERS;
+}
+
+
+uint64_t BusyWait::safe_iters(uint64_t max_cycles)
+{
+    uint64_t limit = max_cycles / last_.cycles;
+
+    // registers must not wrap around (their values would no longer be linear)
+    for (int i = 1; i < 32; i++)
+        limit = std::min(limit, wrap_limit(*regs_[i], reg_delta_[i]));
+
+    // find first iteration in which a branch goes the other way
+    bool predicted = false;
+    for (unsigned j = 0; j < last_.nbr; j++)
+    {
+        uint32_t a = last_.br[j].a, b = last_.br[j].b;
+        uint8_t funct3 = last_.br[j].funct3;
+        limit = std::min({limit, wrap_limit(a, br_delta_[j][0]), wrap_limit(b, br_delta_[j][1])});
+
+        // a-b in m iterations from now: c + m*e
+        bool sgn = funct3 == F3_BLT || funct3 == F3_BGE;
+        int64_t c = sgn ? (int64_t)(int32_t)a - (int32_t)b : (int64_t)a - (int64_t)b;
+        int64_t e = (int64_t)(int32_t)br_delta_[j][0] - (int32_t)br_delta_[j][1];
+        if (e == 0)
+            continue;
+
+        int64_t m;
+        if (funct3 == F3_BEQ || funct3 == F3_BNE)
+        {
+            if (c == 0)
+                m = 0;
+            else if ((c > 0) == (e > 0))
+                continue;   // moving away from equality
+            else
+                m = (std::abs(c) - 1) / std::abs(e);
+        }
+        else
+        {
+            if (c < 0 && e > 0)
+                m = (-c - 1) / e;
+            else if (c >= 0 && e < 0)
+                m = c / -e;
+            else
+                continue;   // moving away from sign change
+        }
+        limit = std::min<uint64_t>(limit, m);
+        predicted = true;
+    }
+
+    // exit depends on something that can't be extrapolated (e.g. peripheral
+    // input), so the cycle in which it happens is unknown; in approximate 
+    // mode skip a chunk & check again
+    approx_skip_ = !predicted;
+    if (!predicted)
+    {
+        if (!approx_)
+            return 0;
+        limit = std::min<uint64_t>(limit, BUSYWAIT_MAX_SKIP / last_.cycles);
+    }
+
+    if (limit * last_.cycles < BUSYWAIT_MIN_SKIP)
+        return 0;
+    return limit;
+}
+
+
+void BusyWait::skip(uint64_t iters)
+{
+    for (int i = 1; i < 32; i++)
+    {
+        uint32_t d = reg_delta_[i] * iters;
+        *regs_[i] += d;
+        snap_[i] += d;
+    }
+    for (unsigned i = 0; i < counters_.size(); i++)
+    {
+        uint64_t d = ctr_delta_[i] * iters;
+        *counters_[i] += d;
+        ctr_snap_[i] += d;
+    }
+
+    // operands of branches executed so far (last iteration & loop head)
+    for (unsigned j = 0; j < last_.nbr; j++)
+    {
+        uint32_t da = br_delta_[j][0] * iters;
+        uint32_t db = br_delta_[j][1] * iters;
+        last_.br[j].a += da;
+        last_.br[j].b += db;
+        if (j < cur_.nbr)
+        {
+            cur_.br[j].a += da;
+            cur_.br[j].b += db;
+        }
+    }
+
+    skips_++;
+    skipped_cycles_ += iters * last_.cycles;
+    if (approx_skip_)
+        approx_cycles_ += iters * last_.cycles;
+}
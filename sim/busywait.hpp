@@ -0,0 +1,230 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#define BUSYWAIT_MAX_INSNS      32      // max instructions in an iteration of a polling loop
+#define BUSYWAIT_MAX_CYCLES     256     // max cycles in an iteration of a polling loop
+#define BUSYWAIT_MAX_BRANCHES   4       // max conditional branches in an iteration
+#define BUSYWAIT_CONFIRM_ITERS  3       // identical iterations to be seen before a loop is skipped
+#define BUSYWAIT_MIN_SKIP       64      // don't bother skipping fewer cycles
+#define BUSYWAIT_MAX_SKIP       (1ULL << 20)    // max cycles skipped at once if loop exit can't be predicted (approximate mode)
+
+/**
+ * @brief Busy-wait loop detector
+ * @details Watches the instructions executed by the core (one call to
+ * detect() per simulated cycle) for a short polling loop, i.e. a loop which
+ * does not store to memory, write CSRs or trap, and only loads from the same
+ * addresses in every iteration. Such a loop can only be exited because of a
+ * value that changes with time (a counter CSR or timer register) or one that
+ * is supplied by a peripheral.
+ *
+ * Once a number of iterations are seen taking the same path & number of
+ * cycles, with every register and every branch operand changing by the same
+ * amount in each of them, the loop is considered periodic. The number of
+ * further iterations in which none of its branches changes direction is then
+ * computed by extrapolating the branch operands; these can be skipped by
+ * advancing registers and free running counters (skip()) without simulating
+ * them. A loop whose exit can't be predicted (branch operands don't change)
+ * is not skipped, since the cycle in which it would have exited is unknown,
+ * unless approximate mode is enabled, in which case it is skipped in chunks
+ * of up to BUSYWAIT_MAX_SKIP cycles (cycle counts then differ from those of
+ * a fully simulated run).
+ */
+class BusyWait
+{
+public:
+    /**
+     * @brief Construct a new BusyWait object
+     * @param regs handles to registers x0-x31 of target
+     * @param counters handles to free running counters of target (cycle &
+     * instret CSRs, timers, ...), which must also change by the same amount
+     * in every iteration
+     * @param approx also skip loops whose exit can't be predicted (in chunks)
+     */
+    BusyWait(const std::vector<uint32_t *> &regs, const std::vector<uint64_t *> &counters, bool approx = false);
+
+    /**
+     * @brief Observe instruction in execute stage of current cycle
+     * @details Must be called exactly once in every simulated cycle, before
+     * it is simulated. If it returns a non-zero value, those many iterations
+     * may be skipped with skip() in place of simulating this cycle; the
+     * detector is then called again for the same cycle and returns 0.
+     *
+     * @param pc pc of instruction
+     * @param ir instruction
+     * @param valid ir holds a valid instruction (not a bubble)
+     * @param max_cycles maximum number of cycles that may be skipped
+     * @return uint64_t number of iterations that can be skipped (0: none)
+     */
+    uint64_t detect(uint32_t pc, uint32_t ir, bool valid, uint64_t max_cycles);
+
+    /**
+     * @brief Advance registers & counters of target as if given number of
+     * iterations of detected loop were executed
+     * @param iters number of iterations (as returned by detect())
+     */
+    void skip(uint64_t iters);
+
+    /**
+     * @brief Forget detected loop (call when cycles were simulated without
+     * being observed by detect())
+     */
+    void reset();
+
+    /**
+     * @brief Get cycles per iteration of detected loop
+     * @return uint32_t
+     */
+    uint32_t iter_cycles()      { return last_.cycles; }
+
+    /**
+     * @brief Get number of times a loop was skipped
+     * @return uint64_t
+     */
+    uint64_t get_skips()        { return skips_; }
+
+    /**
+     * @brief Get total number of cycles skipped
+     * @return uint64_t
+     */
+    uint64_t get_skipped_cycles()   { return skipped_cycles_; }
+
+    /**
+     * @brief Get number of cycles skipped in loops whose exit couldn't be
+     * predicted (approximate mode)
+     * @return uint64_t
+     */
+    uint64_t get_approx_cycles()    { return approx_cycles_; }
+
+    /**
+     * @brief Set skip statistics (when restoring a checkpoint)
+     * @param skips number of times a loop was skipped
+     * @param cycles total number of cycles skipped
+     * @param approx cycles skipped in approximate mode
+     */
+    void set_stats(uint64_t skips, uint64_t cycles, uint64_t approx)
+    {
+        skips_ = skips;
+        skipped_cycles_ = cycles;
+        approx_cycles_ = approx;
+    }
+
+private:
+    /**
+     * @brief Record of an iteration of loop
+     */
+    struct Iter_t
+    {
+        uint32_t cycles = 0;
+        uint32_t insns = 0;
+        uint64_t hash = 0;      // hash of pc sequence & load addresses
+        unsigned nbr = 0;       // conditional branches executed
+        struct {
+            uint32_t a, b;      // operands
+            uint8_t funct3;
+        } br[BUSYWAIT_MAX_BRANCHES];
+    };
+
+    /**
+     * @brief Handles to x0-x31
+     */
+    std::vector<uint32_t *> regs_;
+
+    /**
+     * @brief Handles to free running counters
+     */
+    std::vector<uint64_t *> counters_;
+
+    /**
+     * @brief Skip loops whose exit can't be predicted
+     */
+    bool approx_;
+
+    /**
+     * @brief Set when safe_iters() returned a chunk of a loop whose exit
+     * can't be predicted
+     */
+    bool approx_skip_ = false;
+
+    /**
+     * @brief Loop head (target of backward jump) found?
+     */
+    bool have_head_ = false;
+    uint32_t head_ = 0;
+
+    /**
+     * @brief Instruction observed in last cycle (to tell stalls from new
+     * instructions)
+     */
+    uint32_t last_pc_ = 0;
+    bool last_valid_ = false;
+
+    /**
+     * @brief pc of last instruction executed
+     */
+    uint32_t prev_insn_pc_ = 0;
+
+    /**
+     * @brief Set when an iteration was started at loop head
+     */
+    bool started_ = false;
+
+    /**
+     * @brief Iteration in progress & last completed iteration
+     */
+    Iter_t cur_;
+    Iter_t last_;
+
+    /**
+     * @brief Registers at start of iteration in progress & change of
+     * registers in each iteration
+     */
+    uint32_t snap_[32];
+    uint32_t reg_delta_[32];
+
+    /**
+     * @brief Counters at start of iteration in progress & their change in
+     * each iteration
+     */
+    std::vector<uint64_t> ctr_snap_;
+    std::vector<uint64_t> ctr_delta_;
+
+    /**
+     * @brief Change of branch operands in each iteration
+     */
+    uint32_t br_delta_[BUSYWAIT_MAX_BRANCHES][2];
+
+    /**
+     * @brief Number of consecutive consistent iterations seen
+     */
+    unsigned nmatch_ = 0;
+
+    /**
+     * @brief Set after returning from detect() with a skip
+     */
+    bool skipped_ = false;
+
+    uint64_t skips_ = 0;
+    uint64_t skipped_cycles_ = 0;
+    uint64_t approx_cycles_ = 0;
+
+    /**
+     * @brief Account an instruction to iteration in progress
+     * @return false if instruction can't be part of a polling loop
+     */
+    bool add_insn(uint32_t pc, uint32_t ir);
+
+    /**
+     * @brief Complete an iteration (loop head reached)
+     * @return true if loop is confirmed to be periodic
+     */
+    bool complete_iter();
+
+    /**
+     * @brief Compute number of iterations that can be skipped
+     * @param max_cycles cycle limit
+     * @return uint64_t iterations
+     */
+    uint64_t safe_iters(uint64_t max_cycles);
+};
@@ -0,0 +1,167 @@
+#include "cache.hpp"
+#include "util.hpp"
+#include "except.hpp"
+
+static bool is_pow2(uint32_t x)
+{
+    return x && !(x & (x - 1));
+}
+
+
+/**
+ * @brief Parse a positive integer field of cache spec (with optional k suffix)
+ */
+static uint32_t parse_field(const std::string &field, const std::string &spec, bool allow_k)
+{
+    std::string s = field;
+    uint32_t mult = 1;
+    if (allow_k && !s.empty() && (s.back() == 'k' || s.back() == 'K'))
+    {
+        mult = 1024;
+        s.pop_back();
+    }
+    if (s.empty() || s.find_first_not_of("0123456789") != std::string::npos)
+        throw Atomsim_exception("invalid cache specification: "+spec);
+    return std::stoul(s) * mult;
+}
+
+
+Cache_config parse_cache_config(const std::string &spec)
+{
+    std::vector<std::string> fields;
+    tokenize(spec, fields, ':');
+    if (fields.size() < 3 || fields.size() > 5)
+        throw Atomsim_exception("invalid cache specification: "+spec+" (expected <size>:<ways>:<line size>[:lru|fifo|random][:wb|wt])");
+
+    Cache_config config;
+    config.size = parse_field(fields[0], spec, true);
+    config.ways = parse_field(fields[1], spec, false);
+    config.line_size = parse_field(fields[2], spec, false);
+
+    for (unsigned i = 3; i < fields.size(); i++)
+    {
+        const std::string &f = fields[i];
+        if (f == "lru")         config.repl = REPL_LRU;
+        else if (f == "fifo")   config.repl = REPL_FIFO;
+        else if (f == "random") config.repl = REPL_RANDOM;
+        else if (f == "wb")     config.write_back = true;
+        else if (f == "wt")     config.write_back = false;
+        else
+            throw Atomsim_exception("invalid cache specification: "+spec+" (unknown option \""+f+"\")");
+    }
+    return config;
+}
+
+
+Cache::Cache(const Cache_config &config):
+    config_(config)
+{
+    if (!is_pow2(config.line_size) || config.line_size < 4)
+        throw Atomsim_exception("cache line size must be a power of 2 (>= 4)");
+    if (config.ways == 0 || config.size % (config.ways * config.line_size) != 0)
+        throw Atomsim_exception("cache size must be a multiple of ways x line size");
+
+    uint32_t nsets = config.size / (config.ways * config.line_size);
+    if (!is_pow2(nsets))
+        throw Atomsim_exception("number of cache sets must be a power of 2");
+
+    line_bits_ = 0;
+    while ((1u << line_bits_) < config.line_size)
+        line_bits_++;
+    set_mask_ = nsets - 1;
+    lines_.resize(nsets * config.ways);
+}
+
+
+void Cache::invalidate()
+{
+    for (Line_t &l: lines_)
+        l = Line_t();
+}
+
+
+Cache::Access_t Cache::access(uint32_t addr, bool write)
+{
+    Access_t a;
+    now_++;
+    if (write)
+        stats_.writes++;
+    else
+        stats_.reads++;
+
+    uint32_t tag = addr >> line_bits_;
+    Line_t *set = &lines_[(tag & set_mask_) * config_.ways];
+
+    for (uint32_t w = 0; w < config_.ways; w++)
+    {
+        Line_t &l = set[w];
+        if (!l.valid || l.tag != tag)
+            continue;
+
+        // hit
+        if (config_.repl == REPL_LRU)
+            l.stamp = now_;
+        if (write && config_.write_back)
+            l.dirty = true;
+        a.write_through = write && !config_.write_back;
+        return a;
+    }
+
+    // miss
+    if (write)
+        stats_.write_misses++;
+    else
+        stats_.read_misses++;
+
+    if (write && !config_.write_back)
+    {
+        a.write_through = true;     // no write allocate
+        return a;
+    }
+
+    Line_t *l = victim(set);
+    if (l->valid && l->dirty)
+    {
+        stats_.writebacks++;
+        a.writeback = true;
+        a.wb_addr = l->tag << line_bits_;
+    }
+    a.fill = true;
+    l->tag = tag;
+    l->valid = true;
+    l->dirty = write;
+    l->stamp = now_;
+    return a;
+}
+
+
+Cache::Line_t * Cache::victim(Line_t *set)
+{
+    for (uint32_t w = 0; w < config_.ways; w++)
+        if (!set[w].valid)
+            return &set[w];
+
+    if (config_.repl == REPL_RANDOM)
+    {
+        rand_ ^= rand_ << 13;
+        rand_ ^= rand_ >> 17;
+        rand_ ^= rand_ << 5;
+        return &set[rand_ % config_.ways];
+    }
+
+    // lru & fifo: oldest stamp
+    Line_t *v = set;
+    for (uint32_t w = 1; w < config_.ways; w++)
+        if (set[w].stamp < v->stamp)
+            v = &set[w];
+    return v;
+}
+
+
+std::string Cache::describe()
+{
+    static const char * const repl_names[] = {"lru", "fifo", "random"};
+    std::string size = (config_.size % 1024 == 0) ? std::to_string(config_.size / 1024) + " KB" : std::to_string(config_.size) + " B";
+    return size + ", " + std::to_string(config_.ways) + "-way, " + std::to_string(config_.line_size) + " B lines, "
+        + repl_names[config_.repl] + ", " + (config_.write_back ? "wb" : "wt");
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Cache replacement policy
+ */
+enum CacheRepl_t {
+    REPL_LRU,       // least recently used
+    REPL_FIFO,      // first in first out (oldest fill)
+    REPL_RANDOM     // pseudo random (deterministic)
+};
+
+/**
+ * @brief Cache configuration
+ */
+struct Cache_config
+{
+    uint32_t size       = 4096;     // capacity (bytes)
+    uint32_t ways       = 2;        // associativity
+    uint32_t line_size  = 32;       // line size (bytes)
+    CacheRepl_t repl    = REPL_LRU;
+    bool write_back     = true;     // write-back & write-allocate (else write-through & no-write-allocate)
+};
+
+/**
+ * @brief Parse cache specification
+ * @details Format: <size>:<ways>:<line size>[:lru|fifo|random][:wb|wt];
+ * size may have a k suffix (KB).
+ * @param spec specification string
+ * @return Cache_config
+ * @throws Atomsim_exception if spec is malformed
+ */
+Cache_config parse_cache_config(const std::string &spec);
+
+/**
+ * @brief Cache timing model
+ * @details Tracks tags (not data) of a set associative cache, to tell hits
+ * from misses for the timing of memory accesses; data is always read from /
+ * written to memory. access() reports the memory transfers an access needs
+ * (line fill, write back of evicted dirty line, write through), which are
+ * timed by the caller. In write-through mode store misses don't allocate a
+ * line.
+ */
+class Cache
+{
+public:
+    /**
+     * @brief Access statistics
+     */
+    struct Stats_t
+    {
+        uint64_t reads = 0;
+        uint64_t read_misses = 0;
+        uint64_t writes = 0;
+        uint64_t write_misses = 0;
+        uint64_t writebacks = 0;
+    };
+
+    /**
+     * @brief Memory transfers needed by an access
+     */
+    struct Access_t
+    {
+        bool writeback = false;     // write back evicted line (at wb_addr)
+        bool fill = false;          // fill line
+        bool write_through = false; // write stored word to memory
+        uint32_t wb_addr = 0;
+    };
+
+    /**
+     * @brief Construct a new Cache object
+     * @param config configuration
+     * @throws Atomsim_exception if geometry is invalid
+     */
+    Cache(const Cache_config &config);
+
+    /**
+     * @brief Look up an access & update cache state
+     * @param addr address
+     * @param write true for store
+     * @return Access_t memory transfers needed
+     */
+    Access_t access(uint32_t addr, bool write);
+
+    /**
+     * @brief Invalidate all lines (dirty lines are dropped)
+     */
+    void invalidate();
+
+    /**
+     * @brief Get configuration
+     * @return const Cache_config&
+     */
+    const Cache_config & get_config()   { return config_; }
+
+    /**
+     * @brief Get access statistics
+     * @return Stats_t&
+     */
+    Stats_t & get_stats()   { return stats_; }
+
+    /**
+     * @brief Get description of configuration (e.g. "4 KB, 2-way, 32 B lines, lru, wb")
+     * @return std::string
+     */
+    std::string describe();
+
+private:
+    struct Line_t
+    {
+        uint32_t tag = 0;       // line address
+        bool valid = false;
+        bool dirty = false;
+        uint64_t stamp = 0;     // last use (lru) / fill (fifo)
+    };
+
+    Cache_config config_;
+    Stats_t stats_;
+
+    /**
+     * @brief Lines; ways of a set are adjacent
+     */
+    std::vector<Line_t> lines_;
+
+    uint32_t line_bits_;
+    uint32_t set_mask_;
+
+    /**
+     * @brief Access count (used as timestamp)
+     */
+    uint64_t now_ = 0;
+
+    /**
+     * @brief State of xorshift generator (random replacement)
+     */
+    uint32_t rand_ = 0x2545f491;
+
+    /**
+     * @brief Pick way of a set to be replaced
+     * @param set first line of set
+     * @return Line_t* victim
+     */
+    Line_t * victim(Line_t *set);
+};
@@ -0,0 +1,110 @@
+#include "commitlog.hpp"
+#include "except.hpp"
+
+#include <string.h>
+#include <chrono>
+
+#define COMMITLOG_QUEUE_SIZE    (1 << 16)   // records
+#define COMMITLOG_BATCH_SIZE    1024        // records popped at once by writer
+#define COMMITLOG_OUTBUF_SIZE   (1 << 20)   // bytes buffered before writing to file
+
+
+CommitLog::CommitLog(const std::string &file):
+    queue_(COMMITLOG_QUEUE_SIZE),
+    ircache_pc_(COMMITLOG_IRCACHE_SIZE, 0xffffffff),
+    ircache_ir_(COMMITLOG_IRCACHE_SIZE, 0)
+{
+    fp_ = fopen(file.c_str(), "wb");
+    if(!fp_)
+        throw Atomsim_exception("can't open commit log file for writing: "+file);
+
+    fwrite(COMMITLOG_MAGIC, 1, strlen(COMMITLOG_MAGIC), fp_);
+    fputc(COMMITLOG_VERSION, fp_);
+
+    out_.reserve(COMMITLOG_OUTBUF_SIZE + 64);
+    thread_ = std::thread(&CommitLog::writer, this);
+}
+
+
+CommitLog::~CommitLog()
+{
+    done_.store(true, std::memory_order_release);
+    thread_.join();
+    fclose(fp_);
+}
+
+
+void CommitLog::writer()
+{
+    std::vector<CommitRec_t> batch(COMMITLOG_BATCH_SIZE);
+    while(true)
+    {
+        // check done flag before popping, so that records pushed before it was set are drained
+        bool done = done_.load(std::memory_order_acquire);
+        size_t n = queue_.pop(batch.data(), batch.size());
+
+        for(size_t i=0; i<n; i++)
+            encode(batch[i]);
+
+        if(out_.size() >= COMMITLOG_OUTBUF_SIZE || (n == 0 && !out_.empty())) {
+            fwrite(out_.data(), 1, out_.size(), fp_);
+            out_.clear();
+        }
+
+        if(n == 0) {
+            if(done)
+                break;
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+}
+
+
+void CommitLog::put_varint(uint64_t v)
+{
+    while(v >= 0x80) {
+        out_.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out_.push_back((uint8_t)v);
+}
+
+
+void CommitLog::encode(const CommitRec_t &r)
+{
+    const bool compressed = (r.ir & 0b11) != 0b11;
+    const unsigned ic = (r.pc >> 1) & (COMMITLOG_IRCACHE_SIZE-1);
+
+    uint8_t flags = 0;
+    if(r.cycle - last_cycle_ != 1)                          flags |= CLOG_CYCLE;
+    if(r.pc != next_pc_)                                    flags |= CLOG_NONSEQ_PC;
+    if(ircache_pc_[ic] != r.pc || ircache_ir_[ic] != r.ir)  flags |= CLOG_IR_LITERAL;
+    if(r.rd != 0)                                           flags |= CLOG_RD;
+    if(r.mem != 0)                                          flags |= CLOG_MEM;
+    out_.push_back(flags);
+
+    if(flags & CLOG_CYCLE)
+        put_varint(r.cycle - last_cycle_);
+    if(flags & CLOG_NONSEQ_PC)
+        put_zigzag((int32_t)(r.pc - next_pc_));
+    if(flags & CLOG_IR_LITERAL) {
+        for(unsigned b=0; b<(compressed ? 2 : 4); b++)
+            out_.push_back((uint8_t)(r.ir >> (8*b)));
+        ircache_pc_[ic] = r.pc;
+        ircache_ir_[ic] = r.ir;
+    }
+    if(flags & CLOG_RD) {
+        out_.push_back(r.rd);
+        put_zigzag((int32_t)(r.rd_val - regs_[r.rd & 0x1f]));
+        regs_[r.rd & 0x1f] = r.rd_val;
+    }
+    if(flags & CLOG_MEM) {
+        out_.push_back(r.mem);
+        put_zigzag((int32_t)(r.mem_addr - last_mem_addr_));
+        put_varint(r.mem_data);
+        last_mem_addr_ = r.mem_addr;
+    }
+
+    last_cycle_ = r.cycle;
+    next_pc_ = r.pc + (compressed ? 2 : 4);
+}
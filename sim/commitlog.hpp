@@ -0,0 +1,115 @@
+#pragma once
+
+#include "spsc_queue.hpp"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+
+/**
+ * @brief Instruction committed by target
+ */
+struct CommitRec_t {
+    uint64_t cycle = 0;
+    uint32_t pc = 0;
+    uint32_t ir = 0;        // as fetched (16-bit encoding if compressed)
+    uint32_t rd_val = 0;    // value written to rd
+    uint32_t mem_addr = 0;  // word aligned address
+    uint32_t mem_data = 0;  // data loaded/stored (whole word)
+    uint8_t rd = 0;         // destination register (0: none)
+    uint8_t mem = 0;        // bit 0-3: byte enables, bit 4: write (0: no memory access)
+};
+
+#define COMMITLOG_MAGIC     "ATOMCLOG"
+#define COMMITLOG_VERSION   2
+
+// Record flags
+#define CLOG_NONSEQ_PC      0x01    // pc != previous pc + previous instruction length
+#define CLOG_IR_LITERAL     0x02    // ir not in decoder's cache
+#define CLOG_RD             0x04    // register write
+#define CLOG_MEM            0x08    // memory access
+#define CLOG_CYCLE          0x10    // cycles since previous record != 1
+
+#define COMMITLOG_IRCACHE_SIZE  4096
+
+/**
+ * @brief Binary commit log
+ * @details Committed instructions are handed to a writer thread through a
+ * lock-free queue; the writer thread delta-encodes them and writes them to
+ * file. Use scripts/clogdump.py to decode.
+ *
+ * File format: magic (8 bytes), version (1 byte), followed by records.
+ * Each record starts with a flags byte, followed by (in order, only if the
+ * corresponding flag is set):
+ * - CLOG_CYCLE:      varint(cycle - previous cycle)
+ * - CLOG_NONSEQ_PC:  zigzag varint(pc - expected pc)
+ * - CLOG_IR_LITERAL: ir (2 bytes if compressed else 4 bytes, little endian);
+ *                    otherwise ir is taken from a direct mapped cache of
+ *                    COMMITLOG_IRCACHE_SIZE entries indexed by pc[12:1]
+ * - CLOG_RD:         rd (1 byte), zigzag varint(value - previous value of rd)
+ * - CLOG_MEM:        byte enables | write<<4 (1 byte), zigzag varint(addr -
+ *                    previous addr), varint(data)
+ */
+class CommitLog
+{
+public:
+    /**
+     * @brief Construct a new CommitLog object & start writer thread
+     * @param file output file
+     */
+    CommitLog(const std::string &file);
+
+    /**
+     * @brief Destroy the CommitLog object; drains queue & closes file
+     */
+    ~CommitLog();
+
+    /**
+     * @brief Log a committed instruction
+     * @param r record
+     */
+    void push(const CommitRec_t &r)
+    {
+        while(!queue_.push(r))
+            std::this_thread::yield();  // writer thread is behind
+        count_++;
+    }
+
+    /**
+     * @brief Get number of records logged
+     * @return uint64_t
+     */
+    uint64_t get_count()    { return count_; }
+
+private:
+    /**
+     * @brief Writer thread
+     */
+    void writer();
+
+    /**
+     * @brief Encode a record into out_
+     */
+    void encode(const CommitRec_t &r);
+
+    void put_varint(uint64_t v);
+    void put_zigzag(int32_t v)  { put_varint(((uint32_t)v << 1) ^ (uint32_t)(v >> 31)); }
+
+    FILE *fp_;
+    SpscQueue<CommitRec_t> queue_;
+    std::thread thread_;
+    std::atomic<bool> done_ {false};
+    uint64_t count_ = 0;
+
+    // encoder state (writer thread)
+    std::vector<uint8_t> out_;
+    uint64_t last_cycle_ = 0;
+    uint32_t next_pc_ = 0;
+    uint32_t regs_[32] = {0};
+    uint32_t last_mem_addr_ = 0;
+    std::vector<uint32_t> ircache_pc_;
+    std::vector<uint32_t> ircache_ir_;
+};
@@ -0,0 +1,433 @@
+#include "disasm.hpp"
+#include "rvdefs.hpp"
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#define DISASM_INITIAL_ENTRIES  4096            // must be a power of 2
+#define DISASM_MAX_POOL_SIZE    (16 << 20)      // cache is dropped if string pool grows beyond this
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Instruction encoders (used to expand compressed instructions)
+
+static inline uint32_t enc_r(uint32_t op, uint32_t rd, uint32_t f3, uint32_t rs1, uint32_t rs2, uint32_t f7)
+{
+    return (f7 << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12) | (rd << 7) | op;
+}
+
+static inline uint32_t enc_i(uint32_t op, uint32_t rd, uint32_t f3, uint32_t rs1, int32_t imm)
+{
+    return ((uint32_t)imm << 20) | (rs1 << 15) | (f3 << 12) | (rd << 7) | op;
+}
+
+static inline uint32_t enc_s(uint32_t op, uint32_t f3, uint32_t rs1, uint32_t rs2, int32_t imm)
+{
+    return (((uint32_t)imm >> 5 & 0x7f) << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12) | (((uint32_t)imm & 0x1f) << 7) | op;
+}
+
+static inline uint32_t enc_b(uint32_t f3, uint32_t rs1, uint32_t rs2, int32_t imm)
+{
+    uint32_t i = imm;
+    return ((i >> 12 & 1) << 31) | ((i >> 5 & 0x3f) << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12)
+        | ((i >> 1 & 0xf) << 8) | ((i >> 11 & 1) << 7) | 0x63;
+}
+
+static inline uint32_t enc_j(uint32_t rd, int32_t imm)
+{
+    uint32_t i = imm;
+    return ((i >> 20 & 1) << 31) | ((i >> 1 & 0x3ff) << 21) | ((i >> 11 & 1) << 20) | ((i >> 12 & 0xff) << 12) | (rd << 7) | 0x6f;
+}
+
+static inline int32_t sext(uint32_t val, unsigned bits)
+{
+    return (int32_t)(val << (32-bits)) >> (32-bits);
+}
+
+
+uint32_t rvExpandCompressed(uint16_t c)
+{
+    const uint32_t f3 = (c >> 13) & 0x7;
+    const uint32_t rd = (c >> 7) & 0x1f;            // also rs1
+    const uint32_t rs2 = (c >> 2) & 0x1f;
+    const uint32_t rdp = 8 + ((c >> 2) & 0x7);      // rd'/rs2'
+    const uint32_t rs1p = 8 + ((c >> 7) & 0x7);     // rs1'/rd'
+    const int32_t imm6 = sext((((c >> 12) & 1) << 5) | ((c >> 2) & 0x1f), 6);
+    const uint32_t shamt = (c >> 2) & 0x1f;
+
+    switch(c & 0b11)
+    {
+        case 0b00:
+        {
+            const uint32_t lwimm = (((c >> 10) & 7) << 3) | (((c >> 6) & 1) << 2) | (((c >> 5) & 1) << 6);
+            switch(f3)
+            {
+                case 0b000: {   // c.addi4spn
+                    uint32_t nzuimm = (((c >> 11) & 3) << 4) | (((c >> 7) & 0xf) << 6) | (((c >> 6) & 1) << 2) | (((c >> 5) & 1) << 3);
+                    return nzuimm ? enc_i(0x13, rdp, 0, 2, nzuimm) : 0;
+                }
+                case 0b010: return enc_i(0x03, rdp, 2, rs1p, lwimm);       // c.lw
+                case 0b110: return enc_s(0x23, 2, rs1p, rdp, lwimm);       // c.sw
+                default:    return 0;
+            }
+        }
+        case 0b01:
+        {
+            const int32_t jimm = sext((((c >> 12) & 1) << 11) | (((c >> 11) & 1) << 4) | (((c >> 9) & 3) << 8) | (((c >> 8) & 1) << 10)
+                                | (((c >> 7) & 1) << 6) | (((c >> 6) & 1) << 7) | (((c >> 3) & 7) << 1) | (((c >> 2) & 1) << 5), 12);
+            const int32_t bimm = sext((((c >> 12) & 1) << 8) | (((c >> 10) & 3) << 3) | (((c >> 5) & 3) << 6) | (((c >> 3) & 3) << 1)
+                                | (((c >> 2) & 1) << 5), 9);
+            switch(f3)
+            {
+                case 0b000: return enc_i(0x13, rd, 0, rd, imm6);           // c.addi / c.nop
+                case 0b001: return enc_j(1, jimm);                          // c.jal
+                case 0b010: return enc_i(0x13, rd, 0, 0, imm6);            // c.li
+                case 0b011:
+                    if(rd == 2) {   // c.addi16sp
+                        int32_t nzimm = sext((((c >> 12) & 1) << 9) | (((c >> 6) & 1) << 4) | (((c >> 5) & 1) << 6)
+                                        | (((c >> 3) & 3) << 7) | (((c >> 2) & 1) << 5), 10);
+                        return nzimm ? enc_i(0x13, 2, 0, 2, nzimm) : 0;
+                    }
+                    return imm6 ? (((uint32_t)imm6 << 12) | (rd << 7) | 0x37) : 0;   // c.lui
+                case 0b100:
+                    switch((c >> 10) & 3)
+                    {
+                        case 0b00: return (c >> 12) & 1 ? 0 : enc_i(0x13, rs1p, 5, rs1p, shamt);            // c.srli
+                        case 0b01: return (c >> 12) & 1 ? 0 : enc_i(0x13, rs1p, 5, rs1p, shamt | 0x400);    // c.srai
+                        case 0b10: return enc_i(0x13, rs1p, 7, rs1p, imm6);                                 // c.andi
+                        default:
+                            if((c >> 12) & 1)
+                                return 0;
+                            switch((c >> 5) & 3)
+                            {
+                                case 0b00:  return enc_r(0x33, rs1p, 0, rs1p, rdp, 0x20);   // c.sub
+                                case 0b01:  return enc_r(0x33, rs1p, 4, rs1p, rdp, 0);      // c.xor
+                                case 0b10:  return enc_r(0x33, rs1p, 6, rs1p, rdp, 0);      // c.or
+                                default:    return enc_r(0x33, rs1p, 7, rs1p, rdp, 0);      // c.and
+                            }
+                    }
+                case 0b101: return enc_j(0, jimm);                          // c.j
+                case 0b110: return enc_b(0, rs1p, 0, bimm);                 // c.beqz
+                default:    return enc_b(1, rs1p, 0, bimm);                 // c.bnez
+            }
+        }
+        case 0b10:
+            switch(f3)
+            {
+                case 0b000: return (c >> 12) & 1 ? 0 : enc_i(0x13, rd, 1, rd, shamt);                      // c.slli
+                case 0b010: {   // c.lwsp
+                    uint32_t uimm = (((c >> 12) & 1) << 5) | (((c >> 4) & 7) << 2) | (((c >> 2) & 3) << 6);
+                    return rd ? enc_i(0x03, rd, 2, 2, uimm) : 0;
+                }
+                case 0b100:
+                    if(!((c >> 12) & 1)) {
+                        if(rs2 == 0)
+                            return rd ? enc_i(0x67, 0, 0, rd, 0) : 0;       // c.jr
+                        return enc_r(0x33, rd, 0, 0, rs2, 0);               // c.mv
+                    }
+                    if(rs2 == 0)
+                        return rd ? enc_i(0x67, 1, 0, rd, 0) : RV_INSTR_EBREAK;  // c.jalr / c.ebreak
+                    return enc_r(0x33, rd, 0, rd, rs2, 0);                  // c.add
+                case 0b110: {   // c.swsp
+                    uint32_t uimm = (((c >> 9) & 0xf) << 2) | (((c >> 7) & 3) << 6);
+                    return enc_s(0x23, 2, 2, rs2, uimm);
+                }
+                default:    return 0;
+            }
+        default:
+            return 0;
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Disassembler
+
+static const char * csr_name(uint32_t csr)
+{
+    switch(csr)
+    {
+        case 0x300: return "mstatus";
+        case 0x301: return "misa";
+        case 0x304: return "mie";
+        case 0x305: return "mtvec";
+        case 0x340: return "mscratch";
+        case 0x341: return "mepc";
+        case 0x342: return "mcause";
+        case 0x343: return "mtval";
+        case 0x344: return "mip";
+        case 0xB00: return "mcycle";
+        case 0xB02: return "minstret";
+        case 0xB80: return "mcycleh";
+        case 0xB82: return "minstreth";
+        case 0xC00: return "cycle";
+        case 0xC01: return "time";
+        case 0xC02: return "instret";
+        case 0xC80: return "cycleh";
+        case 0xC81: return "timeh";
+        case 0xC82: return "instreth";
+        case 0xF11: return "mvendorid";
+        case 0xF12: return "marchid";
+        case 0xF13: return "mimpid";
+        case 0xF14: return "mhartid";
+        default:    return nullptr;
+    }
+}
+
+
+std::string rvDisassemble(uint32_t insn, uint32_t pc)
+{
+    if((insn & 0b11) != 0b11)
+    {
+        uint32_t exp = rvExpandCompressed(insn & 0xffff);
+        return exp ? rvDisassemble(exp, pc) : "unknown";
+    }
+
+    const uint32_t opcode = insn & 0x7f;
+    const uint32_t f3 = (insn >> 12) & 0x7;
+    const uint32_t f7 = insn >> 25;
+    const char *rd  = rv_abi_regnames[(insn >> 7) & 0x1f].c_str();
+    const char *rs1 = rv_abi_regnames[(insn >> 15) & 0x1f].c_str();
+    const char *rs2 = rv_abi_regnames[(insn >> 20) & 0x1f].c_str();
+    const bool rd0  = ((insn >> 7) & 0x1f) == 0;
+    const bool rs10 = ((insn >> 15) & 0x1f) == 0;
+    const bool rs20 = ((insn >> 20) & 0x1f) == 0;
+    const int32_t imm_i = (int32_t)insn >> 20;
+    const int32_t imm_s = ((int32_t)insn >> 25 << 5) | ((insn >> 7) & 0x1f);
+    const int32_t imm_b = sext(((insn >> 31) << 12) | (((insn >> 7) & 1) << 11) | (((insn >> 25) & 0x3f) << 5) | (((insn >> 8) & 0xf) << 1), 13);
+    const int32_t imm_j = sext(((insn >> 31) << 20) | (((insn >> 12) & 0xff) << 12) | (((insn >> 20) & 1) << 11) | (((insn >> 21) & 0x3ff) << 1), 21);
+
+    char buf[64];
+    auto fmt = [&buf](const char *mnemonic, const char *ops_fmt, ...) -> std::string {
+        int n = snprintf(buf, sizeof(buf), "%-8s", mnemonic);
+        va_list args;
+        va_start(args, ops_fmt);
+        vsnprintf(buf+n, sizeof(buf)-n, ops_fmt, args);
+        va_end(args);
+        return std::string(buf);
+    };
+
+    switch(opcode)
+    {
+        case 0x37:  return fmt("lui", "%s,0x%x", rd, insn >> 12);
+        case 0x17:  return fmt("auipc", "%s,0x%x", rd, insn >> 12);
+        case 0x6f:
+            if(rd0)                         return fmt("j", "%x", pc + imm_j);
+            if(((insn >> 7) & 0x1f) == 1)   return fmt("jal", "%x", pc + imm_j);
+            return fmt("jal", "%s,%x", rd, pc + imm_j);
+        case 0x67:
+            if(f3 != 0)
+                break;
+            if(rd0 && imm_i == 0)
+                return ((insn >> 15) & 0x1f) == 1 ? "ret" : fmt("jr", "%s", rs1);
+            if(((insn >> 7) & 0x1f) == 1 && imm_i == 0)
+                return fmt("jalr", "%s", rs1);
+            return fmt("jalr", "%s,%d(%s)", rd, imm_i, rs1);
+        case 0x63:
+        {
+            static const char *mn[8] = {"beq", "bne", nullptr, nullptr, "blt", "bge", "bltu", "bgeu"};
+            if(!mn[f3])
+                break;
+            if(rs20 && (f3 == 0 || f3 == 1 || f3 == 4 || f3 == 5)) {
+                static const char *z[8] = {"beqz", "bnez", nullptr, nullptr, "bltz", "bgez"};
+                return fmt(z[f3], "%s,%x", rs1, pc + imm_b);
+            }
+            if(rs10 && (f3 == 4 || f3 == 5))
+                return fmt(f3 == 4 ? "bgtz" : "blez", "%s,%x", rs2, pc + imm_b);
+            return fmt(mn[f3], "%s,%s,%x", rs1, rs2, pc + imm_b);
+        }
+        case 0x03:
+        {
+            static const char *mn[8] = {"lb", "lh", "lw", nullptr, "lbu", "lhu", nullptr, nullptr};
+            if(!mn[f3])
+                break;
+            return fmt(mn[f3], "%s,%d(%s)", rd, imm_i, rs1);
+        }
+        case 0x23:
+        {
+            static const char *mn[8] = {"sb", "sh", "sw"};
+            if(f3 > 2)
+                break;
+            return fmt(mn[f3], "%s,%d(%s)", rs2, imm_s, rs1);
+        }
+        case 0x13:
+        {
+            const uint32_t shamt = (insn >> 20) & 0x1f;
+            switch(f3)
+            {
+                case 0:
+                    if(insn == 0x13)    return "nop";
+                    if(rs10)            return fmt("li", "%s,%d", rd, imm_i);
+                    if(imm_i == 0)      return fmt("mv", "%s,%s", rd, rs1);
+                    return fmt("addi", "%s,%s,%d", rd, rs1, imm_i);
+                case 1:
+                    if(f7 != 0) break;
+                    return fmt("slli", "%s,%s,0x%x", rd, rs1, shamt);
+                case 2: return fmt("slti", "%s,%s,%d", rd, rs1, imm_i);
+                case 3:
+                    if(imm_i == 1)      return fmt("seqz", "%s,%s", rd, rs1);
+                    return fmt("sltiu", "%s,%s,%d", rd, rs1, imm_i);
+                case 4:
+                    if(imm_i == -1)     return fmt("not", "%s,%s", rd, rs1);
+                    return fmt("xori", "%s,%s,%d", rd, rs1, imm_i);
+                case 5:
+                    if(f7 == 0)         return fmt("srli", "%s,%s,0x%x", rd, rs1, shamt);
+                    if(f7 == 0x20)      return fmt("srai", "%s,%s,0x%x", rd, rs1, shamt);
+                    break;
+                case 6: return fmt("ori", "%s,%s,%d", rd, rs1, imm_i);
+                case 7: return fmt("andi", "%s,%s,%d", rd, rs1, imm_i);
+            }
+            break;
+        }
+        case 0x33:
+        {
+            if(f7 == 0x01) {
+                static const char *mn[8] = {"mul", "mulh", "mulhsu", "mulhu", "div", "divu", "rem", "remu"};
+                return fmt(mn[f3], "%s,%s,%s", rd, rs1, rs2);
+            }
+            if(f7 == 0x20) {
+                if(f3 == 0)
+                    return rs10 ? fmt("neg", "%s,%s", rd, rs2) : fmt("sub", "%s,%s,%s", rd, rs1, rs2);
+                if(f3 == 5)
+                    return fmt("sra", "%s,%s,%s", rd, rs1, rs2);
+                break;
+            }
+            if(f7 != 0)
+                break;
+            static const char *mn[8] = {"add", "sll", "slt", "sltu", "xor", "srl", "or", "and"};
+            if(f3 == 0 && rs10)
+                return fmt("mv", "%s,%s", rd, rs2);
+            if(f3 == 3 && rs10)
+                return fmt("snez", "%s,%s", rd, rs2);
+            return fmt(mn[f3], "%s,%s,%s", rd, rs1, rs2);
+        }
+        case 0x0f:
+            if(f3 == 1)
+                return "fence.i";
+            if(f3 == 0) {
+                auto iorw = [](uint32_t b, char *s) {
+                    int n = 0;
+                    if(b & 8) s[n++] = 'i';
+                    if(b & 4) s[n++] = 'o';
+                    if(b & 2) s[n++] = 'r';
+                    if(b & 1) s[n++] = 'w';
+                    s[n] = '\0';
+                };
+                char pred[5], succ[5];
+                iorw((insn >> 24) & 0xf, pred);
+                iorw((insn >> 20) & 0xf, succ);
+                return fmt("fence", "%s,%s", pred, succ);
+            }
+            break;
+        case 0x73:
+        {
+            if(f3 == 0) {
+                switch(insn)
+                {
+                    case 0x00000073:        return "ecall";
+                    case RV_INSTR_EBREAK:   return "ebreak";
+                    case 0x30200073:        return "mret";
+                    case 0x10500073:        return "wfi";
+                }
+                break;
+            }
+            if(f3 == 4)
+                break;
+
+            char csr[8];
+            const char *cname = csr_name(insn >> 20);
+            if(!cname) {
+                snprintf(csr, sizeof(csr), "0x%x", insn >> 20);
+                cname = csr;
+            }
+            const uint32_t uimm = (insn >> 15) & 0x1f;
+            static const char *mn[8] = {nullptr, "csrrw", "csrrs", "csrrc", nullptr, "csrrwi", "csrrsi", "csrrci"};
+            static const char *wr[8] = {nullptr, "csrw", "csrs", "csrc", nullptr, "csrwi", "csrsi", "csrci"};
+
+            if(f3 == 2 && rs10)
+                return fmt("csrr", "%s,%s", rd, cname);
+            if(f3 < 4)
+                return rd0 ? fmt(wr[f3], "%s,%s", cname, rs1) : fmt(mn[f3], "%s,%s,%s", rd, cname, rs1);
+            return rd0 ? fmt(wr[f3], "%s,%u", cname, uimm) : fmt(mn[f3], "%s,%s,%u", rd, cname, uimm);
+        }
+    }
+    return "unknown";
+}
+
+
+Disassembler::Disassembler(std::function<bool(uint32_t addr, uint32_t size, uint32_t &data)> fetch):
+    fetch_(fetch)
+{
+    clear();
+}
+
+
+void Disassembler::clear()
+{
+    table_.assign(DISASM_INITIAL_ENTRIES, {0, 0, EMPTY});
+    used_ = 0;
+    pool_.clear();
+}
+
+
+uint32_t Disassembler::add_string(uint32_t raw, uint32_t pc)
+{
+    std::string s = rvDisassemble(raw, pc);
+    uint32_t off = pool_.size();
+    pool_.insert(pool_.end(), s.begin(), s.end());
+    pool_.push_back('\0');
+    return off;
+}
+
+
+std::string Disassembler::get(uint32_t pc, uint32_t &raw)
+{
+    // read instruction from memory
+    uint32_t lo, hi;
+    if(!fetch_(pc, 2, lo))
+        return "";
+    raw = lo & 0xffff;
+    if((raw & 0b11) == 0b11) {
+        if(!fetch_(pc+2, 2, hi))
+            return "";
+        raw |= (hi & 0xffff) << 16;
+    }
+
+    if(pool_.size() > DISASM_MAX_POOL_SIZE)
+        clear();
+
+    // lookup (linear probing)
+    size_t mask = table_.size()-1;
+    size_t i = ((pc >> 1) * 0x9E3779B1u) & mask;
+    while(table_[i].str != EMPTY && table_[i].pc != pc)
+        i = (i+1) & mask;
+
+    Entry_t &e = table_[i];
+    if(e.str == EMPTY) {
+        e = {pc, raw, add_string(raw, pc)};
+        used_++;
+    }
+    else if(e.raw != raw) {
+        // memory was modified since last lookup
+        e.raw = raw;
+        e.str = add_string(raw, pc);
+    }
+    std::string s(&pool_[e.str]);
+
+    // grow table at 50% load
+    if(2*used_ > table_.size()) {
+        std::vector<Entry_t> old;
+        old.swap(table_);
+        table_.assign(old.size()*2, {0, 0, EMPTY});
+        mask = table_.size()-1;
+        for(const Entry_t &o: old) {
+            if(o.str == EMPTY)
+                continue;
+            size_t j = ((o.pc >> 1) * 0x9E3779B1u) & mask;
+            while(table_[j].str != EMPTY)
+                j = (j+1) & mask;
+            table_[j] = o;
+        }
+    }
+    return s;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <functional>
+
+/**
+ * @brief Disassemble an RV32IMC_Zicsr instruction
+ * @details Output follows objdump: ABI register names, common pseudo
+ * instructions, compressed instructions shown as their 32-bit equivalents
+ * and absolute branch/jump targets.
+ *
+ * @param insn instruction (compressed if insn[1:0] != 2'b11)
+ * @param pc address of instruction
+ * @return std::string disassembly
+ */
+std::string rvDisassemble(uint32_t insn, uint32_t pc);
+
+/**
+ * @brief Expand a compressed instruction to its 32-bit equivalent (the
+ * single RVC expansion table of atomsim, also used by the ISS decoder)
+ * @param c compressed instruction
+ * @return uint32_t 32-bit instruction (0 if illegal)
+ */
+uint32_t rvExpandCompressed(uint16_t c);
+
+
+/**
+ * @brief Disassembler
+ * Disassembles instructions lazily (on first request for a PC) from the
+ * memory image of the target, and caches them in a flat open addressed
+ * table; disassembly strings are kept in a single string pool. Cached
+ * entries are revalidated against memory on every lookup, so code which is
+ * loaded/modified at runtime is handled.
+ */
+class Disassembler
+{
+public:
+    /**
+     * @brief Construct a new Disassembler object
+     * @param fetch reads size (2/4) bytes of target memory at addr; returns
+     * false if addr is not mapped
+     */
+    Disassembler(std::function<bool(uint32_t addr, uint32_t size, uint32_t &data)> fetch);
+
+    /**
+     * @brief Get disassembly of instruction at given address
+     *
+     * @param pc address
+     * @param raw instruction at address (output)
+     * @return std::string disassembly ("" if address is not mapped)
+     */
+    std::string get(uint32_t pc, uint32_t &raw);
+
+    /**
+     * @brief Drop all cached disassembly
+     */
+    void clear();
+
+private:
+    /**
+     * @brief Cache entry
+     */
+    struct Entry_t {
+        uint32_t pc;
+        uint32_t raw;       // instruction disassembled
+        uint32_t str;       // offset of disassembly in pool_ (EMPTY: unused entry)
+    };
+    static const uint32_t EMPTY = 0xffffffff;
+
+    std::function<bool(uint32_t, uint32_t, uint32_t &)> fetch_;
+
+    std::vector<Entry_t> table_;
+    size_t used_ = 0;
+    std::vector<char> pool_;
+
+    /**
+     * @brief Add disassembly of raw to pool
+     * @return uint32_t offset in pool
+     */
+    uint32_t add_string(uint32_t raw, uint32_t pc);
+};
@@ -0,0 +1,163 @@
+#include "flightrec.hpp"
+#include "except.hpp"
+
+#include <stdio.h>
+
+#ifdef ATOMSIM_TRACE_FST
+#include "gtkwave/fstapi.h"
+#endif
+
+
+FlightRecorder::FlightRecorder(uint64_t depth):
+    depth_(depth)
+{
+    if(depth_ == 0)
+        throw Atomsim_exception("flight recorder depth must be non-zero");
+}
+
+
+void FlightRecorder::add_signal(const std::string &name, unsigned width, const void *ptr)
+{
+    if(width == 0 || width > 32)
+        throw Atomsim_exception("flight recorder: invalid width for signal "+name);
+
+    // signals never straddle words
+    if(bits_ + width > 32) {
+        words_++;
+        bits_ = 0;
+    }
+
+    Signal_t s;
+    s.name = name;
+    s.width = width;
+    s.ptr = ptr;
+    s.word = words_-1;
+    s.shift = bits_;
+    s.mask = (width == 32) ? 0xffffffff : ((1u << width) - 1);
+    signals_.push_back(s);
+    bits_ += width;
+
+    buf_.assign(depth_ * words_, 0);
+    cycles_.assign(depth_, 0);
+    clear();
+}
+
+
+template <class TimeFn, class ValueFn>
+void FlightRecorder::replay(TimeFn time_fn, ValueFn value_fn)
+{
+    uint64_t start = (head_ + depth_ - count_) % depth_;
+    const uint32_t *prev = nullptr;
+
+    for(uint64_t n=0; n<count_; n++)
+    {
+        uint64_t i = (start + n) % depth_;
+        const uint32_t *rec = &buf_[i * words_];
+
+        // sample holds values just before the rising edge (same timestamps as Testbench)
+        uint64_t t = 10*(cycles_[i]+1);
+        time_fn(t-5);
+        value_fn(-1, 0);
+        for(unsigned s=0; s<signals_.size(); s++)
+        {
+            uint32_t val = unpack(signals_[s], rec);
+            if(!prev || val != unpack(signals_[s], prev))
+                value_fn(s, val);
+        }
+        time_fn(t);
+        value_fn(-1, 1);
+        prev = rec;
+    }
+}
+
+
+/**
+ * @brief Format value as a binary string
+ */
+static void to_bin(uint32_t val, unsigned width, char *buf)
+{
+    for(unsigned b=0; b<width; b++)
+        buf[b] = (val >> (width-1-b)) & 1 ? '1' : '0';
+    buf[width] = '\0';
+}
+
+
+void FlightRecorder::dump(const std::string &file)
+{
+    if(file.size() >= 4 && file.substr(file.size()-4) == ".fst")
+        dump_fst(file);
+    else
+        dump_vcd(file);
+}
+
+
+void FlightRecorder::dump_vcd(const std::string &file)
+{
+    FILE *fp = fopen(file.c_str(), "w");
+    if(!fp)
+        throw Atomsim_exception("can't open flight recorder file for writing: "+file);
+
+    // identifiers: "!" for clk, followed by "\"", "#", ...
+    auto id = [](int s) { return std::string(1, (char)('"' + s)); };
+    if(signals_.size() > ('~' - '"'))
+        throw Atomsim_exception("flight recorder: too many signals");
+
+    fprintf(fp, "$version atomsim flight recorder $end\n");
+    fprintf(fp, "$timescale 1ps $end\n");
+    fprintf(fp, "$scope module flightrec $end\n");
+    fprintf(fp, "$var wire 1 ! clk $end\n");
+    for(unsigned s=0; s<signals_.size(); s++)
+        fprintf(fp, "$var wire %u %s %s $end\n", signals_[s].width, id(s).c_str(), signals_[s].name.c_str());
+    fprintf(fp, "$upscope $end\n");
+    fprintf(fp, "$enddefinitions $end\n");
+
+    char bin[33];
+    replay(
+        [&](uint64_t t) { fprintf(fp, "#%lu\n", (unsigned long)t); },
+        [&](int s, uint32_t val) {
+            if(s < 0)
+                fprintf(fp, "%u!\n", val);
+            else if(signals_[s].width == 1)
+                fprintf(fp, "%u%s\n", val, id(s).c_str());
+            else {
+                to_bin(val, signals_[s].width, bin);
+                fprintf(fp, "b%s %s\n", bin, id(s).c_str());
+            }
+        });
+
+    fclose(fp);
+}
+
+
+void FlightRecorder::dump_fst(const std::string &file)
+{
+#ifdef ATOMSIM_TRACE_FST
+    void *ctx = fstWriterCreate(file.c_str(), 1);
+    if(!ctx)
+        throw Atomsim_exception("can't open flight recorder file for writing: "+file);
+
+    fstWriterSetTimescaleFromString(ctx, "1ps");
+    fstWriterSetScope(ctx, FST_ST_VCD_MODULE, "flightrec", NULL);
+    fstHandle clk = fstWriterCreateVar(ctx, FST_VT_VCD_WIRE, FST_VD_IMPLICIT, 1, "clk", 0);
+    std::vector<fstHandle> handles;
+    for(const Signal_t &s: signals_)
+        handles.push_back(fstWriterCreateVar(ctx, FST_VT_VCD_WIRE, FST_VD_IMPLICIT, s.width, s.name.c_str(), 0));
+    fstWriterSetUpscope(ctx);
+
+    char bin[33];
+    replay(
+        [&](uint64_t t) { fstWriterEmitTimeChange(ctx, t); },
+        [&](int s, uint32_t val) {
+            if(s < 0) {
+                fstWriterEmitValueChange(ctx, clk, val ? "1" : "0");
+            } else {
+                to_bin(val, signals_[s].width, bin);
+                fstWriterEmitValueChange(ctx, handles[s], bin);
+            }
+        });
+
+    fstWriterClose(ctx);
+#else
+    throw Atomsim_exception("FST output is not supported in this build of atomsim (rebuild with TRACE_FST=1)");
+#endif
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Flight recorder
+ * Keeps the last N cycles of a set of signals in a ring buffer, and dumps
+ * them to a VCD (or FST) file on demand. Samples are bit-packed into 32-bit
+ * words, so memory footprint is fixed by the depth & set of signals and does
+ * not grow with the length of the simulation.
+ */
+class FlightRecorder
+{
+public:
+    /**
+     * @brief Construct a new FlightRecorder object
+     * @param depth number of cycles to keep
+     */
+    FlightRecorder(uint64_t depth);
+
+    /**
+     * @brief Add a signal to be recorded
+     * @note all signals must be added before first call to record()
+     *
+     * @param name signal name
+     * @param width width in bits (1-32); signal is read as uint8_t/uint16_t/uint32_t
+     * for widths upto 8/16/32 bits (like verilator CData/SData/IData)
+     * @param ptr pointer to signal
+     */
+    void add_signal(const std::string &name, unsigned width, const void *ptr);
+
+    /**
+     * @brief Record current values of all signals
+     * @param cycle cycle number
+     */
+    void record(uint64_t cycle)
+    {
+        uint32_t *rec = &buf_[head_ * words_];
+        for(unsigned i=0; i<words_; i++)
+            rec[i] = 0;
+
+        for(const Signal_t &s: signals_)
+            rec[s.word] |= (read(s) & s.mask) << s.shift;
+
+        cycles_[head_] = cycle;
+        if(++head_ == depth_)
+            head_ = 0;
+        if(count_ < depth_)
+            count_++;
+    }
+
+    /**
+     * @brief Discard all recorded cycles
+     */
+    void clear()            { head_ = 0; count_ = 0; }
+
+    /**
+     * @brief Get number of cycles currently recorded
+     * @return uint64_t
+     */
+    uint64_t get_count()    { return count_; }
+
+    /**
+     * @brief Dump recorded cycles to a trace file
+     * @details Format is chosen by file extension: FST for ".fst" (only if
+     * built with FST tracing), VCD otherwise
+     *
+     * @param file filename
+     */
+    void dump(const std::string &file);
+
+private:
+    /**
+     * @brief Recorded signal
+     */
+    struct Signal_t {
+        std::string name;
+        unsigned width;
+        const void *ptr;
+        unsigned word;      // word index in packed sample
+        unsigned shift;     // bit offset in word
+        uint32_t mask;
+    };
+
+    /**
+     * @brief Read current value of a signal
+     */
+    static uint32_t read(const Signal_t &s)
+    {
+        if(s.width <= 8)
+            return *(const uint8_t *)s.ptr;
+        if(s.width <= 16)
+            return *(const uint16_t *)s.ptr;
+        return *(const uint32_t *)s.ptr;
+    }
+
+    /**
+     * @brief Extract a signal value from a packed sample
+     */
+    static uint32_t unpack(const Signal_t &s, const uint32_t *rec)
+    {
+        return (rec[s.word] >> s.shift) & s.mask;
+    }
+
+    /**
+     * @brief Call time_fn(t) & value_fn(signal index, value) for every timestamp
+     * and value change (oldest first); signal index -1 is the clock
+     */
+    template <class TimeFn, class ValueFn>
+    void replay(TimeFn time_fn, ValueFn value_fn);
+
+    void dump_vcd(const std::string &file);
+    void dump_fst(const std::string &file);
+
+    std::vector<Signal_t> signals_;
+    unsigned words_ = 0;    // words per sample
+    unsigned bits_ = 32;    // bits used in last word
+
+    uint64_t depth_;
+    uint64_t head_ = 0;     // next entry to be written
+    uint64_t count_ = 0;    // valid entries
+
+    std::vector<uint32_t> buf_;     // packed samples
+    std::vector<uint64_t> cycles_;  // cycle number of each sample
+};
@@ -15,7 +15,7 @@
 
 #define DEBUG_PRINT_T2B
 #define DEFAULT_DUMPMEM_PATH "memdump.txt"
-#define DEFAULT_TRACEFILE_PATH "trace.vcd"
+#define DEFAULT_CHECKPOINT_PATH "atomsim.ckpt"
 #define ATOMSIM_PROMPT "atomsim> "
 #define ATOMSIM_HISTORY_FILE ".atomsim_history"
 #define ATOMSIM_HISTORY_LENGTH 1000
@@ -28,7 +28,13 @@ void Atomsim::display_dbg_screen()
     uint64_t pc = backend_.read_reg("pc");
     uint64_t ir = backend_.read_reg("ir");
 
-    std::string disasm = trimstr((disassembly_[pc].instr == ir) ? disassembly_[pc].disassembly : "_", 40);
+    // IR holds expanded form of compressed instructions; if IR doesn't hold 
+    // the instruction at PC (e.g. pipeline bubble), disassemble IR itself
+    uint32_t raw = 0;
+    std::string disasm = disassembler_.get(pc, raw);
+    if(disasm == "" || (raw != ir && rvExpandCompressed(raw & 0xffff) != ir))
+        disasm = rvDisassemble(ir, pc);
+    disasm = trimstr(disasm, 40);
 
     ////////////////////////////////////////////////////////////////////////////
     // Non verbose debug screen
@@ -177,12 +183,14 @@ Rcode Atomsim::run_interactive_mode()
     funcs["q"] =    funcs["quit"]       = &Atomsim::cmd_quit;
     funcs["v"] =    funcs["verbose"]    = &Atomsim::cmd_verbose;
                     funcs["trace"]      = &Atomsim::cmd_trace;
+                    funcs["checkpoint"] = &Atomsim::cmd_checkpoint;
 
                     funcs["reset"]      = &Atomsim::cmd_reset; 
     funcs["s"] =    funcs["step"]       = &Atomsim::cmd_step;
     funcs["r"] =    funcs["run"]        = &Atomsim::cmd_run;
     funcs["w"] =    funcs["while"]      = &Atomsim::cmd_while;
     funcs["b"] =    funcs["break"]      = &Atomsim::cmd_break;
+                    funcs["watch"]      = &Atomsim::cmd_watch;
     funcs["i"] =    funcs["info"]       = &Atomsim::cmd_info;
 
 
@@ -274,9 +282,12 @@ Rcode Atomsim::cmd_help(const std::vector<std::string>&)
     "  h, help                      : Show command help (this)\n"
     "  q, quit                      : Quit atomsim\n"
     "  v, verbose [\"on\"/\"off\"]  : set verbosity (toggle if ommitted)\n"
-    "     trace <on> [filepath]     : Enable VCD tracing.\n"
-    "                                 (default: " DEFAULT_TRACEFILE_PATH ")\n"
+    "     trace <on> [filepath]     : Enable VCD/FST tracing.\n"
+    "                                 (default: " DEFAULT_TRACE_FILE ")\n"
     "           <off>               : Disable VCD tracing\n"
+    "     checkpoint <save> [file]  : Save full simulation state to a file\n"
+    "                <load> [file]  : Restore simulation state from a file\n"
+    "                                 (default: " DEFAULT_CHECKPOINT_PATH ")\n"
     "\n"
     "*** Control commands ***\n"
     "     reset                      : Reset\n"
@@ -284,6 +295,8 @@ Rcode Atomsim::cmd_help(const std::vector<std::string>&)
     "  r, run                        : Run until finished (press ctrl+c to return\n" 
     "                                  to console)\n"
     "  b, break [addr]               : Set breakpoint at given address\n"
+    "     watch <reg>                : Set watchpoint on register (stops when\n"
+    "                                  its value changes)\n"
     // "  w,  while reg [reg] [cond] [val]     : Run while value of [reg] [cond] [val] is true\n"
     // "            pc [cond] [val]               Run while value of PC [cond] [val] is true\n"
     // "            mem [cond] [hex addr] [val]   Run while value at address [hex addr] [cond] [val] is true\n"
@@ -298,7 +311,12 @@ Rcode Atomsim::cmd_help(const std::vector<std::string>&)
     "  i, info [something]              : Show information about something\n"
     "                                     Display dbg screen if no arg provided \n"
     "                                       b|break:    show all breakpoints\n"
+    "                                       w|watch:    show all watchpoints\n"
     "                                       r|reg:      show all registers\n"
+    "                                       m|mem:      show memory map & host memory usage\n"
+    "                                       perf:       show retired instructions, CPI,\n"
+    "                                                   cycle breakdown, cache hit rates\n"
+    "                                                   & memory region stats\n"
     // "                                       s|symbols:  show all symbols\n"
     "  m, mem <addr> [bytes] [flags]    : Show contents of memory at <addr>\n"
     "                                       addr: start address\n"
@@ -368,12 +386,12 @@ Rcode Atomsim::cmd_trace(const std::vector<std::string> &args)
             }
             
             // enable trace
-            std::string tracefile = DEFAULT_TRACEFILE_PATH;
+            std::string tracefile = DEFAULT_TRACE_FILE;
             if(args.size() >= 2)
                 tracefile = args[1];
 
             backend_.open_trace(tracefile);
-            std::cout << "Trace enabled: \"" << tracefile << "\" opened for VCD output.\n";
+            std::cout << "Trace enabled: \"" << tracefile << "\" opened for output.\n";
             sim_config_.trace_flag = true;
         }
         else if(args[0] == "off")
@@ -396,6 +414,28 @@ Rcode Atomsim::cmd_trace(const std::vector<std::string> &args)
     return RC_OK;
 }
 
+Rcode Atomsim::cmd_checkpoint(const std::vector<std::string> &args)
+{
+    if (args.size() < 1 || args.size() > 2)
+        throw Atomsim_exception("checkpoint command expects \"save\"/\"load\" as 1st argument and an optional file path");
+    
+    std::string file = (args.size() == 2) ? args[1] : DEFAULT_CHECKPOINT_PATH;
+    if (args[0] == "save")
+    {
+        save_checkpoint(file);
+        std::cout << "Checkpoint saved: \"" << file << "\" (" << backend_.get_total_tick_count() << " ticks)\n";
+    }
+    else if (args[0] == "load")
+    {
+        load_checkpoint(file);
+        std::cout << "Checkpoint restored: \"" << file << "\" (" << backend_.get_total_tick_count() << " ticks)\n";
+        display_dbg_screen();
+    }
+    else
+        throw Atomsim_exception("1st arg can be only be \"save\"/\"load\"");
+    return RC_OK;
+}
+
 Rcode Atomsim::cmd_reset(const std::vector<std::string> &/*args*/)
 {
     std::cout << "Resetting..." << std::endl;
@@ -456,7 +496,8 @@ Rcode Atomsim::cmd_break(const std::vector<std::string> &args)
             }
         }
         if(i == NUM_MAX_BREAKPOINTS)
-            Atomsim_exception("Cannot set breakpoint, max used\n");
+            throw Atomsim_exception("Cannot set breakpoint, max used\n");
+        update_breakpoint_map();
      
         printf("Breakpoint %d at %s0x%08x%s\n", i, ansicode(FG_BLUE), breakpoints_[i].addr, ansicode(FG_RESET));
     }
@@ -467,6 +508,22 @@ Rcode Atomsim::cmd_break(const std::vector<std::string> &args)
 }
 
 
+Rcode Atomsim::cmd_watch(const std::vector<std::string> &args)
+{
+    if(args.size() != 1)
+        throw Atomsim_exception("too few/many args\n");
+
+    Watchpoint_t wp;
+    wp.reg = args[0];
+    wp.handle = backend_.get_reg_handle32(wp.reg);
+    wp.value = *wp.handle;
+    wp.active = true;
+    watchpoints_.push_back(wp);
+
+    printf("Watchpoint %ld on %s%s%s\n", watchpoints_.size()-1, ansicode(FG_BLUE), wp.reg.c_str(), ansicode(FG_RESET));
+    return RC_OK;
+}
+
 
 Rcode Atomsim::cmd_info(const std::vector<std::string> &args)
 {
@@ -485,6 +542,23 @@ Rcode Atomsim::cmd_info(const std::vector<std::string> &args)
                 }
             }
         }
+        else if(args[0] == "w" || args[0] == "watch") {
+            // show watchpoints
+            printf("Num  Register    Value\n");
+            for(unsigned i=0; i<watchpoints_.size(); i++){
+                if (watchpoints_[i].active) {
+                    printf("%3d  %s%-10s%s  0x%08x\n", i, ansicode(FG_BLUE), watchpoints_[i].reg.c_str(), ansicode(FG_RESET), watchpoints_[i].value);
+                }
+            }
+        }
+        else if(args[0] == "m" || args[0] == "mem") {
+            // show memory map & host memory usage
+            backend_.print_mem_info();
+        }
+        else if(args[0] == "perf") {
+            // show cycle breakdown
+            print_perf_info();
+        }
         else if(args[0] == "r" || args[0] == "reg") {
             // Print registers
             bool arch_regs_only = false;
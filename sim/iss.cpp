@@ -0,0 +1,574 @@
+#include "iss.hpp"
+
+#include "memory.hpp"
+#include "disasm.hpp"
+#include "except.hpp"
+
+#include <string.h>
+#include <stdio.h>
+
+// Granularity at which pre-decoded instructions are allocated (in bytes of code)
+#define ICACHE_PAGE_SHIFT   12
+#define ICACHE_PAGE_SZ      (1 << ICACHE_PAGE_SHIFT)
+
+// CSR addresses (see rtl/core/CSR_defs.vh)
+#define CSR_cycle       0xC00
+#define CSR_time        0xC01
+#define CSR_instret     0xC02
+#define CSR_cycleh      0xC80
+#define CSR_timeh       0xC81
+#define CSR_instreth    0xC82
+#define CSR_mvendorid   0xF11
+#define CSR_marchid     0xF12
+#define CSR_mimpid      0xF13
+#define CSR_mhartid     0xF14
+#define CSR_mstatus     0x300
+#define CSR_misa        0x301
+#define CSR_mie         0x304
+#define CSR_mtvec       0x305
+#define CSR_mstatush    0x310
+#define CSR_mscratch    0x340
+#define CSR_mepc        0x341
+#define CSR_mcause      0x342
+#define CSR_mtval       0x343
+#define CSR_mip         0x344
+#define CSR_mcycle      0xB00
+#define CSR_minstret    0xB02
+#define CSR_mcycleh     0xB80
+#define CSR_minstreth   0xB82
+
+#define MSTATUS_MIE     (1 << 3)
+#define MIX_MASK        ((1 << 11) | (1 << 7) | (1 << 3))   // implemented bits of mie/mip
+
+// Trap causes
+#define CAUSE_ILLEGAL_INSTR     2
+#define CAUSE_LOAD_MISALIGNED   4
+#define CAUSE_STORE_MISALIGNED  6
+
+// misa: rv32im(c)
+#ifdef EN_RVC
+#define MISA_VAL    ((1u << 30) | (1 << 12) | (1 << 8) | (1 << 2))
+#else
+#define MISA_VAL    ((1u << 30) | (1 << 12) | (1 << 8))
+#endif
+
+// sign extend lower n bits of x
+static inline int32_t sext(uint32_t x, unsigned n)
+{
+    return (int32_t)(x << (32 - n)) >> (32 - n);
+}
+
+
+ISS::ISS(uint32_t reset_vector):
+    reset_vector_(reset_vector)
+{
+    reset();
+}
+
+
+void ISS::add_region(Memory *m)
+{
+    Region_t r;
+    r.base = m->get_base_addr();
+    r.size = m->get_size();
+    r.data = m->get_data_ptr();
+    r.mem = m;
+    r.icache.resize((r.size + ICACHE_PAGE_SZ - 1) >> ICACHE_PAGE_SHIFT);
+    regions_.push_back(std::move(r));
+
+    // pointers into regions_ might have been invalidated
+    iregion_ = dregion_ = nullptr;
+    next_ = nullptr;
+}
+
+
+void ISS::reset()
+{
+    uint64_t instret_total = st_.instret_total;
+    st_ = ISS_state_t();
+    st_.instret_total = instret_total;
+    st_.pc = reset_vector_;
+    next_ = nullptr;
+
+    // fetch first instruction, so that it is visible in IR
+    if (!regions_.empty())
+    {
+        next_ = fetch(st_.pc);
+        next_pc_ = st_.pc;
+        st_.ir = next_->ir;
+        st_.ir_raw = next_->raw;
+    }
+}
+
+
+void ISS::flush_icache()
+{
+    for (auto &r: regions_)
+        for (auto &page: r.icache)
+            page.reset();
+    next_ = nullptr;
+}
+
+
+void ISS::set_pc(uint32_t pc)
+{
+    st_.pc = pc;
+    next_ = fetch(pc);
+    next_pc_ = pc;
+    st_.ir = next_->ir;
+    st_.ir_raw = next_->raw;
+}
+
+
+ISS::Region_t * ISS::find_region(uint32_t addr, uint32_t size)
+{
+    for (auto &r: regions_)
+    {
+        uint32_t off = addr - r.base;
+        if (off < r.size && size <= r.size - off)
+            return &r;
+    }
+    return nullptr;
+}
+
+
+const ISS_insn_t * ISS::fetch(uint32_t addr)
+{
+    Region_t *r = iregion_;
+    if (!r || (addr - r->base) >= r->size)
+    {
+        r = find_region(addr, 2);
+        if (!r)
+        {
+            char buf[80];
+            sprintf(buf, "iss: instruction fetch failed: no mem block at given address (0x%08x)", addr);
+            throw Atomsim_exception(buf);
+        }
+        iregion_ = r;
+    }
+
+    uint32_t off = addr - r->base;
+    std::unique_ptr<ISS_insn_t[]> &page = r->icache[off >> ICACHE_PAGE_SHIFT];
+    if (!page)
+        page.reset(new ISS_insn_t[ICACHE_PAGE_SZ/2]);
+
+    ISS_insn_t &insn = page[(off & (ICACHE_PAGE_SZ-1)) >> 1];
+    if (insn.op == OP_UNDECODED)
+    {
+        uint16_t lo;
+        memcpy(&lo, r->data + off, 2);
+        bool compressed = (lo & 0b11) != 0b11;
+        #ifndef EN_RVC
+        compressed = false;     // AtomRV decodes the whole word, 16-bit encodings are illegal
+        #endif
+        if (compressed)
+        {
+            // expanded by the same table as used by the disassembler (0: 
+            // illegal, decoded as is like AtomRV does)
+            uint32_t exp = rvExpandCompressed(lo);
+            decode(exp ? exp : lo, insn);
+            insn.len = 2;
+            insn.raw = lo;
+        }
+        else
+        {
+            if (r->size - off < 4)
+            {
+                char buf[80];
+                sprintf(buf, "iss: instruction fetch failed: no mem block at given address (0x%08x)", addr+2);
+                throw Atomsim_exception(buf);
+            }
+            uint32_t raw;
+            memcpy(&raw, r->data + off, 4);
+            decode(raw, insn);
+        }
+    }
+    return &insn;
+}
+
+
+void ISS::decode(uint32_t raw, ISS_insn_t &insn)
+{
+    uint32_t opcode = raw & 0x7f;
+    uint32_t func3 = (raw >> 12) & 0x7;
+    uint32_t func7 = raw >> 25;
+
+    insn.ir = raw;
+    insn.raw = raw;
+    insn.len = 4;
+    insn.rd  = (raw >> 7) & 0x1f;
+    insn.rs1 = (raw >> 15) & 0x1f;
+    insn.rs2 = (raw >> 20) & 0x1f;
+    insn.imm = 0;
+    insn.op = OP_ILLEGAL;
+
+    static const ISS_op_t branch_ops[8] = {OP_BEQ, OP_BNE, OP_ILLEGAL, OP_ILLEGAL, OP_BLT, OP_BGE, OP_BLTU, OP_BGEU};
+    static const ISS_op_t load_ops[8] = {OP_LB, OP_LH, OP_LW, OP_ILLEGAL, OP_LBU, OP_LHU, OP_ILLEGAL, OP_ILLEGAL};
+    static const ISS_op_t store_ops[8] = {OP_SB, OP_SH, OP_SW, OP_ILLEGAL, OP_ILLEGAL, OP_ILLEGAL, OP_ILLEGAL, OP_ILLEGAL};
+    static const ISS_op_t opimm_ops[8] = {OP_ADDI, OP_SLLI, OP_SLTI, OP_SLTIU, OP_XORI, OP_SRLI, OP_ORI, OP_ANDI};
+    static const ISS_op_t op_ops[8] = {OP_ADD, OP_SLL, OP_SLT, OP_SLTU, OP_XOR, OP_SRL, OP_OR, OP_AND};
+    static const ISS_op_t mul_ops[8] = {OP_MUL, OP_MULH, OP_MULHSU, OP_MULHU, OP_DIV, OP_DIVU, OP_REM, OP_REMU};
+    static const ISS_op_t csr_ops[8] = {OP_ILLEGAL, OP_CSRRW, OP_CSRRS, OP_CSRRC, OP_ILLEGAL, OP_CSRRWI, OP_CSRRSI, OP_CSRRCI};
+
+    switch (opcode)
+    {
+        case 0b0110111: // LUI
+            insn.op = OP_LUI;
+            insn.imm = raw & 0xfffff000;
+            break;
+
+        case 0b0010111: // AUIPC
+            insn.op = OP_AUIPC;
+            insn.imm = raw & 0xfffff000;
+            break;
+
+        case 0b1101111: // JAL
+            insn.op = OP_JAL;
+            insn.imm = sext(((raw >> 31) << 20) | (((raw >> 12) & 0xff) << 12) | (((raw >> 20) & 1) << 11) | (((raw >> 21) & 0x3ff) << 1), 21);
+            break;
+
+        case 0b1100111: // JALR
+            if (func3 == 0)
+            {
+                insn.op = OP_JALR;
+                insn.imm = (int32_t)raw >> 20;
+            }
+            break;
+
+        case 0b1100011: // Branches
+            insn.op = branch_ops[func3];
+            insn.imm = sext(((raw >> 31) << 12) | (((raw >> 7) & 1) << 11) | (((raw >> 25) & 0x3f) << 5) | (((raw >> 8) & 0xf) << 1), 13);
+            break;
+
+        case 0b0000011: // Loads
+            insn.op = load_ops[func3];
+            insn.imm = (int32_t)raw >> 20;
+            break;
+
+        case 0b0100011: // Stores
+            insn.op = store_ops[func3];
+            insn.imm = ((int32_t)raw >> 25 << 5) | ((raw >> 7) & 0x1f);
+            break;
+
+        case 0b0010011: // OP-IMM
+            insn.op = opimm_ops[func3];
+            insn.imm = (int32_t)raw >> 20;
+            if (func3 == 0b001)         // SLLI
+            {
+                insn.imm = insn.rs2;
+                if (func7 != 0)
+                    insn.op = OP_ILLEGAL;
+            }
+            else if (func3 == 0b101)    // SRLI/SRAI
+            {
+                insn.imm = insn.rs2;
+                if (func7 == 0b0100000)
+                    insn.op = OP_SRAI;
+                else if (func7 != 0)
+                    insn.op = OP_ILLEGAL;
+            }
+            break;
+
+        case 0b0110011: // OP
+            if (func7 == 0)
+                insn.op = op_ops[func3];
+            else if (func7 == 0b0000001)
+                insn.op = mul_ops[func3];
+            else if (func7 == 0b0100000 && func3 == 0b000)
+                insn.op = OP_SUB;
+            else if (func7 == 0b0100000 && func3 == 0b101)
+                insn.op = OP_SRA;
+            break;
+
+        case 0b0001111: // FENCE, FENCE.I
+            insn.op = OP_FENCE;
+            break;
+
+        case 0b1110011: // SYSTEM
+            if (raw == 0x00000073)
+                insn.op = OP_ECALL;
+            else if (raw == 0x00100073)
+                insn.op = OP_EBREAK;
+            else if (raw == 0x30200073)
+                insn.op = OP_MRET;
+            else if (raw == 0x10500073)
+                insn.op = OP_WFI;
+            else
+            {
+                insn.op = csr_ops[func3];
+                insn.imm = raw >> 20;   // csr address
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+uint32_t ISS::load(uint32_t addr, uint32_t size)
+{
+    Region_t *r = dregion_;
+    if (!r || (addr - r->base) > (r->size - size))
+    {
+        r = find_region(addr, size);
+        if (!r)
+        {
+            // forward to mmio handler
+            uint32_t word;
+            if (mmio_load && mmio_load(addr & 0xfffffffc, word))
+                return (word >> ((addr & 0b11) * 8)) & (0xffffffffu >> ((4 - size) * 8));
+
+            char buf[80];
+            sprintf(buf, "iss: memory fetch failed: no mem block at given address (0x%08x)", addr);
+            throw Atomsim_exception(buf);
+        }
+        dregion_ = r;
+    }
+
+    uint32_t val = 0;
+    memcpy(&val, r->data + (addr - r->base), size);
+    return val;
+}
+
+
+void ISS::store(uint32_t addr, uint32_t data, uint32_t size)
+{
+    last_store.valid = true;
+    last_store.addr = addr & 0xfffffffc;
+    last_store.data = data << ((addr & 0b11) * 8);
+    last_store.sel = ((1 << size) - 1) << (addr & 0b11);
+
+    Region_t *r = dregion_;
+    if (!r || (addr - r->base) > (r->size - size))
+    {
+        r = find_region(addr, size);
+        if (!r)
+        {
+            // forward to mmio handler
+            if (mmio_store && mmio_store(last_store.addr, last_store.data, last_store.sel))
+                return;
+
+            char buf[80];
+            sprintf(buf, "iss: memory store failed: no mem block at given address (0x%08x)", addr);
+            throw Atomsim_exception(buf);
+        }
+        dregion_ = r;
+    }
+
+    if (r->mem->is_write_protected())
+    {
+        char buf[80];
+        sprintf(buf, "Attempted to store in a write-protected memory @ address [0x%08x]", addr);
+        throw Atomsim_exception(buf);
+    }
+
+    uint32_t off = addr - r->base;
+    memcpy(r->data + off, &data, size);
+
+    // invalidate pre-decoded instructions overlapping the stored bytes
+    uint32_t start = (off >= 2 ? off - 2 : 0) & ~1u;
+    for (uint32_t o = start; o < off + size; o += 2)
+    {
+        std::unique_ptr<ISS_insn_t[]> &page = r->icache[o >> ICACHE_PAGE_SHIFT];
+        if (page)
+            page[(o & (ICACHE_PAGE_SZ-1)) >> 1].op = OP_UNDECODED;
+    }
+}
+
+
+uint32_t ISS::csr_rw(uint32_t addr, uint32_t op, uint32_t val)
+{
+    uint64_t cycles = st_.instret;  // one instruction per cycle
+    uint32_t old = 0;
+    switch (addr)
+    {
+        case CSR_cycle:     case CSR_mcycle:    old = (uint32_t)cycles; break;
+        case CSR_cycleh:    case CSR_mcycleh:   old = (uint32_t)(cycles >> 32); break;
+        case CSR_instret:   case CSR_minstret:  old = (uint32_t)st_.instret; break;
+        case CSR_instreth:  case CSR_minstreth: old = (uint32_t)(st_.instret >> 32); break;
+        case CSR_misa:      old = MISA_VAL; break;
+        case CSR_mstatus:   old = st_.mstatus; break;
+        case CSR_mie:       old = st_.mie; break;
+        case CSR_mip:       old = st_.mip; break;
+        case CSR_mtvec:     old = st_.mtvec; break;
+        case CSR_mscratch:  old = st_.mscratch; break;
+        case CSR_mepc:      old = st_.mepc; break;
+        case CSR_mcause:    old = st_.mcause; break;
+        case CSR_mtval:     old = st_.mtval; break;
+        default:            old = 0; break;     // mvendorid, marchid, mimpid, mhartid, time etc.
+    }
+
+    uint32_t newval;
+    switch (op)
+    {
+        case 0b01:  newval = val; break;            // CSRRW
+        case 0b10:  newval = old | val; break;      // CSRRS
+        case 0b11:  newval = old & ~val; break;     // CSRRC
+        default:    newval = old; break;
+    }
+
+    // like AtomRV, CSRs are written even if rs1 = x0
+    switch (addr)
+    {
+        case CSR_mstatus:   st_.mstatus = newval & MSTATUS_MIE; break;
+        case CSR_mie:       st_.mie = newval & MIX_MASK; break;
+        case CSR_mip:       st_.mip = newval & MIX_MASK; break;
+        case CSR_mtvec:     st_.mtvec = newval; break;
+        case CSR_mscratch:  st_.mscratch = newval; break;
+        case CSR_mepc:      st_.mepc = newval & ~1u; break;
+        default:            break;  // read-only
+    }
+    return old;
+}
+
+
+bool ISS::trap(uint32_t cause, uint32_t epc, uint32_t &npc)
+{
+    // AtomRV only takes exceptions if interrupts are globally enabled
+    if (!(st_.mstatus & MSTATUS_MIE))
+        return false;
+
+    st_.mepc = epc;
+    st_.mcause = cause;
+
+    uint32_t base = st_.mtvec & ~0b11u;
+    npc = ((st_.mtvec & 0b11) == 0b01) ? base + 4 * cause : base;
+    return true;
+}
+
+
+void ISS::step()
+{
+    const ISS_insn_t *in = (next_ && next_pc_ == st_.pc) ? next_ : fetch(st_.pc);
+    uint32_t *x = st_.x;
+    const uint32_t pc = st_.pc;
+    uint32_t npc = pc + in->len;
+
+    const uint32_t rs1 = x[in->rs1];
+    const uint32_t rs2 = x[in->rs2];
+    const uint32_t imm = (uint32_t)in->imm;
+    uint32_t addr;
+
+    switch (in->op)
+    {
+        case OP_LUI:    x[in->rd] = imm; break;
+        case OP_AUIPC:  x[in->rd] = pc + imm; break;
+        case OP_JAL:    x[in->rd] = npc; npc = pc + imm; break;
+        case OP_JALR:   x[in->rd] = npc; npc = (rs1 + imm) & ~1u; break;
+
+        case OP_BEQ:    if (rs1 == rs2) npc = pc + imm; break;
+        case OP_BNE:    if (rs1 != rs2) npc = pc + imm; break;
+        case OP_BLT:    if ((int32_t)rs1 < (int32_t)rs2) npc = pc + imm; break;
+        case OP_BGE:    if ((int32_t)rs1 >= (int32_t)rs2) npc = pc + imm; break;
+        case OP_BLTU:   if (rs1 < rs2) npc = pc + imm; break;
+        case OP_BGEU:   if (rs1 >= rs2) npc = pc + imm; break;
+
+        // misaligned accesses trap if exceptions are enabled, otherwise (like AtomRV)
+        // they access the naturally aligned location
+        case OP_LB:     x[in->rd] = (int32_t)(int8_t)load(rs1 + imm, 1); break;
+        case OP_LBU:    x[in->rd] = load(rs1 + imm, 1); break;
+        case OP_LH:
+        case OP_LHU:
+            addr = rs1 + imm;
+            if ((addr & 1) && trap(CAUSE_LOAD_MISALIGNED, pc, npc))
+                break;
+            x[in->rd] = load(addr & ~1u, 2);
+            if (in->op == OP_LH)
+                x[in->rd] = (int32_t)(int16_t)x[in->rd];
+            break;
+        case OP_LW:
+            addr = rs1 + imm;
+            if ((addr & 3) && trap(CAUSE_LOAD_MISALIGNED, pc, npc))
+                break;
+            x[in->rd] = load(addr & ~3u, 4);
+            break;
+
+        case OP_SB:     store(rs1 + imm, rs2 & 0xff, 1); break;
+        case OP_SH:
+            addr = rs1 + imm;
+            if ((addr & 1) && trap(CAUSE_STORE_MISALIGNED, pc, npc))
+                break;
+            store(addr & ~1u, rs2 & 0xffff, 2);
+            break;
+        case OP_SW:
+            addr = rs1 + imm;
+            if ((addr & 3) && trap(CAUSE_STORE_MISALIGNED, pc, npc))
+                break;
+            store(addr & ~3u, rs2, 4);
+            break;
+
+        case OP_ADDI:   x[in->rd] = rs1 + imm; break;
+        case OP_SLTI:   x[in->rd] = (int32_t)rs1 < (int32_t)imm; break;
+        case OP_SLTIU:  x[in->rd] = rs1 < imm; break;
+        case OP_XORI:   x[in->rd] = rs1 ^ imm; break;
+        case OP_ORI:    x[in->rd] = rs1 | imm; break;
+        case OP_ANDI:   x[in->rd] = rs1 & imm; break;
+        case OP_SLLI:   x[in->rd] = rs1 << imm; break;
+        case OP_SRLI:   x[in->rd] = rs1 >> imm; break;
+        case OP_SRAI:   x[in->rd] = (int32_t)rs1 >> imm; break;
+
+        case OP_ADD:    x[in->rd] = rs1 + rs2; break;
+        case OP_SUB:    x[in->rd] = rs1 - rs2; break;
+        case OP_SLL:    x[in->rd] = rs1 << (rs2 & 0x1f); break;
+        case OP_SLT:    x[in->rd] = (int32_t)rs1 < (int32_t)rs2; break;
+        case OP_SLTU:   x[in->rd] = rs1 < rs2; break;
+        case OP_XOR:    x[in->rd] = rs1 ^ rs2; break;
+        case OP_SRL:    x[in->rd] = rs1 >> (rs2 & 0x1f); break;
+        case OP_SRA:    x[in->rd] = (int32_t)rs1 >> (rs2 & 0x1f); break;
+        case OP_OR:     x[in->rd] = rs1 | rs2; break;
+        case OP_AND:    x[in->rd] = rs1 & rs2; break;
+
+        case OP_MUL:    x[in->rd] = rs1 * rs2; break;
+        case OP_MULH:   x[in->rd] = (uint32_t)(((int64_t)(int32_t)rs1 * (int64_t)(int32_t)rs2) >> 32); break;
+        case OP_MULHSU: x[in->rd] = (uint32_t)(((int64_t)(int32_t)rs1 * (int64_t)(uint64_t)rs2) >> 32); break;
+        case OP_MULHU:  x[in->rd] = (uint32_t)(((uint64_t)rs1 * (uint64_t)rs2) >> 32); break;
+        case OP_DIV:
+            if (rs2 == 0)                                       x[in->rd] = 0xffffffff;
+            else if (rs1 == 0x80000000 && rs2 == 0xffffffff)    x[in->rd] = rs1;
+            else                                                x[in->rd] = (int32_t)rs1 / (int32_t)rs2;
+            break;
+        case OP_DIVU:   x[in->rd] = (rs2 == 0) ? 0xffffffff : rs1 / rs2; break;
+        case OP_REM:
+            if (rs2 == 0)                                       x[in->rd] = rs1;
+            else if (rs1 == 0x80000000 && rs2 == 0xffffffff)    x[in->rd] = 0;
+            else                                                x[in->rd] = (int32_t)rs1 % (int32_t)rs2;
+            break;
+        case OP_REMU:   x[in->rd] = (rs2 == 0) ? rs1 : rs1 % rs2; break;
+
+        case OP_FENCE:  break;
+        case OP_WFI:    break;  // no interrupt sources are modelled
+
+        case OP_CSRRW:  x[in->rd] = csr_rw(imm, 0b01, rs1); break;
+        case OP_CSRRS:  x[in->rd] = csr_rw(imm, 0b10, rs1); break;
+        case OP_CSRRC:  x[in->rd] = csr_rw(imm, 0b11, rs1); break;
+        case OP_CSRRWI: x[in->rd] = csr_rw(imm, 0b01, in->rs1); break;
+        case OP_CSRRSI: x[in->rd] = csr_rw(imm, 0b10, in->rs1); break;
+        case OP_CSRRCI: x[in->rd] = csr_rw(imm, 0b11, in->rs1); break;
+
+        case OP_MRET:   npc = st_.mepc; break;
+
+        case OP_ECALL:
+        case OP_EBREAK:
+        case OP_ILLEGAL:
+        default:
+            trap(CAUSE_ILLEGAL_INSTR, pc, npc);
+            break;
+    }
+    x[0] = 0;
+
+    st_.pc = npc;
+    st_.instret++;
+    st_.instret_total++;
+
+    // pre-fetch next instruction, so that it is visible in IR
+    // (fast path: next sequential instruction is already decoded, in the same page)
+    const ISS_insn_t *seq = in + (in->len >> 1);
+    if (npc == pc + in->len && ((pc - iregion_->base) & (ICACHE_PAGE_SZ-1)) + in->len < ICACHE_PAGE_SZ && seq->op != OP_UNDECODED)
+        next_ = seq;
+    else
+        next_ = fetch(npc);
+    next_pc_ = npc;
+    st_.ir = next_->ir;
+    st_.ir_raw = next_->raw;
+}
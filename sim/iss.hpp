@@ -0,0 +1,265 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+class Memory;
+
+/**
+ * @brief Decoded instruction operations
+ * @note Compressed instructions are expanded into their 32-bit equivalents
+ * while decoding
+ */
+enum ISS_op_t : uint8_t {
+    OP_UNDECODED = 0,
+    OP_LUI, OP_AUIPC, OP_JAL, OP_JALR,
+    OP_BEQ, OP_BNE, OP_BLT, OP_BGE, OP_BLTU, OP_BGEU,
+    OP_LB, OP_LH, OP_LW, OP_LBU, OP_LHU,
+    OP_SB, OP_SH, OP_SW,
+    OP_ADDI, OP_SLTI, OP_SLTIU, OP_XORI, OP_ORI, OP_ANDI, OP_SLLI, OP_SRLI, OP_SRAI,
+    OP_ADD, OP_SUB, OP_SLL, OP_SLT, OP_SLTU, OP_XOR, OP_SRL, OP_SRA, OP_OR, OP_AND,
+    OP_MUL, OP_MULH, OP_MULHSU, OP_MULHU, OP_DIV, OP_DIVU, OP_REM, OP_REMU,
+    OP_FENCE,
+    OP_CSRRW, OP_CSRRS, OP_CSRRC, OP_CSRRWI, OP_CSRRSI, OP_CSRRCI,
+    OP_MRET, OP_WFI, OP_ECALL, OP_EBREAK,
+    OP_ILLEGAL
+};
+
+/**
+ * @brief Pre-decoded instruction
+ */
+struct ISS_insn_t {
+    ISS_op_t op = OP_UNDECODED;
+    uint8_t rd = 0;
+    uint8_t rs1 = 0;
+    uint8_t rs2 = 0;
+    int32_t imm = 0;
+    uint32_t ir = 0;        // instruction (compressed ones expanded, as in IR of AtomRV)
+    uint32_t raw = 0;       // instruction encoding as fetched (16-bit if compressed)
+    uint32_t len = 0;       // instruction length (2/4)
+};
+
+/**
+ * @brief Architectural state of ISS
+ * @note only a subset of CSRs is implemented, mirroring the CSR unit of AtomRV
+ */
+struct ISS_state_t {
+    uint32_t pc = 0;        // address of next instruction to be executed
+    uint32_t ir = 0;        // next instruction to be executed (compressed ones expanded, as in IR of AtomRV)
+    uint32_t ir_raw = 0;    // encoding of next instruction as fetched (16-bit if compressed)
+    uint32_t x[32] = {0};   // register file
+
+    // CSRs
+    uint32_t mstatus = 0;
+    uint32_t mie = 0;
+    uint32_t mip = 0;
+    uint32_t mtvec = 0;
+    uint32_t mscratch = 0;
+    uint32_t mepc = 0;
+    uint32_t mcause = 0;
+    uint32_t mtval = 0;
+
+    uint64_t instret = 0;       // instructions retired since last reset
+    uint64_t instret_total = 0; // instructions retired in total
+};
+
+/**
+ * @brief Store made by ISS, in the form seen on dport of AtomRV
+ */
+struct ISS_store_t {
+    bool valid = false;
+    uint32_t addr = 0;      // word aligned address
+    uint32_t data = 0;      // data (shifted to byte lane)
+    uint8_t sel = 0;        // byte enables
+};
+
+
+/**
+ * @brief Functional RV32IM(C)_Zicsr instruction set simulator (compressed
+ * instructions are only decoded if built with EN_RVC, like AtomRV)
+ * @details Executes one instruction per tick without modelling the pipeline.
+ * Instructions are decoded once into a lazily allocated cache of pre-decoded
+ * instructions (one entry per halfword of memory), which is invalidated on
+ * stores to code. Memories are accessed directly through their backing
+ * arrays; accesses which don't hit any memory region are forwarded to mmio
+ * handlers (word aligned, like the dport of AtomRV).
+ *
+ * Trap behaviour mirrors AtomRV: exceptions are only taken if mstatus.MIE is
+ * set (otherwise the faulting instruction is skipped), ecall/ebreak are
+ * treated as illegal instructions, and wfi is a nop.
+ */
+class ISS
+{
+public:
+    /**
+     * @brief Construct a new ISS object
+     * @param reset_vector reset address
+     */
+    ISS(uint32_t reset_vector);
+
+    /**
+     * @brief Add a memory region
+     * @param m memory
+     */
+    void add_region(Memory *m);
+
+    /**
+     * @brief Handler for word aligned mmio reads; returns false if address
+     * is not handled
+     */
+    std::function<bool(uint32_t addr, uint32_t &data)> mmio_load;
+
+    /**
+     * @brief Handler for word aligned mmio writes (sel: byte enables);
+     * returns false if address is not handled
+     */
+    std::function<bool(uint32_t addr, uint32_t data, uint8_t sel)> mmio_store;
+
+    /**
+     * @brief Last store made by ISS
+     * @note valid flag is set on every store, but never cleared by ISS 
+     * (used by lockstep mode to compare stores against RTL)
+     */
+    ISS_store_t last_store;
+
+    /**
+     * @brief Reset ISS state
+     */
+    void reset();
+
+    /**
+     * @brief Execute one instruction
+     */
+    void step();
+
+    /**
+     * @brief Execute up to n instructions
+     * @details Stops early if stop() returns true
+     *
+     * @param n maximum number of instructions
+     * @param stop callable invoked after every instruction; returns true to stop
+     * @return uint64_t number of instructions executed
+     */
+    template <class StopFn>
+    uint64_t run(uint64_t n, StopFn stop);
+
+    /**
+     * @brief Invalidate all pre-decoded instructions
+     * @details needs to be called if memory is modified externally
+     */
+    void flush_icache();
+
+    /**
+     * @brief Set address of next instruction to be executed
+     * @details updates IR; used when state is transferred from another model
+     * @param pc address
+     */
+    void set_pc(uint32_t pc);
+
+    /**
+     * @brief Get architectural state
+     * @return ISS_state_t& state
+     */
+    ISS_state_t & state()   { return st_; }
+
+private:
+    /**
+     * @brief Memory region accessible by ISS
+     */
+    struct Region_t {
+        uint32_t base;
+        uint32_t size;
+        uint8_t *data;
+        Memory *mem;
+        std::vector<std::unique_ptr<ISS_insn_t[]>> icache;  // pre-decoded instructions (per page)
+    };
+
+    /**
+     * @brief Architectural state
+     */
+    ISS_state_t st_;
+
+    /**
+     * @brief Reset vector
+     */
+    uint32_t reset_vector_;
+
+    /**
+     * @brief Memory regions
+     */
+    std::vector<Region_t> regions_;
+
+    /**
+     * @brief Last region used for instruction fetch & data access
+     */
+    Region_t *iregion_ = nullptr;
+    Region_t *dregion_ = nullptr;
+
+    /**
+     * @brief Next instruction to be executed & its address
+     */
+    const ISS_insn_t *next_ = nullptr;
+    uint32_t next_pc_ = 0;
+
+    /**
+     * @brief Find region containing given block
+     * @return Region_t* region (nullptr if none)
+     */
+    Region_t * find_region(uint32_t addr, uint32_t size);
+
+    /**
+     * @brief Get pre-decoded instruction at given address
+     */
+    const ISS_insn_t * fetch(uint32_t addr);
+
+    /**
+     * @brief Decode an instruction
+     */
+    static void decode(uint32_t raw, ISS_insn_t &insn);
+
+    /**
+     * @brief Load from memory
+     * @return uint32_t value (zero extended)
+     */
+    uint32_t load(uint32_t addr, uint32_t size);
+
+    /**
+     * @brief Store to memory
+     */
+    void store(uint32_t addr, uint32_t data, uint32_t size);
+
+    /**
+     * @brief Read/modify/write a CSR
+     * @return uint32_t old value
+     */
+    uint32_t csr_rw(uint32_t addr, uint32_t op, uint32_t val);
+
+    /**
+     * @brief Take a trap if exceptions are enabled
+     * 
+     * @param cause trap cause
+     * @param epc address of faulting instruction
+     * @param npc next pc; set to trap handler address if trap is taken
+     * @return true if trap is taken
+     */
+    bool trap(uint32_t cause, uint32_t epc, uint32_t &npc);
+};
+
+
+template <class StopFn>
+uint64_t ISS::run(uint64_t n, StopFn stop)
+{
+    uint64_t i = 0;
+    while(i < n)
+    {
+        step();
+        i++;
+
+        if(stop())
+            break;
+    }
+    return i;
+}
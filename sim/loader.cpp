@@ -0,0 +1,404 @@
+#include "loader.hpp"
+#include "memory.hpp"
+#include "except.hpp"
+#include "util.hpp"
+
+#include <ctype.h>
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+
+MappedFile::MappedFile(const std::string &filepath)
+{
+    int fd = open(filepath.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw Atomsim_exception("file access failed: "+filepath+" ("+strerror(errno)+")");
+
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+    {
+        close(fd);
+        throw Atomsim_exception("file access failed: "+filepath+" ("+strerror(errno)+")");
+    }
+    size_ = st.st_size;
+
+    if(size_ > 0)   // can't map an empty file
+    {
+        void *p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p == MAP_FAILED)
+        {
+            close(fd);
+            throw Atomsim_exception("file mapping failed: "+filepath+" ("+strerror(errno)+")");
+        }
+        data_ = (const uint8_t *) p;
+    }
+    close(fd);  // mapping stays valid
+}
+
+
+MappedFile::~MappedFile()
+{
+    if(data_)
+        munmap((void *)data_, size_);
+}
+
+
+ElfImage::ElfImage(const std::string &filepath):
+    file_(filepath)
+{
+    const uint8_t *base = file_.data();
+    const size_t size = file_.size();
+
+    Elf32_Ehdr eh;
+    if(size < sizeof(eh) || memcmp(base, ELFMAG, SELFMAG) != 0)
+        throwError("INIT0", "Can't find or process ELF file : " + filepath + "\n", true);
+    memcpy(&eh, base, sizeof(eh));
+
+    // Check ELF Class, Endiness & segment count
+    if(eh.e_ident[EI_CLASS] != ELFCLASS32)
+        throwError("INIT1", "Elf file format invalid: should be 32-bit elf\n", true);
+    if(eh.e_ident[EI_DATA] != ELFDATA2LSB)
+        throwError("INIT2", "Elf file format invalid: should be little Endian\n", true);
+    if(eh.e_phnum == 0)
+        throwError("INIT3", "Elf file format invalid: should consist of atleast one section\n", true);
+    if(eh.e_phentsize < sizeof(Elf32_Phdr) || eh.e_phoff > size || (size - eh.e_phoff) / eh.e_phentsize < eh.e_phnum)
+        throwError("INIT4", "Elf file format invalid: program headers out of bounds\n", true);
+
+    entry_ = eh.e_entry;
+
+    for (unsigned i = 0; i < eh.e_phnum; i++)
+    {
+        Elf32_Phdr ph;
+        memcpy(&ph, base + eh.e_phoff + i * eh.e_phentsize, sizeof(ph));
+        if(ph.p_type != PT_LOAD)
+            continue;
+
+        if(ph.p_offset > size || ph.p_filesz > size - ph.p_offset       // contents in file
+            || ph.p_filesz > ph.p_memsz                                 // contents fit in segment
+            || (ph.p_memsz != 0 && ph.p_paddr + (ph.p_memsz - 1) < ph.p_paddr))  // doesn't wrap around
+        {
+            throwError("INIT4", "Elf file format invalid: segment "+std::to_string(i)+" out of bounds\n", true);
+        }
+
+        segments_.push_back({
+            .addr = ph.p_paddr,
+            .filesz = ph.p_filesz,
+            .memsz = ph.p_memsz,
+            .flags = ph.p_flags,
+            .data = base + ph.p_offset
+        });
+    }
+}
+
+
+unsigned init_from_elf(Memory * m, std::string filepath, std::vector<int> flag_signatures)
+{
+    if(!m)
+        throw Atomsim_exception("Can't initialize memory; mem pointer == null");
+
+    ElfImage elf(filepath);
+
+    const std::vector<ElfSegment_t> &segs = elf.get_segments();
+    for (unsigned i = 0; i < segs.size(); i++)
+    {
+        const ElfSegment_t &seg = segs[i];
+        if(seg.filesz == 0 || flag_signatures.end() == std::find(flag_signatures.begin(), flag_signatures.end(), (int)seg.flags))
+            continue;
+
+        // load only segments which lie in this memory
+        if(m->block_in_range(seg.addr, seg.filesz))
+        {
+            printf("Loading segment %d [base=0x%08x, sz=% 6d bytes, at=0x%08x] ...\t", i, seg.addr, seg.filesz, seg.addr);
+            m->store(seg.addr, (uint8_t *)seg.data, seg.filesz);
+            printf("done\n");
+        }
+    }
+    return elf.get_entry();
+}
+
+
+void init_from_bin(Memory * m, std::string filepath) {
+    if(!m) {
+        throw Atomsim_exception("Can't initialize memory; mem pointer == null");
+    }
+
+    MappedFile f(filepath);
+
+    printf("Loading %ld bytes at 0x%08x from %s\n", f.size(), m->get_base_addr(), filepath.c_str());
+    m->store(m->get_base_addr(), (uint8_t *)f.data(), f.size());
+}
+
+
+namespace {
+
+/**
+ * @brief Iterates over lines of a mapped text file (stripped of surrounding
+ * whitespace)
+ */
+class LineReader
+{
+public:
+    LineReader(const MappedFile &f): p_(f.data()), end_(f.data() + f.size()) {}
+
+    bool next(const uint8_t *&line, size_t &len)
+    {
+        if(p_ >= end_)
+            return false;
+
+        const uint8_t *nl = (const uint8_t *) memchr(p_, '\n', end_ - p_);
+        const uint8_t *e = nl ? nl : end_;
+        line = p_;
+        p_ = nl ? nl + 1 : end_;
+        lineno_++;
+
+        while(line < e && isspace(*line))
+            line++;
+        while(e > line && isspace(e[-1]))
+            e--;
+        len = e - line;
+        return true;
+    }
+
+    unsigned lineno()   { return lineno_; }
+
+private:
+    const uint8_t *p_;
+    const uint8_t *end_;
+    unsigned lineno_ = 0;
+};
+
+
+/**
+ * @brief Parse hex digits
+ * @return false if a non hex digit is found
+ */
+inline bool parse_hex(const uint8_t *s, unsigned ndigits, uint32_t &val)
+{
+    val = 0;
+    for (unsigned i = 0; i < ndigits; i++)
+    {
+        uint8_t c = s[i];
+        uint32_t d;
+        if(c >= '0' && c <= '9')
+            d = c - '0';
+        else if((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+            d = (c | 0x20) - 'a' + 10;
+        else
+            return false;
+        val = (val << 4) | d;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Collects data records & stores contiguous runs to memory in bulk
+ */
+class RecordWriter
+{
+public:
+    RecordWriter(Memory *m, const std::string &filepath): m_(m), filepath_(filepath) {}
+
+    void put(uint32_t addr, const uint8_t *data, size_t n)
+    {
+        if(addr != addr_ + (uint32_t)buf_.size())
+        {
+            flush();
+            addr_ = addr;
+        }
+        buf_.insert(buf_.end(), data, data + n);
+    }
+
+    void flush()
+    {
+        if(buf_.empty())
+            return;
+        if(!m_->block_in_range(addr_, buf_.size()))
+        {
+            char except_buf[100];
+            sprintf(except_buf, "record at 0x%08x (%lu bytes) outside memory", addr_, buf_.size());
+            throw Atomsim_exception("file:"+filepath_+": "+except_buf);
+        }
+        m_->store(addr_, buf_.data(), buf_.size());
+        nbytes_ += buf_.size();
+        buf_.clear();
+    }
+
+    size_t nbytes() { return nbytes_; }
+
+private:
+    Memory *m_;
+    const std::string &filepath_;
+    uint32_t addr_ = 0;
+    std::vector<uint8_t> buf_;
+    size_t nbytes_ = 0;
+};
+
+} // namespace
+
+
+void init_from_hex(Memory * m, std::string filepath) {
+    if(!m) {
+        throw Atomsim_exception("Can't initialize memory; mem pointer == null");
+    }
+
+    MappedFile f(filepath);
+    LineReader lr(f);
+    std::vector<uint8_t> img;
+    img.reserve(f.size() / 2);
+
+    // parse
+    const uint8_t *line;
+    size_t len;
+    while(lr.next(line, len)) {
+        if (len == 0)
+            continue;
+
+        uint32_t word;
+        if (len != 8 || !parse_hex(line, 8, word))
+            throw Atomsim_exception("file:"+filepath+":"+std::to_string(lr.lineno())+" Invalid hex format");
+
+        for (int b = 0; b < 4; b++)     // little endian
+            img.push_back((uint8_t)(word >> (8*b)));
+    }
+
+    printf("Loading %ld bytes at 0x%08x from %s\n", img.size(), m->get_base_addr(), filepath.c_str());
+    m->store(m->get_base_addr(), img.data(), img.size());
+}
+
+
+void init_from_ihex(Memory * m, std::string filepath) {
+    if(!m) {
+        throw Atomsim_exception("Can't initialize memory; mem pointer == null");
+    }
+
+    MappedFile f(filepath);
+    LineReader lr(f);
+    RecordWriter wr(m, filepath);
+    uint32_t base = 0;      // from extended segment/linear address records
+    uint8_t rec[256+5];
+
+    const uint8_t *line;
+    size_t len;
+    while(lr.next(line, len)) {
+        if (len == 0)
+            continue;
+
+        // :LLAAAATT<data>CC
+        size_t nrec = (len - 1) / 2;
+        bool ok = len >= 11 && line[0] == ':' && (len % 2) == 1 && nrec <= sizeof(rec);
+        uint8_t sum = 0;
+        for (size_t i = 0; ok && i < nrec; i++) {
+            uint32_t b;
+            ok = parse_hex(line + 1 + 2*i, 2, b);
+            rec[i] = b;
+            sum += b;
+        }
+        if (!ok || nrec != rec[0] + 5u || sum != 0)
+            throw Atomsim_exception("file:"+filepath+":"+std::to_string(lr.lineno())+" Invalid Intel HEX record");
+
+        uint32_t addr = (rec[1] << 8) | rec[2];
+        uint8_t type = rec[3];
+        const uint8_t *data = &rec[4];
+
+        if (type == 0x00)                                   // data
+            wr.put(base + addr, data, rec[0]);
+        else if (type == 0x01)                              // end of file
+            break;
+        else if (type == 0x02 && rec[0] == 2)               // extended segment address
+            base = ((data[0] << 8) | data[1]) << 4;
+        else if (type == 0x04 && rec[0] == 2)               // extended linear address
+            base = ((data[0] << 8) | data[1]) << 16;
+        else if (type != 0x03 && type != 0x05)              // start address records are ignored
+            throw Atomsim_exception("file:"+filepath+":"+std::to_string(lr.lineno())+" Invalid Intel HEX record");
+    }
+    wr.flush();
+
+    printf("Loaded %ld bytes from %s\n", wr.nbytes(), filepath.c_str());
+}
+
+
+void init_from_srec(Memory * m, std::string filepath) {
+    if(!m) {
+        throw Atomsim_exception("Can't initialize memory; mem pointer == null");
+    }
+
+    MappedFile f(filepath);
+    LineReader lr(f);
+    RecordWriter wr(m, filepath);
+    uint8_t rec[256];
+
+    const uint8_t *line;
+    size_t len;
+    while(lr.next(line, len)) {
+        if (len == 0)
+            continue;
+
+        // S<type><count><address><data><checksum>; count covers address, data & checksum
+        size_t nrec = (len - 2) / 2;
+        bool ok = len >= 10 && line[0] == 'S' && (len % 2) == 0 && nrec <= sizeof(rec);
+        uint8_t sum = 0;
+        for (size_t i = 0; ok && i < nrec; i++) {
+            uint32_t b;
+            ok = parse_hex(line + 2 + 2*i, 2, b);
+            rec[i] = b;
+            sum += b;
+        }
+        if (!ok || nrec != rec[0] + 1u || sum != 0xff)
+            throw Atomsim_exception("file:"+filepath+":"+std::to_string(lr.lineno())+" Invalid S-record");
+
+        unsigned addr_len;
+        switch (line[1]) {
+            case '1': addr_len = 2; break;
+            case '2': addr_len = 3; break;
+            case '3': addr_len = 4; break;
+            case '0': case '5': case '6':           // header & record counts
+            case '7': case '8': case '9': continue; // start address
+            default:
+                throw Atomsim_exception("file:"+filepath+":"+std::to_string(lr.lineno())+" Invalid S-record");
+        }
+        if (rec[0] < addr_len + 1)
+            throw Atomsim_exception("file:"+filepath+":"+std::to_string(lr.lineno())+" Invalid S-record");
+
+        uint32_t addr = 0;
+        for (unsigned i = 0; i < addr_len; i++)
+            addr = (addr << 8) | rec[1 + i];
+        wr.put(addr, &rec[1 + addr_len], rec[0] - addr_len - 1);
+    }
+    wr.flush();
+
+    printf("Loaded %ld bytes from %s\n", wr.nbytes(), filepath.c_str());
+}
+
+
+void init_from_imgfile(Memory * m, std::string filepath) {
+    size_t dot = filepath.rfind('.');
+    std::string ext = (dot == std::string::npos) ? "" : filepath.substr(dot);
+
+    if(ext == ".hex") {
+        // Intel HEX files are commonly named .hex too
+        MappedFile f(filepath);
+        const uint8_t *p = f.data(), *end = f.data() + f.size();
+        while(p < end && isspace(*p))
+            p++;
+        if(p < end && *p == ':')
+            init_from_ihex(m, filepath);
+        else
+            init_from_hex(m, filepath);
+    }
+    else if (ext == ".bin")
+        init_from_bin(m, filepath);
+    else if (ext == ".ihex" || ext == ".ihx")
+        init_from_ihex(m, filepath);
+    else if (ext == ".srec" || ext == ".s19" || ext == ".s28" || ext == ".s37" || ext == ".mot")
+        init_from_srec(m, filepath);
+    else
+        throw Atomsim_exception("invalid image-file format: "+filepath);
+}
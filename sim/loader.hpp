@@ -0,0 +1,153 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+class Memory;
+
+/**
+ * @brief Read-only memory mapping of a file
+ */
+class MappedFile
+{
+public:
+    /**
+     * @brief Map a file into memory
+     * @param filepath file path
+     * @throws Atomsim_exception if file can't be opened/mapped
+     */
+    MappedFile(const std::string &filepath);
+
+    /**
+     * @brief Unmap file
+     */
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+
+    /**
+     * @brief Get pointer to file contents
+     * @return const uint8_t*
+     */
+    const uint8_t * data() const    { return data_; }
+
+    /**
+     * @brief Get file size
+     * @return size_t
+     */
+    size_t size() const             { return size_; }
+
+private:
+    const uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+
+/**
+ * @brief Loadable (PT_LOAD) segment of an ELF file
+ */
+struct ElfSegment_t
+{
+    uint32_t addr;          // physical address
+    uint32_t filesz;        // bytes present in file
+    uint32_t memsz;         // bytes occupied in memory
+    uint32_t flags;         // PF_R | PF_W | PF_X
+    const uint8_t *data;    // segment contents (in mapped file)
+};
+
+
+/**
+ * @brief 32-bit little endian ELF file, mapped into memory
+ * @details Headers and program headers are validated on construction, so
+ * that segment contents can be copied straight from the mapping.
+ */
+class ElfImage
+{
+public:
+    /**
+     * @brief Map & validate an ELF file
+     * @param filepath file path
+     */
+    ElfImage(const std::string &filepath);
+
+    /**
+     * @brief Get entry point
+     * @return uint32_t
+     */
+    uint32_t get_entry()    { return entry_; }
+
+    /**
+     * @brief Get loadable segments (in program header order)
+     * @return const std::vector<ElfSegment_t>&
+     */
+    const std::vector<ElfSegment_t> & get_segments()  { return segments_; }
+
+private:
+    MappedFile file_;
+    uint32_t entry_ = 0;
+    std::vector<ElfSegment_t> segments_;
+};
+
+
+/**
+ * @brief Initialize a memory from an elf file
+ * @details Each loadable segment with matching flags that lies in the memory
+ * is copied to it in a single bulk store.
+ *
+ * @param m memory ptr
+ * @param filepath elf file path
+ * @param flag_signatures segment flags to load
+ * @return unsigned entry point
+ */
+unsigned init_from_elf(Memory * m, std::string filepath, std::vector<int> flag_signatures);
+
+
+/**
+ * @brief Initialize a memory from an bin file
+ *
+ * @param m memory ptr
+ * @param filepath elf file path
+ */
+void init_from_bin(Memory * m, std::string filepath);
+
+
+/**
+ * @brief Initialize a memory from an hex file (one 32-bit word per line)
+ *
+ * @param m memory ptr
+ * @param filepath elf file path
+ */
+void init_from_hex(Memory * m, std::string filepath);
+
+
+/**
+ * @brief Initialize a memory from an Intel HEX file
+ * @details Record addresses are absolute and must lie in the memory.
+ *
+ * @param m memory ptr
+ * @param filepath file path
+ */
+void init_from_ihex(Memory * m, std::string filepath);
+
+
+/**
+ * @brief Initialize a memory from a Motorola S-record file
+ * @details Record addresses are absolute and must lie in the memory.
+ *
+ * @param m memory ptr
+ * @param filepath file path
+ */
+void init_from_srec(Memory * m, std::string filepath);
+
+
+/**
+ * @brief Initialize a memory from bin/hex/ihex/srec file
+ * @details .hex files starting with ':' are read as Intel HEX.
+ *
+ * @param m memory ptr
+ * @param filepath image filepath
+ */
+void init_from_imgfile(Memory * m, std::string filepath);
@@ -79,29 +79,56 @@ void parse_commandline_args(int argc, char**argv, Atomsim_config &sim_config, Ba
 		
 		options.add_options("Sim Config")
 		("maxitr", "Specify maximum simulation iterations", cxxopts::value<unsigned long int>(sim_config.maxitr)->default_value(std::to_string(default_sim_config.maxitr)))
+		("restore", "Restore simulation state from a checkpoint file", cxxopts::value<std::string>(sim_config.restore_file)->default_value(default_sim_config.restore_file))
+		;
+
+		options.add_options("Sampled Simulation")
+		("sample-at", "Enable sampled simulation; fast-forward in ISS to an instruction count, pc (0x..) or symbol", cxxopts::value<std::string>(sim_config.sample_at)->default_value(default_sim_config.sample_at))
+		("sample-window", "Cycles to simulate in RTL per sample", cxxopts::value<unsigned long int>(sim_config.sample_window)->default_value(std::to_string(default_sim_config.sample_window)))
+		("sample-interval", "Instructions to fast-forward in ISS between samples", cxxopts::value<unsigned long int>(sim_config.sample_interval)->default_value(std::to_string(default_sim_config.sample_interval)))
+		("samples", "Number of samples", cxxopts::value<unsigned long int>(sim_config.samples)->default_value(std::to_string(default_sim_config.samples)))
 		;
 
 		options.add_options("Backend Config")
 		("p,vuart-port", "serial port for virtual UART", cxxopts::value<std::string>(backend_config.vuart_portname)->default_value(default_backend_config.vuart_portname))
 		("b,vuart-baud", "serial baud rate for virtual UART", cxxopts::value<uint32_t>(backend_config.vuart_baudrate)->default_value(std::to_string(default_backend_config.vuart_baudrate)))
 		("u,enable-uart-dump", "Enable dumping UART data (from soc) to stdout", cxxopts::value<bool>(backend_config.enable_uart_dump)->default_value(default_backend_config.enable_uart_dump?"true":"false"))
+		("engine", "Simulation engine: rtl (cycle accurate) or iss (functional, fast)", cxxopts::value<std::string>(backend_config.engine)->default_value(default_backend_config.engine))
+		("lockstep", "Run RTL in lockstep with reference ISS, stop at first divergence", cxxopts::value<bool>(backend_config.lockstep)->default_value(default_backend_config.lockstep?"true":"false"))
+		("busywait-skip", "Fast-forward over busy-wait loops (polling a counter, timer or peripheral)", cxxopts::value<bool>(backend_config.busywait_skip)->default_value(default_backend_config.busywait_skip?"true":"false"))
+		("busywait-approx", "Also fast-forward over busy-wait loops whose exit can't be predicted, in chunks (cycle counts become inexact)", cxxopts::value<bool>(backend_config.busywait_approx)->default_value(default_backend_config.busywait_approx?"true":"false"))
 		
 		#ifdef TARGET_ATOMBONES
 		("bootrom-size", "Specify size of bootrom to simulate (in KB)", cxxopts::value<uint32_t>(backend_config.bootrom_size_kb)->default_value(std::to_string(default_backend_config.bootrom_size_kb)))
-		("bootrom-image", "Specify bootrom hex image", cxxopts::value<std::string>(backend_config.bootrom_img)->default_value(default_backend_config.bootrom_img))
+		("bootrom-image", "Specify bootrom image (hex/bin/ihex/srec)", cxxopts::value<std::string>(backend_config.bootrom_img)->default_value(default_backend_config.bootrom_img))
 		("ram-size", "Specify size of RAM memory to simulate (in KB)", cxxopts::value<uint32_t>(backend_config.ram_size_kb)->default_value(std::to_string(default_backend_config.ram_size_kb)))
+		("sparse-ram", "Back RAM with demand paged host memory (pages allocated on first write)", cxxopts::value<bool>(backend_config.sparse_ram)->default_value(default_backend_config.sparse_ram?"true":"false"))
+		("icache", "Enable I-cache model: <size>:<ways>:<line size>[:lru|fifo|random] (size in bytes, or KB with k suffix)", cxxopts::value<std::string>(backend_config.icache)->default_value(default_backend_config.icache))
+		("dcache", "Enable D-cache model: <size>:<ways>:<line size>[:lru|fifo|random][:wb|wt]", cxxopts::value<std::string>(backend_config.dcache)->default_value(default_backend_config.dcache))
+		("cache-miss-penalty", "Cycles to fill (or write back) a cache line outside memory regions timed by --mem-timing", cxxopts::value<uint32_t>(backend_config.cache_miss_penalty)->default_value(std::to_string(default_backend_config.cache_miss_penalty)))
+		("mem-timing", "Latency, bandwidth & outstanding request limits of memory regions: \"<region>:latency=N,bandwidth=N,outstanding=N; ...\" (region: bootrom, ram or <base>+<size> in hex; default: from target config)", cxxopts::value<std::string>(backend_config.mem_timing)->default_value(default_backend_config.mem_timing))
+		("mem-bench", "Measure host time per memory access at startup", cxxopts::value<bool>(backend_config.mem_bench)->default_value(default_backend_config.mem_bench?"true":"false"))
 		#endif
 
 		#ifdef TARGET_HYDROGENSOC
 		("bootmode", "Specify bootmode signal", cxxopts::value<int>(backend_config.bootmode)->default_value(std::to_string(default_backend_config.bootmode)))
+		("idle-skip", "Fast-forward simulated time while core sleeps in WFI (until next timer interrupt)", cxxopts::value<bool>(backend_config.idle_skip)->default_value(default_backend_config.idle_skip?"true":"false"))
+		("uart-model", "UART model: bitbang (serialize bits on tx/rx pins) or tlm (exchange whole bytes with uart registers, fast)", cxxopts::value<std::string>(backend_config.uart_model)->default_value(default_backend_config.uart_model))
 		#endif
 		;
 
 		options.add_options("Debug")
 		("v,verbose", "Turn on verbose output", cxxopts::value<bool>(sim_config.verbose_flag)->default_value(default_sim_config.verbose_flag?"true":"false"))
 		("d,debug", "Start in debug mode", cxxopts::value<bool>(sim_config.debug_flag)->default_value(default_sim_config.debug_flag?"true":"false"))
-		("t,trace", "Enable VCD tracing ", cxxopts::value<bool>(sim_config.trace_flag)->default_value(default_sim_config.trace_flag?"true":"false"))
+		("t,trace", "Enable VCD/FST tracing ", cxxopts::value<bool>(sim_config.trace_flag)->default_value(default_sim_config.trace_flag?"true":"false"))
 		("trace-file", "Specify trace file", cxxopts::value<std::string>(sim_config.trace_file)->default_value(default_sim_config.trace_file))
+		("trace-start", "Start trace capture at a cycle, pc (0x..) or symbol (implies --trace)", cxxopts::value<std::string>(sim_config.trace_start)->default_value(default_sim_config.trace_start))
+		("trace-stop", "Stop trace capture at a cycle, pc (0x..) or symbol (implies --trace)", cxxopts::value<std::string>(sim_config.trace_stop)->default_value(default_sim_config.trace_stop))
+		("commit-log", "Write binary log of committed instructions to file (decode with scripts/clogdump.py)", cxxopts::value<std::string>(sim_config.commitlog_file)->default_value(default_sim_config.commitlog_file))
+		("profile", "Enable sampling profiler; write flat profile to file & folded call stacks (for flamegraph tools) to <file>.folded at exit", cxxopts::value<std::string>(sim_config.profile_file)->default_value(default_sim_config.profile_file))
+		("profile-interval", "Cycles between profiler samples", cxxopts::value<unsigned long int>(sim_config.profile_interval)->default_value(std::to_string(default_sim_config.profile_interval)))
+		("flightrec", "Enable flight recorder; keep last N cycles of pc, ir, bus & regfile write signals, dumped at ebreak, exception, maxitr & Ctrl+C", cxxopts::value<unsigned long int>(sim_config.flightrec_depth)->default_value(std::to_string(default_sim_config.flightrec_depth)))
+		("flightrec-file", "Specify flight recorder dump file (.vcd/.fst)", cxxopts::value<std::string>(sim_config.flightrec_file)->default_value(default_sim_config.flightrec_file))
 		("dump-file", "Specify dump file", cxxopts::value<std::string>(sim_config.dump_file)->default_value(default_sim_config.dump_file))
 		("ebreak-dump", "Enable processor state dump at hault", cxxopts::value<bool>(sim_config.dump_on_ebreak_flag)->default_value(default_sim_config.dump_on_ebreak_flag?"true":"false"))
 		("signature", "Enable signature dump at hault (Used for riscv compliance tests)", cxxopts::value<std::string>(sim_config.signature_file)->default_value(default_sim_config.signature_file))
@@ -176,6 +203,14 @@ int main(int argc, char ** argv)
 	// Parse commandline arguments
 	parse_commandline_args(argc, argv, sim_config, backend_config);
 
+	// Trace window implies tracing
+	if(sim_config.trace_start != "" || sim_config.trace_stop != "")
+		sim_config.trace_flag = true;
+
+	// Sampled simulation starts by fast-forwarding in ISS
+	if(sim_config.sample_at != "")
+		backend_config.engine = "iss";
+
 	// Disable colors if stdout is being piped
 	NO_COLOR_OUTPUT = !isatty(STDOUT_FILENO) || sim_config.no_color_flag;
 
@@ -194,7 +229,7 @@ int main(int argc, char ** argv)
 		Atomsim sim(sim_config, backend_config);
 
 		// Run sim
-		exitcode = sim.run();
+		exitcode = (sim_config.sample_at != "") ? sim.run_sampled() : sim.run();
 	}
 	catch(const std::exception& e)
 	{
@@ -1,23 +1,41 @@
 #include "memory.hpp"
 #include "except.hpp"
 
-#include "elfio/elfio.hpp"
-#include "util.hpp"
-
 #include <stdint.h>
 #include <iostream>
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <chrono>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 
-Memory::Memory(uint32_t num_bytes, uint32_t address_offset, bool is_write_protected):
+Memory::Memory(uint32_t num_bytes, uint32_t address_offset, bool is_write_protected, bool sparse):
     size_(num_bytes),
     addr_offset_(address_offset),
-    is_write_protected_(is_write_protected)
+    is_write_protected_(is_write_protected),
+    is_sparse_(sparse)
 {
+    if(num_bytes != 0 && (uint32_t)(address_offset + (num_bytes - 1)) < address_offset)
+    {
+        char except_buf[80];
+        sprintf(except_buf, "Memory at 0x%08x does not fit in 32-bit address space", address_offset);
+        throw Atomsim_exception(except_buf);
+    }
+
     // Allocate memory
-    if(!(mem_ = new uint8_t[num_bytes]))
+    if(is_sparse_)
+    {
+        void *p = mmap(nullptr, num_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(p == MAP_FAILED)
+            throw Atomsim_exception("Memory allocation failed: "+std::string(strerror(errno)));
+        mem_ = (uint8_t *) p;
+    }
+    else if(!(mem_ = new uint8_t[num_bytes]))
         throw Atomsim_exception("Memory allocation failed");
 }
 
@@ -25,30 +43,64 @@ Memory::Memory(uint32_t num_bytes, uint32_t address_offset, bool is_write_protec
 Memory::~Memory()
 {
     // deallocate memory
-    delete [] mem_;
+    if(is_sparse_)
+        munmap(mem_, size_);
+    else
+        delete [] mem_;
     size_ = 0;
 }
 
 
+uint64_t Memory::get_resident_size()
+{
+    const uintptr_t pgsz = sysconf(_SC_PAGESIZE);
+    const uintptr_t start = (uintptr_t)mem_ & ~(pgsz-1);
+    const uintptr_t end = ((uintptr_t)mem_ + size_ + pgsz-1) & ~(pgsz-1);
+    const size_t npages = (end - start) / pgsz;
+    const size_t batch = 4096;
+    uint64_t nresident = 0;
+
+    // bit 63: present, bit 56: exclusively mapped (not set for zero page)
+    int fd = open("/proc/self/pagemap", O_RDONLY);
+    bool pagemap_ok = (fd >= 0);
+    std::vector<uint64_t> ent(batch);
+    for (size_t i = 0; pagemap_ok && i < npages; i += batch)
+    {
+        size_t n = std::min(batch, npages - i);
+        ssize_t nrd = pread(fd, ent.data(), n * sizeof(uint64_t), ((start / pgsz) + i) * sizeof(uint64_t));
+        pagemap_ok = (nrd == (ssize_t)(n * sizeof(uint64_t)));
+        for (size_t j = 0; pagemap_ok && j < n; j++)
+            nresident += ((ent[j] >> 63) & 1) && ((ent[j] >> 56) & 1);
+    }
+    if(fd >= 0)
+        close(fd);
+    if(pagemap_ok)
+        return std::min<uint64_t>(nresident * pgsz, size_);
+
+    nresident = 0;
+    std::vector<unsigned char> vec(npages);
+    if(mincore((void *)start, end - start, vec.data()) != 0)
+        throw Atomsim_exception("can't query resident memory: "+std::string(strerror(errno)));
+    for (unsigned char v: vec)
+        nresident += v & 1;
+    return std::min<uint64_t>(nresident * pgsz, size_);
+}
+
+
 void Memory::fetch(const uint32_t start_addr, uint8_t *buf, const uint32_t buf_sz)
 {
     uint32_t rel_start_addr = start_addr - addr_offset_;    // relative to current memory block
 
-    for (uint32_t i = 0; i < buf_sz; i++)
+    if (!(rel_start_addr < size_ && buf_sz <= size_ - rel_start_addr))  // check bounds
     {
-        // get index
-        uint32_t indx = rel_start_addr + i;
-        
-        if (!(indx < size_))    // check bounds
-        {
-            char except_buf[70];
-            sprintf(except_buf, "Can't fetch, address outside range of memory [0x%08x]", start_addr + i);
-            throw Atomsim_exception(except_buf);
-        }
-
-        // copy from mem
-        buf[i] = mem_[indx];
+        char except_buf[70];
+        sprintf(except_buf, "Can't fetch, address outside range of memory [0x%08x]", 
+            rel_start_addr < size_ ? addr_offset_ + size_ : start_addr);
+        throw Atomsim_exception(except_buf);
     }
+
+    // copy from mem
+    memcpy(buf, mem_ + rel_start_addr, buf_sz);
 }
 
 
@@ -63,134 +115,151 @@ void Memory::store(const uint32_t start_addr, uint8_t *buf, const uint32_t buf_s
 
     uint32_t rel_start_addr = start_addr - addr_offset_;    // relative to current memory block
 
-    for (uint32_t i = 0; i < buf_sz; i++)
+    if (!(rel_start_addr < size_ && buf_sz <= size_ - rel_start_addr))  // check bounds
     {
-        // get index
-        uint32_t indx = rel_start_addr + i;
-        
-        if (!(indx < size_))    // check bounds
-        {
-            char except_buf[70];
-            sprintf(except_buf, "Can't store, address outside range of memory [0x%08x]", start_addr + i);
-            throw Atomsim_exception(except_buf);
-        }
-
-        // copy to mem
-        mem_[indx] = buf[i];
+        char except_buf[70];
+        sprintf(except_buf, "Can't store, address outside range of memory [0x%08x]", 
+            rel_start_addr < size_ ? addr_offset_ + size_ : start_addr);
+        throw Atomsim_exception(except_buf);
     }
+
+    // copy to mem
+    memcpy(mem_ + rel_start_addr, buf, buf_sz);
 }
 
 
-unsigned init_from_elf(Memory * m, std::string filepath, std::vector<int> flag_signatures)    // TODO: Remove this and switch to init from binary/hex files
+MemoryMap::MemoryMap():
+    pages_(1ul << (32 - MEMMAP_PAGE_BITS), nullptr)
+{}
+
+
+void MemoryMap::add(Memory *m)
 {
-    if(!m)
-        throw Atomsim_exception("Can't initialize memory; mem pointer == null");
+    if(m->get_size() == 0)
+        return;
 
-    // Initialize Memory object from input ELF File
-    ELFIO::elfio reader;
+    uint32_t first = m->get_base_addr();
+    uint32_t last = first + (m->get_size() - 1);
 
-    // Load file into elf reader
-    if (!reader.load(filepath)) 
+    for (Memory *b: blocks_)
     {
-        throwError("INIT0", "Can't find or process ELF file : " + filepath + "\n", true);
+        if (first <= b->get_base_addr() + (b->get_size() - 1) && b->get_base_addr() <= last)
+        {
+            char except_buf[90];
+            sprintf(except_buf, "memory block at 0x%08x overlaps block at 0x%08x", first, b->get_base_addr());
+            throw Atomsim_exception(except_buf);
+        }
     }
+    blocks_.push_back(m);
 
-    // Check ELF Class, Endiness & segment count
-    if(reader.get_class() !=ELFCLASS32)
-        throwError("INIT1", "Elf file format invalid: should be 32-bit elf\n", true);
-    if(reader.get_encoding() != ELFDATA2LSB)
-        throwError("INIT2", "Elf file format invalid: should be little Endian\n", true);
+    // pages already taken by another block keep it; accesses to the new 
+    // block in those pages are resolved by find_slow()
+    for (uint64_t p = first >> MEMMAP_PAGE_BITS; p <= (last >> MEMMAP_PAGE_BITS); p++)
+    {
+        if(!pages_[p])
+            pages_[p] = m;
+    }
+}
 
-    ELFIO::Elf_Half seg_num = reader.segments.size();
 
-    if(seg_num == 0)
-        throwError("INIT3", "Elf file format invalid: should consist of atleast one section\n", true);
+Memory * MemoryMap::find_slow(uint32_t addr)
+{
+    for (Memory *m: blocks_)
+    {
+        if(m->addr_in_range(addr))
+            return m;
+    }
+    return nullptr;
+}
 
 
-    // Read elf and initialize memory
+bool MemoryMap::write_word(uint32_t addr, uint32_t data, uint8_t sel)
+{
+    Memory *m = find(addr);
+    if(!m)
+        return false;
 
-    // if(verbose_flag)
-    //     std::cout << "Segments found : "<< seg_num <<"\n";
-    
-    unsigned int i = 0;
-    while (i < seg_num) // iterate over all segments
+    if(m->is_write_protected())
     {
-        const ELFIO::segment * seg = reader.segments[i];
-
-        // Get segment properties
-        
-        if (seg->get_type() == SHT_PROGBITS)
-        {
-            int seg_flags = reader.segments[i]->get_flags();
+        char except_buf[70];
+        sprintf(except_buf, "Attempted to store in a write-protected memory @ address [0x%08x]", addr);
+        throw Atomsim_exception(except_buf);
+    }
 
-            if(flag_signatures.end() != std::find(flag_signatures.begin(), flag_signatures.end(), seg_flags))	// Flag found in signature list
+    switch(sel & 0xf)
+    {
+        case 0b1111: m->write<uint32_t>(addr, data); break;
+        case 0b0011: m->write<uint16_t>(addr, data); break;
+        case 0b1100: m->write<uint16_t>(addr+2, data >> 16); break;
+        default:
+            for (int i=0; i<4; i++)
             {
-                // Get section
-                const ELFIO::Elf64_Addr seg_base_addr = reader.segments[i]->get_physical_address();
-                const ELFIO::Elf_Xword seg_size = reader.segments[i]->get_file_size();
-                const char* seg_data = reader.segments[i]->get_data();
-
-                // check bounds
-                if (seg_base_addr >= m->get_base_addr() && seg_base_addr < m->get_base_addr() + m->get_size() && seg_base_addr+seg_size <= m->get_base_addr()+m->get_size())
-                {
-                    // initialize memory
-                    // printf("mem-base=%08x, sz=%08x\n", m->get_base_addr(), m->get_size());
-                    // if(verbose_flag)
-                    printf("Loading segment %d [base=0x%08x, sz=% 6d bytes, at=0x%08x] ...\t", i, (unsigned) seg_base_addr, (unsigned) seg_size, (unsigned) seg_base_addr);
-                    m->store(seg_base_addr, (uint8_t*)seg_data, seg_size);
-                    // if(verbose_flag)
-                    printf("done\n");
-                }
+                if(sel & (1 << i))
+                    m->write<uint8_t>(addr+i, data >> (8*i));
             }
-        }
-        i++;
     }
-    return (unsigned int) reader.get_entry();
+    return true;
 }
 
 
-void init_from_bin(Memory * m, std::string filepath) {
-    if(!m) {
-        throw Atomsim_exception("Can't initialize memory; mem pointer == null");
-    }
-
-    std::vector<char> fcontents = fReadBin(filepath);
+bool MemoryMap::fetch(const uint32_t start_addr, uint8_t *buf, const uint32_t buf_sz)
+{
+    Memory *m = find(start_addr);
+    if(!m)
+        return false;
+    
+    if(!m->block_in_range(start_addr, buf_sz))
+        throw Atomsim_exception("can't fetch; bufsize too large for mem");
 
-    printf("Loading %ld bytes at 0x%08x from %s\n", fcontents.size(), m->get_base_addr(), filepath.c_str());
-    m->store(m->get_base_addr(), (uint8_t*)fcontents.data(), fcontents.size());
+    m->fetch(start_addr, buf, buf_sz);
+    return true;
 }
 
 
-void init_from_hex(Memory * m, std::string filepath) {
-    if(!m) {
-        throw Atomsim_exception("Can't initialize memory; mem pointer == null");
-    }
+bool MemoryMap::store(const uint32_t start_addr, uint8_t *buf, const uint32_t buf_sz)
+{
+    Memory *m = find(start_addr);
+    if(!m)
+        return false;
+    
+    if(!m->block_in_range(start_addr, buf_sz))
+        throw Atomsim_exception("can't store; bufsize too large for mem");
 
-    std::vector<std::string> fcontents = fRead(filepath);
-    uint32_t addr = m->get_base_addr(); 
-
-    printf("Loading %ld bytes at 0x%08x from %s\n", fcontents.size(), addr, filepath.c_str());
-
-    // parse
-    for(unsigned l=0; l<fcontents.size(); l++) {
-        std::string line = strip(fcontents[l]);
-        if (line.length() != 8)
-            throw Atomsim_exception("file:"+filepath+":"+std::to_string(l+1)+" Invalid hex format");
-        
-        Word_alias wa;
-        wa.word = std::stoul(line, nullptr, 16);
-        m->store(addr, wa.byte, 4);
-        addr += 4;
-    }
+    m->store(start_addr, buf, buf_sz);
+    return true;
 }
 
 
-void init_from_imgfile(Memory * m, std::string filepath) {
-    std::string ext = filepath.substr(filepath.length()-4, 4);
-    if(ext == ".hex")
-        init_from_hex(m, filepath);
-    else if (ext == ".bin")
-        init_from_bin(m, filepath);
-    else
-        throw Atomsim_exception("invalid image-file format: "+filepath);
-}
\ No newline at end of file
+double MemoryMap::benchmark(uint32_t naccesses)
+{
+    if(blocks_.empty() || naccesses == 0)
+        return 0.0;
+
+    // stride through blocks (in a scrambled order) so that the page table 
+    // lookup, and not just the host cache hit path, gets timed
+    std::vector<uint32_t> blk_addrs;
+    for (Memory *m: blocks_)
+        for (uint32_t off = 0; off < m->get_size() && off < (1u << 24); off += 4 * 1021)
+            blk_addrs.push_back(m->get_base_addr() + off);
+
+    const uint32_t nseq = 4096;
+    std::vector<uint32_t> addrs(nseq);
+    for (uint32_t k = 0; k < nseq; k++)
+        addrs[k] = blk_addrs[((uint64_t)k * 2654435761u) % blk_addrs.size()];
+    
+    uint32_t sum = 0;
+    auto tstart = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < naccesses; i++)
+    {
+        uint32_t data = 0;
+        read<uint32_t>(addrs[i & (nseq-1)], data);
+        sum += data;
+    }
+    auto tend = std::chrono::steady_clock::now();
+
+    // keep compiler from eliding the loop
+    volatile uint32_t sink = sum;
+    (void) sink;
+
+    return std::chrono::duration<double, std::nano>(tend - tstart).count() / naccesses;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <string.h>
 #include <string>
 #include <vector>
 
@@ -26,12 +27,18 @@ class Memory
 public:
 	/**
 	 * @brief Construct a new Memory object
-	 * 
+	 * @details A sparse memory is backed by an anonymous mapping reserved 
+     * (without committing swap) for the whole size: pages are zero filled 
+     * and only materialize when first written; untouched pages read as the 
+     * kernel's shared zero page. This allows simulating large address spaces 
+     * at a host memory cost proportional to the pages actually used.
+     * 
 	 * @param num_bytes size of memory
      * @param address_offset address offset for memory device
      * @param is_write_protected write protect flag
+     * @param sparse use demand paged backing
 	 */
-	Memory(uint32_t num_bytes, uint32_t address_offset, bool is_write_protected);
+	Memory(uint32_t num_bytes, uint32_t address_offset, bool is_write_protected, bool sparse=false);
 
 
 	/**
@@ -84,6 +91,29 @@ public:
     uint32_t get_size() { return size_; }
 
 
+    /**
+     * @brief Check if memory uses demand paged backing
+     * @return true if sparse
+     */
+    bool is_sparse()    { return is_sparse_; }
+
+    /**
+     * @brief Get number of bytes of memory resident in host memory
+     * @details Counts host pages privately backed by physical memory; 
+     * untouched pages and pages mapped to the shared zero page aren't 
+     * counted. Falls back to mincore() (which counts zero pages as resident)
+     * if /proc/self/pagemap is unavailable.
+     * @return uint64_t resident bytes
+     */
+    uint64_t get_resident_size();
+
+    /**
+     * @brief Get pointer to the backing array (used for direct accesses)
+     * @return uint8_t* pointer
+     */
+    uint8_t * get_data_ptr() { return mem_; }
+
+
     /**
      * @brief Get the base addr of memory block
      * 
@@ -118,6 +148,33 @@ public:
         && ((blk_addr + blk_sz - 1) < (addr_offset_ + size_));  // end address in range
     }
 
+    /**
+     * @brief Read a naturally aligned word/halfword/byte (no bounds check)
+     * @tparam T uint32_t, uint16_t or uint8_t
+     * @param addr address (must be in range)
+     * @return T data
+     */
+    template <typename T>
+    inline T read(uint32_t addr)
+    {
+        T data;
+        memcpy(&data, mem_ + (addr - addr_offset_), sizeof(T));
+        return data;
+    }
+
+    /**
+     * @brief Write a naturally aligned word/halfword/byte (no bounds or write 
+     * protect check)
+     * @tparam T uint32_t, uint16_t or uint8_t
+     * @param addr address (must be in range)
+     * @param data data
+     */
+    template <typename T>
+    inline void write(uint32_t addr, T data)
+    {
+        memcpy(mem_ + (addr - addr_offset_), &data, sizeof(T));
+    }
+
 private:
 	/**
 	 * @brief pointer to memory array
@@ -138,43 +195,128 @@ private:
      * @brief write protect flag
      */
     bool is_write_protected_;
+
+    /**
+     * @brief demand paged backing flag
+     */
+    bool is_sparse_;
 };
 
 
 
+#define MEMMAP_PAGE_BITS    16      // 64 KB pages
+
 /**
- * @brief Initialize a memory from an elf file
+ * @brief Address decoded map of memory blocks
+ * @details The 32-bit address space is split into pages of 
+ * (1 << MEMMAP_PAGE_BITS) bytes; a flat table built once (as blocks are 
+ * added) maps each page to the block covering it, so an access takes a 
+ * single table lookup and a range check instead of a search over all 
+ * blocks. Pages shared by more than one block fall back to a linear search.
  * 
- * @param m memory ptr
- * @param filepath elf file path
- * @param flag_signatures section signatures to load
- * @return unsigned entry point
+ * Word & halfword accesses are expected to be naturally aligned; since 
+ * memory blocks are word aligned, these need not be checked against the end 
+ * of the block.
  */
-unsigned init_from_elf(Memory * m, std::string filepath, std::vector<int> flag_signatures);
+class MemoryMap
+{
+public:
+    /**
+     * @brief Construct a new (empty) MemoryMap object
+     */
+    MemoryMap();
 
+    /**
+     * @brief Add a memory block to map
+     * @param m memory block (must outlive the map)
+     * @throws Atomsim_exception if block overlaps an existing block
+     */
+    void add(Memory *m);
 
-/**
- * @brief Initialize a memory from an bin file
- * 
- * @param m memory ptr
- * @param filepath elf file path
- */
-void init_from_bin(Memory * m, std::string filepath);
+    /**
+     * @brief Get memory block containing given address
+     * @param addr address
+     * @return Memory* memory block (nullptr if unmapped)
+     */
+    inline Memory * find(uint32_t addr)
+    {
+        Memory *m = pages_[addr >> MEMMAP_PAGE_BITS];
+        if(m && m->addr_in_range(addr))
+            return m;
+        return find_slow(addr);
+    }
 
+    /**
+     * @brief Read an aligned word/halfword/byte
+     * @tparam T uint32_t, uint16_t or uint8_t
+     * @param addr address
+     * @param data data read (output)
+     * @return false if address is unmapped
+     */
+    template <typename T>
+    inline bool read(uint32_t addr, T &data)
+    {
+        Memory *m = find(addr);
+        if(!m)
+            return false;
+        data = m->read<T>(addr);
+        return true;
+    }
 
-/**
- * @brief Initialize a memory from an hex file
- * 
- * @param m memory ptr
- * @param filepath elf file path
- */
-void init_from_hex(Memory * m, std::string filepath);
+    /**
+     * @brief Write bytes of an aligned word selected by byte enables
+     * @param addr word aligned address
+     * @param data data
+     * @param sel byte enables
+     * @return false if address is unmapped
+     * @throws Atomsim_exception if memory is write protected
+     */
+    bool write_word(uint32_t addr, uint32_t data, uint8_t sel);
 
+    /**
+     * @brief fetch bytes (may span pages, but not blocks)
+     * 
+     * @param start_addr starting address
+     * @param buf byte buffer 
+     * @param buf_sz buffer size
+     * @return false if start address is unmapped
+     * @throws Atomsim_exception if block is not contained in a single memory
+     */
+    bool fetch(const uint32_t start_addr, uint8_t *buf, const uint32_t buf_sz);
 
-/**
- * @brief Initialize a memory from bin/hex file
- * 
- * @param m memory ptr
- * @param filepath bin/hex filepath
- */
-void init_from_imgfile(Memory * m, std::string filepath);
\ No newline at end of file
+    /**
+     * @brief store bytes (may span pages, but not blocks)
+     * 
+     * @param start_addr starting address
+     * @param buf byte buffer 
+     * @param buf_sz buffer size
+     * @return false if start address is unmapped
+     * @throws Atomsim_exception if block is not contained in a single memory 
+     * or memory is write protected
+     */
+    bool store(const uint32_t start_addr, uint8_t *buf, const uint32_t buf_sz);
+
+    /**
+     * @brief Measure average host time taken by an aligned word read through 
+     * the map
+     * @param naccesses number of reads to time
+     * @return double ns per access
+     */
+    double benchmark(uint32_t naccesses = 1 << 22);
+
+private:
+    /**
+     * @brief Page table (1 << (32 - MEMMAP_PAGE_BITS) entries)
+     */
+    std::vector<Memory *> pages_;
+
+    /**
+     * @brief All memory blocks in map
+     */
+    std::vector<Memory *> blocks_;
+
+    /**
+     * @brief Search all blocks for given address
+     */
+    Memory * find_slow(uint32_t addr);
+};
@@ -0,0 +1,147 @@
+#include "memtiming.hpp"
+#include "memory.hpp"
+#include "util.hpp"
+#include "except.hpp"
+
+#include <stdio.h>
+#include <algorithm>
+#include <stdexcept>
+
+
+MemTiming::MemTiming(const std::string &spec, const std::map<std::string, std::shared_ptr<Memory>> &mems)
+{
+    std::string s = spec;
+    std::replace(s.begin(), s.end(), ';', ' ');
+    std::replace(s.begin(), s.end(), '\t', ' ');
+
+    std::vector<std::string> entries;
+    tokenize(s, entries, ' ');
+    for (const std::string &e: entries)
+    {
+        if (e.empty())
+            continue;
+
+        size_t colon = e.find(':');
+        if (colon == std::string::npos)
+            throw Atomsim_exception("invalid memory timing specification: "+e+" (expected <region>:<key>=<value>,...)");
+
+        Region_t r;
+        r.name = e.substr(0, colon);
+        size_t plus = r.name.find('+');
+        try
+        {
+            if (mems.count(r.name))
+            {
+                r.base = mems.at(r.name)->get_base_addr();
+                r.size = mems.at(r.name)->get_size();
+            }
+            else if (plus != std::string::npos)
+            {
+                r.base = std::stoul(r.name.substr(0, plus), nullptr, 16);
+                r.size = std::stoul(r.name.substr(plus+1), nullptr, 16);
+            }
+            else
+                throw Atomsim_exception("unknown memory region in timing specification: "+r.name);
+
+            std::vector<std::string> params;
+            tokenize(e.substr(colon+1), params, ',');
+            for (const std::string &p: params)
+            {
+                size_t eq = p.find('=');
+                std::string key = p.substr(0, eq);
+                if (eq == std::string::npos || p.find_first_not_of("0123456789", eq+1) != std::string::npos || eq+1 == p.size())
+                    throw Atomsim_exception("invalid memory timing parameter: "+p);
+                uint32_t val = std::stoul(p.substr(eq+1));
+
+                if (key == "latency")           r.latency = val;
+                else if (key == "bandwidth")    r.bandwidth = val;
+                else if (key == "outstanding")  r.outstanding = val;
+                else
+                    throw Atomsim_exception("unknown memory timing parameter: "+key);
+            }
+        }
+        catch (const std::logic_error &)   // from stoul
+        {
+            throw Atomsim_exception("invalid memory timing specification: "+e);
+        }
+        regions_.push_back(r);
+    }
+}
+
+
+MemTiming::Region_t * MemTiming::find(uint32_t addr)
+{
+    // regions may overlap (first match wins); there are only a few of them
+    for (Region_t &r: regions_)
+        if (addr - r.base < r.size)
+            return &r;
+    return nullptr;
+}
+
+
+uint64_t MemTiming::request(uint64_t now, uint32_t addr, uint32_t bytes)
+{
+    Region_t *rp = find(addr);
+    if (!rp)
+        return now;
+    Region_t &r = *rp;
+
+    uint64_t t = std::max(now, r.next_issue);
+
+    // wait for a slot; completed requests free theirs in the next cycle
+    if (r.outstanding)
+    {
+        auto &q = r.inflight;
+        q.erase(std::remove_if(q.begin(), q.end(), [t](uint64_t c) { return c < t; }), q.end());
+        while (q.size() >= r.outstanding)
+        {
+            auto first = std::min_element(q.begin(), q.end());
+            t = std::max(t, *first + 1);
+            q.erase(first);
+        }
+    }
+
+    uint64_t beats = r.bandwidth ? (bytes + r.bandwidth - 1) / r.bandwidth : 1;
+    uint64_t done = t + r.latency + beats - 1;
+    if (r.bandwidth)
+        r.next_issue = t + beats;
+    if (r.outstanding)
+        r.inflight.push_back(done);
+
+    r.requests++;
+    r.bytes += bytes;
+    r.wait_cycles += done - now;
+    return done;
+}
+
+
+void MemTiming::reset()
+{
+    for (Region_t &r: regions_)
+    {
+        r.next_issue = 0;
+        r.inflight.clear();
+    }
+}
+
+
+void MemTiming::print_info()
+{
+    for (Region_t &r: regions_)
+    {
+        printf("Region %s (0x%08x-0x%08x): latency %u, bandwidth %s, outstanding %s\n", r.name.c_str(), r.base,
+            r.base + r.size - 1, r.latency, r.bandwidth ? (std::to_string(r.bandwidth)+" B/cycle").c_str() : "unlimited",
+            r.outstanding ? std::to_string(r.outstanding).c_str() : "unlimited");
+        printf("  requests : %12ld, %ld bytes, %.2f cycles/request\n", r.requests, r.bytes,
+            r.requests ? (double)r.wait_cycles / r.requests : 0.0);
+    }
+}
+
+
+std::vector<uint64_t *> MemTiming::get_counters()
+{
+    std::vector<uint64_t *> c;
+    for (Region_t &r: regions_)
+        c.insert(c.end(), {&r.requests, &r.bytes, &r.wait_cycles});
+    return c;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+
+class Memory;
+
+/**
+ * @brief Memory timing model
+ * @details Times the transfers made on regions of the memory map. Each region
+ * has a latency (wait states of an access), a bandwidth (bytes per cycle:
+ * data of an n byte transfer arrives over n/bandwidth cycles, the first one
+ * after the latency; the next transfer is issued once this one has issued
+ * all its beats) and a limit on the number of requests in flight (further
+ * requests are issued as they complete). Accesses outside timed regions take
+ * no extra cycles.
+ *
+ * Times are in cycles counted by the caller; a request issued at cycle t
+ * with no extra cycles completes in cycle t.
+ *
+ * Specification: whitespace or ';' separated list of regions
+ *   <region>:<key>=<value>[,<key>=<value>...]
+ * where region is the name of a memory block or <base>+<size> (hex), and
+ * keys are latency (cycles), bandwidth (bytes/cycle, 0: unlimited) and
+ * outstanding (requests, 0: unlimited). Regions are matched in order.
+ */
+class MemTiming
+{
+public:
+    /**
+     * @brief Construct a new MemTiming object
+     * @param spec specification
+     * @param mems memory blocks of target (to resolve region names)
+     * @throws Atomsim_exception if spec is malformed
+     */
+    MemTiming(const std::string &spec, const std::map<std::string, std::shared_ptr<Memory>> &mems);
+
+    /**
+     * @brief Issue a transfer
+     * @param now cycle in which it is requested
+     * @param addr address
+     * @param bytes size of transfer
+     * @return uint64_t cycle in which it completes
+     */
+    uint64_t request(uint64_t now, uint32_t addr, uint32_t bytes);
+
+    /**
+     * @brief Check if an address is in a timed region
+     * @param addr address
+     * @return true if timed
+     */
+    bool covers(uint32_t addr)  { return find(addr) != nullptr; }
+
+    /**
+     * @brief Check if there are no timed regions
+     * @return true if empty
+     */
+    bool empty()    { return regions_.empty(); }
+
+    /**
+     * @brief Forget requests in flight
+     */
+    void reset();
+
+    /**
+     * @brief Print configuration & statistics of regions
+     */
+    void print_info();
+
+    /**
+     * @brief Get handles to statistics counters (which advance with time)
+     * @return std::vector<uint64_t *>
+     */
+    std::vector<uint64_t *> get_counters();
+
+private:
+    struct Region_t
+    {
+        std::string name;
+        uint32_t base;
+        uint32_t size;
+        uint32_t latency = 0;
+        uint32_t bandwidth = 0;
+        uint32_t outstanding = 0;
+
+        uint64_t next_issue = 0;        // earliest cycle of next issue (bandwidth)
+        std::vector<uint64_t> inflight; // completion cycles of requests in flight
+
+        uint64_t requests = 0;
+        uint64_t bytes = 0;
+        uint64_t wait_cycles = 0;       // cycles from request to completion
+    };
+
+    std::vector<Region_t> regions_;
+
+    /**
+     * @brief Find region containing address
+     * @return Region_t* region (nullptr if none)
+     */
+    Region_t * find(uint32_t addr);
+};
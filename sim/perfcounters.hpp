@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Classes of cycles accounted by performance counters
+ * @details Every simulated cycle falls in exactly one class, based on what
+ * stage2 of the pipeline does in it: it either retires an instruction, or
+ * the cycle is lost for the reason the instruction in stage2 is stalled (or
+ * the reason a bubble was inserted into stage2 in the previous cycle).
+ */
+enum PerfClass_t {
+    PERF_RETIRE,    // an instruction retired
+    PERF_IBUS,      // bubble: stage1 was waiting for ibus response
+    PERF_DBUS,      // stage2 stalled waiting for dbus response
+    PERF_FLUSH,     // bubble: pipeline flushed by a jump/branch/trap
+    PERF_HALT,      // core halted (sleeping in WFI)
+    PERF_OTHER,     // bubble: anything else (e.g. after reset)
+    PERF_NCLASSES
+};
+
+/**
+ * @brief Names of cycle classes (indexed by PerfClass_t)
+ */
+static const char * const perf_class_names[PERF_NCLASSES] = {
+    "retire", "ibus", "dbus", "flush", "halt", "other"
+};
+
+/**
+ * @brief Cycle breakdown of RTL simulation
+ */
+struct PerfCounters_t {
+    uint64_t cycles[PERF_NCLASSES] = {};
+
+    uint64_t total() const
+    {
+        uint64_t n = 0;
+        for (int i = 0; i < PERF_NCLASSES; i++)
+            n += cycles[i];
+        return n;
+    }
+
+    uint64_t retired() const    { return cycles[PERF_RETIRE]; }
+};
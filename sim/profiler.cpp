@@ -0,0 +1,237 @@
+#include "profiler.hpp"
+#include "rvdefs.hpp"
+#include "util.hpp"
+#include "except.hpp"
+
+#include "elfio/elfio.hpp"
+
+#include <stdio.h>
+#include <algorithm>
+#include <numeric>
+
+// RV32 opcodes
+#define OPC_JAL     0x6f
+#define OPC_JALR    0x67
+
+#define REG_RA      1
+
+
+Profiler::Profiler(const std::string &elf_file, const std::string &out_file, uint64_t interval):
+    out_file_(out_file),
+    interval_(interval),
+    next_sample_(interval)
+{
+    if (interval == 0)
+        throw Atomsim_exception("profiler sampling interval must be non-zero");
+
+    load_symbols(elf_file);
+    self_.resize(funcs_.size(), 0);
+    calls_.resize(funcs_.size(), 0);
+    cls_.resize(funcs_.size(), {});
+
+    // make sure output file is writable before simulating
+    FILE *fp = fopen(out_file_.c_str(), "w");
+    if (!fp)
+        throw Atomsim_exception("can't open profile file for writing: "+out_file_);
+    fclose(fp);
+}
+
+
+Profiler::~Profiler()
+{
+    write();
+}
+
+
+void Profiler::load_symbols(const std::string &elf_file)
+{
+    forEachElfSymbol(elf_file, [&](const ElfSymbol_t &sym) {
+        // functions, and global labels in code (e.g. _start in assembly files)
+        if (sym.name.empty() || !sym.defined)
+            return true;
+        if (sym.type == STT_FUNC || (sym.type == STT_NOTYPE && sym.bind != STB_LOCAL && sym.code))
+            funcs_.push_back({sym.value, sym.size, sym.name});
+        return true;
+    });
+
+    // one name per address
+    std::stable_sort(funcs_.begin(), funcs_.end(), [](const Func_t &a, const Func_t &b) { return a.addr < b.addr; });
+    funcs_.erase(std::unique(funcs_.begin(), funcs_.end(), [](const Func_t &a, const Func_t &b) { return a.addr == b.addr; }), funcs_.end());
+
+    funcs_.push_back({0, 0, PROFILER_UNKNOWN});
+}
+
+
+uint32_t Profiler::func_of(uint32_t pc)
+{
+    if (pc >= cache_lo_ && pc < cache_hi_)
+        return cache_func_;
+
+    const uint32_t unknown = funcs_.size() - 1;
+    auto begin = funcs_.begin(), end = funcs_.end() - 1;
+
+    // first function starting after pc
+    auto it = std::upper_bound(begin, end, pc, [](uint32_t pc, const Func_t &f) { return pc < f.addr; });
+    uint32_t next = (it != end) ? it->addr : 0xffffffff;
+    if (it == begin)
+    {
+        cache_lo_ = 0;
+        cache_hi_ = next;
+        cache_func_ = unknown;
+        return unknown;
+    }
+
+    auto f = it - 1;
+    uint32_t f_end = f->size ? (uint32_t)std::min<uint64_t>((uint64_t)f->addr + f->size, next) : next;
+    if (pc < f_end)
+    {
+        cache_lo_ = f->addr;
+        cache_hi_ = f_end;
+        cache_func_ = f - begin;
+    }
+    else    // in a gap between functions
+    {
+        cache_lo_ = f_end;
+        cache_hi_ = next;
+        cache_func_ = unknown;
+    }
+    return cache_func_;
+}
+
+
+void Profiler::track_calls(uint32_t pc, uint32_t ir)
+{
+    if (ir == RV_INSTR_NOP)     // pipeline bubble
+        return;
+
+    // calls/returns take effect once the next instruction is reached, so 
+    // that samples of the call/ret itself are attributed to the right stack
+    if (pending_ == CALL)
+    {
+        if (stack_.size() < PROFILER_MAX_DEPTH)
+            stack_.push_back(caller_);
+        else
+            overflow_++;
+        calls_[func_of(pc)]++;
+    }
+    else if (pending_ == RET)
+    {
+        if (overflow_)
+            overflow_--;
+        else if (!stack_.empty())
+            stack_.pop_back();
+    }
+    pending_ = NONE;
+
+    uint32_t opcode = ir & 0x7f;
+    uint32_t rd = (ir >> 7) & 0x1f;
+    uint32_t rs1 = (ir >> 15) & 0x1f;
+
+    if ((opcode == OPC_JAL || opcode == OPC_JALR) && rd == REG_RA)
+    {
+        pending_ = CALL;
+        caller_ = func_of(pc);
+    }
+    else if (opcode == OPC_JALR && rd == 0 && rs1 == REG_RA)
+        pending_ = RET;
+}
+
+
+void Profiler::sample(uint64_t cycle, uint32_t pc, PerfClass_t cls)
+{
+    // cycles skipped by simulator are attributed to current pc
+    uint64_t n = (cycle - next_sample_) / interval_ + 1;
+    next_sample_ += n * interval_;
+    nsamples_ += n;
+
+    uint32_t f = func_of(pc);
+    self_[f] += n;
+    cls_[f][cls] += n;
+
+    std::vector<uint32_t> key(stack_);
+    key.push_back(f);
+    stacks_[key] += n;
+}
+
+
+void Profiler::write()
+{
+    // inclusive samples (functions on stack are counted once per sample)
+    std::vector<uint64_t> total(funcs_.size(), 0);
+    for (auto &s: stacks_)
+    {
+        std::vector<uint32_t> fs(s.first);
+        std::sort(fs.begin(), fs.end());
+        fs.erase(std::unique(fs.begin(), fs.end()), fs.end());
+        for (uint32_t f: fs)
+            total[f] += s.second;
+    }
+
+    FILE *fp = fopen(out_file_.c_str(), "w");
+    if (!fp)
+    {
+        throwWarning("PROF0", "can't open profile file for writing: "+out_file_);
+        return;
+    }
+
+    std::vector<uint32_t> order(funcs_.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        if (self_[a] != self_[b])
+            return self_[a] > self_[b];
+        if (calls_[a] != calls_[b])
+            return calls_[a] > calls_[b];
+        return funcs_[a].name < funcs_[b].name;
+    });
+
+    fprintf(fp, "Flat profile:\n\n");
+    fprintf(fp, "Each sample counts as %lu cycles (%lu samples).\n", interval_, nsamples_);
+    fprintf(fp, "  %%   cumulative     self                 self      total\n");
+    fprintf(fp, " time     cycles     cycles     calls  cyc/call   cyc/call  name\n");
+
+    uint64_t cumulative = 0;
+    for (uint32_t f: order)
+    {
+        if (self_[f] == 0 && calls_[f] == 0)
+            continue;
+        uint64_t self = self_[f] * interval_;
+        cumulative += self;
+        fprintf(fp, "%6.2f %10lu %10lu ", nsamples_ ? 100.0 * self_[f] / nsamples_ : 0.0, cumulative, self);
+        if (calls_[f])
+            fprintf(fp, "%9lu %9.1f %10.1f  ", calls_[f], (double)self / calls_[f], (double)total[f] * interval_ / calls_[f]);
+        else
+            fprintf(fp, "%9s %9s %10s  ", "", "", "");
+        fprintf(fp, "%s\n", funcs_[f].name.c_str());
+    }
+
+    // where the cycles of each function go
+    fprintf(fp, "\nCycle breakdown (%% of self cycles):\n\n");
+    for (int c = 0; c < PERF_NCLASSES; c++)
+        fprintf(fp, "%7s ", perf_class_names[c]);
+    fprintf(fp, " name\n");
+    for (uint32_t f: order)
+    {
+        if (self_[f] == 0)
+            continue;
+        for (int c = 0; c < PERF_NCLASSES; c++)
+            fprintf(fp, "%7.2f ", 100.0 * cls_[f][c] / self_[f]);
+        fprintf(fp, " %s\n", funcs_[f].name.c_str());
+    }
+    fclose(fp);
+
+    // folded call stacks
+    std::string folded_file = out_file_ + ".folded";
+    fp = fopen(folded_file.c_str(), "w");
+    if (!fp)
+    {
+        throwWarning("PROF0", "can't open profile file for writing: "+folded_file);
+        return;
+    }
+    for (auto &s: stacks_)
+    {
+        for (unsigned i = 0; i < s.first.size(); i++)
+            fprintf(fp, "%s%s", i ? ";" : "", funcs_[s.first[i]].name.c_str());
+        fprintf(fp, " %lu\n", s.second);
+    }
+    fclose(fp);
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <array>
+
+#include "perfcounters.hpp"
+
+#define PROFILER_MAX_DEPTH  256     // max call stack depth tracked
+#define PROFILER_UNKNOWN    "[unknown]"
+
+/**
+ * @brief Sampling profiler
+ * @details Samples the pc every interval cycles and maps it to a function
+ * using the symbol table of the ELF file being simulated. Call stacks are
+ * reconstructed by watching executed instructions for calls (jal/jalr with
+ * rd=ra) and returns (ret), so tick() must see every instruction; it is
+ * cheap when the instruction isn't a call/return and no sample is due.
+ *
+ * Each sample also records the class of the sampled cycle (see PerfClass_t),
+ * giving a breakdown of where the cycles of each function go.
+ *
+ * When destroyed, a gprof style flat profile (followed by the cycle breakdown
+ * of each function) is written to the output file and the sampled call stacks are written in folded format (one line per
+ * unique stack: "main;foo;bar <samples>", usable by flamegraph tools) to
+ * <output file>.folded.
+ */
+class Profiler
+{
+public:
+    /**
+     * @brief Construct a new Profiler object
+     * @param elf_file ELF file to read symbols from
+     * @param out_file output file
+     * @param interval cycles between samples
+     */
+    Profiler(const std::string &elf_file, const std::string &out_file, uint64_t interval);
+
+    /**
+     * @brief Destroy the Profiler object; writes profile
+     */
+    ~Profiler();
+
+    /**
+     * @brief Observe instruction being executed (call after every cycle)
+     * @details Cycles skipped between calls are attributed to the pc of the
+     * next call.
+     * @param cycle total cycles simulated so far
+     * @param pc pc of instruction
+     * @param ir instruction
+     * @param cls class of cycle
+     */
+    void tick(uint64_t cycle, uint32_t pc, uint32_t ir, PerfClass_t cls)
+    {
+        // an instruction stays in ir for multiple cycles if pipeline is stalled
+        if (pc != last_pc_ || ir != last_ir_)
+        {
+            last_pc_ = pc;
+            last_ir_ = ir;
+            track_calls(pc, ir);
+        }
+        if (cycle >= next_sample_)
+            sample(cycle, pc, cls);
+    }
+
+    /**
+     * @brief Write flat profile & folded call stacks
+     */
+    void write();
+
+    /**
+     * @brief Get number of samples taken
+     * @return uint64_t
+     */
+    uint64_t get_samples()  { return nsamples_; }
+
+private:
+    struct Func_t
+    {
+        uint32_t addr;
+        uint32_t size;      // 0: extends till next function
+        std::string name;
+    };
+
+    /**
+     * @brief Functions sorted by address; last entry is PROFILER_UNKNOWN
+     */
+    std::vector<Func_t> funcs_;
+
+    std::string out_file_;
+    uint64_t interval_;
+    uint64_t next_sample_;
+    uint64_t nsamples_ = 0;
+
+    uint32_t last_pc_ = 0;
+    uint32_t last_ir_ = 0;
+
+    /**
+     * @brief Functions containing the call sites of active calls
+     */
+    std::vector<uint32_t> stack_;
+
+    /**
+     * @brief Calls made while stack_ was full (not tracked)
+     */
+    uint64_t overflow_ = 0;
+
+    /**
+     * @brief Call/return seen, applied at next instruction (callee is the
+     * function of next instruction)
+     */
+    enum { NONE, CALL, RET } pending_ = NONE;
+    uint32_t caller_ = 0;
+
+    /**
+     * @brief Last lookup of func_of() (pc range & function)
+     */
+    uint32_t cache_lo_ = 1, cache_hi_ = 0;
+    uint32_t cache_func_ = 0;
+
+    /**
+     * @brief Samples & calls per function
+     */
+    std::vector<uint64_t> self_;
+    std::vector<uint64_t> calls_;
+
+    /**
+     * @brief Samples per function & cycle class
+     */
+    std::vector<std::array<uint64_t, PERF_NCLASSES>> cls_;
+
+    /**
+     * @brief Samples per unique call stack (callers..., function)
+     */
+    std::map<std::vector<uint32_t>, uint64_t> stacks_;
+
+    /**
+     * @brief Load functions from symbol table of ELF file
+     */
+    void load_symbols(const std::string &elf_file);
+
+    /**
+     * @brief Get index of function containing pc
+     */
+    uint32_t func_of(uint32_t pc);
+
+    /**
+     * @brief Update call stack for a new instruction
+     */
+    void track_calls(uint32_t pc, uint32_t ir);
+
+    /**
+     * @brief Take sample(s) at given cycle
+     */
+    void sample(uint64_t cycle, uint32_t pc, PerfClass_t cls);
+};
@@ -1,6 +1,9 @@
 #pragma once
 #include <string>
 
+#define RV_INSTR_EBREAK 0x100073
+#define RV_INSTR_NOP    0x13
+
 const std::string rv_abi_regnames [32] = {
     "zero",     "ra",       "sp",	    "gp",
     "tp",       "t0",	    "t1",       "t2",
@@ -0,0 +1,259 @@
+#include "semihosting.hpp"
+#include "util.hpp"
+
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#define SEMIHOST_CHUNK_SZ   4096    // bytes copied from/to target at once
+#define SEMIHOST_MAX_PATH   1024
+
+// fopen modes for SYS_OPEN mode numbers 0-11
+static const char * open_modes[] = {
+    "r", "rb", "r+", "r+b", "w", "wb", "w+", "w+b", "a", "ab", "a+", "a+b"
+};
+
+
+Semihosting::Semihosting(MemFn load, MemFn store):
+    load_(load),
+    store_(store),
+    files_({stdin, stdout, stderr}),
+    start_time_(std::chrono::steady_clock::now())
+{}
+
+
+Semihosting::~Semihosting()
+{
+    for (unsigned i = 3; i < files_.size(); i++)
+        if (files_[i])
+            fclose(files_[i]);
+}
+
+
+uint32_t Semihosting::param(uint32_t block, int n)
+{
+    uint32_t w;
+    load_(block + 4*n, (uint8_t *)&w, 4);
+    return w;
+}
+
+
+FILE * Semihosting::get_file(uint32_t fd)
+{
+    if (fd >= files_.size() || !files_[fd])
+    {
+        errno_ = EBADF;
+        return nullptr;
+    }
+    return files_[fd];
+}
+
+
+uint32_t Semihosting::service(uint32_t op, uint32_t arg)
+{
+    switch (op)
+    {
+        case SYS_OPEN:
+        {
+            uint32_t mode = param(arg, 1);
+            uint32_t len = param(arg, 2);
+            if (mode >= sizeof(open_modes)/sizeof(open_modes[0]) || len >= SEMIHOST_MAX_PATH)
+            {
+                errno_ = EINVAL;
+                return -1;
+            }
+            char path[SEMIHOST_MAX_PATH];
+            load_(param(arg, 0), (uint8_t *)path, len);
+            path[len] = '\0';
+
+            // ":tt" is the console; stdin for read modes, stdout for write & stderr for append modes
+            if (strcmp(path, ":tt") == 0)
+                return mode / 4;
+
+            FILE *fp = fopen(path, open_modes[mode]);
+            if (!fp)
+            {
+                errno_ = errno;
+                return -1;
+            }
+
+            // reuse a free slot if any
+            for (unsigned i = 3; i < files_.size(); i++)
+            {
+                if (!files_[i])
+                {
+                    files_[i] = fp;
+                    return i;
+                }
+            }
+            files_.push_back(fp);
+            return files_.size() - 1;
+        }
+
+        case SYS_CLOSE:
+        {
+            uint32_t fd = param(arg, 0);
+            FILE *fp = get_file(fd);
+            if (!fp)
+                return -1;
+            if (fd > 2)     // console stays open
+            {
+                fclose(fp);
+                files_[fd] = nullptr;
+            }
+            return 0;
+        }
+
+        case SYS_WRITEC:
+        {
+            uint8_t c;
+            load_(arg, &c, 1);
+            fputc(c, stdout);
+            fflush(stdout);
+            return 0;
+        }
+
+        case SYS_WRITE0:
+        {
+            uint8_t c;
+            for (uint32_t addr = arg; load_(addr, &c, 1), c != '\0'; addr++)
+                fputc(c, stdout);
+            fflush(stdout);
+            return 0;
+        }
+
+        case SYS_WRITE:
+        {
+            FILE *fp = get_file(param(arg, 0));
+            uint32_t buf = param(arg, 1);
+            uint32_t len = param(arg, 2);
+            if (!fp)
+                return len;
+
+            uint8_t chunk[SEMIHOST_CHUNK_SZ];
+            uint32_t done = 0;
+            while (done < len)
+            {
+                uint32_t n = std::min<uint32_t>(SEMIHOST_CHUNK_SZ, len - done);
+                load_(buf + done, chunk, n);
+                size_t w = fwrite(chunk, 1, n, fp);
+                done += w;
+                if (w < n)
+                {
+                    errno_ = errno;
+                    break;
+                }
+            }
+            if (fp == stdout || fp == stderr)
+                fflush(fp);
+            return len - done;  // bytes not written
+        }
+
+        case SYS_READ:
+        {
+            FILE *fp = get_file(param(arg, 0));
+            uint32_t buf = param(arg, 1);
+            uint32_t len = param(arg, 2);
+            if (!fp)
+                return len;
+
+            uint8_t chunk[SEMIHOST_CHUNK_SZ];
+            uint32_t done = 0;
+            while (done < len)
+            {
+                uint32_t n = std::min<uint32_t>(SEMIHOST_CHUNK_SZ, len - done);
+                ssize_t r;
+                if (fp == stdin)
+                    r = read(STDIN_FILENO, chunk, n);   // don't block for more than what is available (a line)
+                else
+                    r = fread(chunk, 1, n, fp);
+                if (r <= 0)
+                {
+                    if (r < 0 || ferror(fp))
+                        errno_ = errno;
+                    break;
+                }
+                store_(buf + done, chunk, r);
+                done += r;
+                if (fp == stdin || (uint32_t)r < n)
+                    break;
+            }
+            return len - done;  // bytes not read
+        }
+
+        case SYS_READC:
+        {
+            int c = getchar();
+            return c == EOF ? -1 : c;
+        }
+
+        case SYS_ISTTY:
+        {
+            FILE *fp = get_file(param(arg, 0));
+            if (!fp)
+                return 0;
+            return isatty(fileno(fp)) ? 1 : 0;
+        }
+
+        case SYS_SEEK:
+        {
+            FILE *fp = get_file(param(arg, 0));
+            if (!fp)
+                return -1;
+            if (fseek(fp, param(arg, 1), SEEK_SET) != 0)
+            {
+                errno_ = errno;
+                return -1;
+            }
+            return 0;
+        }
+
+        case SYS_FLEN:
+        {
+            FILE *fp = get_file(param(arg, 0));
+            if (!fp)
+                return -1;
+            long pos = ftell(fp);
+            if (pos < 0 || fseek(fp, 0, SEEK_END) != 0)
+            {
+                errno_ = errno;
+                return -1;
+            }
+            long len = ftell(fp);
+            fseek(fp, pos, SEEK_SET);
+            return len;
+        }
+
+        case SYS_CLOCK:     // centiseconds since start
+            return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time_).count() / 10;
+
+        case SYS_TIME:
+            return time(NULL);
+
+        case SYS_ERRNO:
+            return errno_;
+
+        case SYS_EXIT:
+            exited_ = true;
+            exit_code_ = (arg == ADP_Stopped_ApplicationExit) ? EXIT_SUCCESS : EXIT_FAILURE;
+            return 0;
+
+        case SYS_EXIT_EXTENDED:
+            exited_ = true;
+            exit_code_ = (param(arg, 0) == ADP_Stopped_ApplicationExit) ? (int)param(arg, 1) : EXIT_FAILURE;
+            return 0;
+
+        default:
+        {
+            char hx[12];
+            sprintf(hx, "0x%02x", op);
+            throwWarning("SEMI0", "unsupported semihosting operation: "+std::string(hx));
+            errno_ = ENOSYS;
+            return -1;
+        }
+    }
+}
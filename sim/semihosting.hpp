@@ -0,0 +1,123 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+
+// Semihosting call sequence (must be uncompressed & in this order)
+#define SEMIHOST_INSTR_ENTRY    0x01f01013  // slli x0, x0, 0x1f
+#define SEMIHOST_INSTR_EBREAK   0x00100073  // ebreak
+#define SEMIHOST_INSTR_EXIT     0x40705013  // srai x0, x0, 7
+
+// Operations (a0)
+#define SYS_OPEN            0x01
+#define SYS_CLOSE           0x02
+#define SYS_WRITEC          0x03
+#define SYS_WRITE0          0x04
+#define SYS_WRITE           0x05
+#define SYS_READ            0x06
+#define SYS_READC           0x07
+#define SYS_ISTTY           0x09
+#define SYS_SEEK            0x0a
+#define SYS_FLEN            0x0c
+#define SYS_CLOCK           0x10
+#define SYS_TIME            0x11
+#define SYS_ERRNO           0x13
+#define SYS_EXIT            0x18
+#define SYS_EXIT_EXTENDED   0x20
+
+#define ADP_Stopped_ApplicationExit 0x20026
+
+/**
+ * @brief RISC-V semihosting host
+ * @details Services semihosting calls made by the target. A call is made by
+ * executing the slli/ebreak/srai sequence with the operation in a0 and its
+ * argument (usually a pointer to a parameter block of words) in a1; the
+ * result is returned in a0. Target memory is accessed through the load/store
+ * callbacks. File handles 0, 1 & 2 are the host's stdin, stdout & stderr
+ * (opened as ":tt").
+ */
+class Semihosting
+{
+public:
+    typedef std::function<void(uint32_t addr, uint8_t *buf, uint32_t sz)> MemFn;
+
+    /**
+     * @brief Construct a new Semihosting object
+     * @param load reads target memory
+     * @param store writes target memory
+     */
+    Semihosting(MemFn load, MemFn store);
+
+    /**
+     * @brief Destroy the Semihosting object; closes files opened by target
+     */
+    ~Semihosting();
+
+    /**
+     * @brief Check if given instruction words form a semihosting call
+     * @param prev instruction before ebreak
+     * @param next instruction after ebreak
+     * @return true if semihosting call
+     */
+    static bool is_call(uint32_t prev, uint32_t next)
+    {
+        return prev == SEMIHOST_INSTR_ENTRY && next == SEMIHOST_INSTR_EXIT;
+    }
+
+    /**
+     * @brief Service a semihosting call
+     * @param op operation (a0)
+     * @param arg argument (a1)
+     * @return uint32_t result (a0)
+     */
+    uint32_t service(uint32_t op, uint32_t arg);
+
+    /**
+     * @brief Check if target requested to exit
+     * @return true if SYS_EXIT(_EXTENDED) was called
+     */
+    bool exited()       { return exited_; }
+
+    /**
+     * @brief Get exit code passed by target
+     * @return int
+     */
+    int exit_code()     { return exit_code_; }
+
+private:
+    MemFn load_;
+    MemFn store_;
+
+    /**
+     * @brief Host files indexed by target file handle (nullptr: free slot)
+     */
+    std::vector<FILE *> files_;
+
+    /**
+     * @brief errno of last failed call (returned by SYS_ERRNO)
+     */
+    int errno_ = 0;
+
+    bool exited_ = false;
+    int exit_code_ = 0;
+
+    /**
+     * @brief Reference time for SYS_CLOCK
+     */
+    std::chrono::steady_clock::time_point start_time_;
+
+    /**
+     * @brief Read nth word of parameter block
+     */
+    uint32_t param(uint32_t block, int n);
+
+    /**
+     * @brief Get host file for target file handle
+     * @return FILE* (nullptr if handle is invalid; sets errno_)
+     */
+    FILE * get_file(uint32_t fd);
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+/**
+ * @brief Lock-free single producer single consumer queue
+ * @details Fixed capacity ring buffer. Each side keeps a cached copy of the
+ * other side's index, so shared cache lines are only touched when the cached
+ * copy runs out.
+ */
+template <class T>
+class SpscQueue
+{
+public:
+    /**
+     * @brief Construct a new SpscQueue object
+     * @param capacity capacity (rounded up to a power of 2)
+     */
+    SpscQueue(size_t capacity)
+    {
+        size_t n = 2;
+        while(n < capacity)
+            n <<= 1;
+        buf_.resize(n);
+        mask_ = n-1;
+    }
+
+    /**
+     * @brief Push an element (producer side)
+     * @return false if queue is full
+     */
+    bool push(const T &v)
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if(tail - head_cached_ > mask_) {
+            head_cached_ = head_.load(std::memory_order_acquire);
+            if(tail - head_cached_ > mask_)
+                return false;
+        }
+        buf_[tail & mask_] = v;
+        tail_.store(tail+1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Pop up to n elements (consumer side)
+     *
+     * @param out output buffer
+     * @param n max number of elements
+     * @return size_t number of elements popped
+     */
+    size_t pop(T *out, size_t n)
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if(tail_cached_ == head) {
+            tail_cached_ = tail_.load(std::memory_order_acquire);
+            if(tail_cached_ == head)
+                return 0;
+        }
+
+        size_t count = tail_cached_ - head;
+        if(count > n)
+            count = n;
+        for(size_t i=0; i<count; i++)
+            out[i] = buf_[(head+i) & mask_];
+        head_.store(head+count, std::memory_order_release);
+        return count;
+    }
+
+private:
+    std::vector<T> buf_;
+    size_t mask_;
+
+    // consumer side
+    alignas(64) std::atomic<size_t> head_ {0};
+    size_t tail_cached_ = 0;
+
+    // producer side
+    alignas(64) std::atomic<size_t> tail_ {0};
+    size_t head_cached_ = 0;
+};
@@ -1,10 +1,33 @@
 #pragma once
 
+#ifndef ATOMSIM_NO_TRACE
+#ifdef ATOMSIM_TRACE_FST
+#include <verilated_fst_c.h>
+typedef VerilatedFstC VerilatedTrace_t;
+#define DEFAULT_TRACE_FILE "trace.fst"
+#else
 #include <verilated_vcd_c.h>
+typedef VerilatedVcdC VerilatedTrace_t;
+#define DEFAULT_TRACE_FILE "trace.vcd"
+#endif
+#else
+#include <verilated.h>
+class VerilatedVcdC;
+typedef VerilatedVcdC VerilatedTrace_t;
+#define DEFAULT_TRACE_FILE "trace.vcd"
+#endif
+#ifdef ATOMSIM_SAVABLE
+#include <verilated_save.h>
+#endif
 #include <stdint.h>
 
+#include "except.hpp"
+
+// Trace file is flushed every TRACE_FLUSH_INTERVAL cycles (must be a power of 2)
+#define TRACE_FLUSH_INTERVAL    4096
+
 /**
- * @brief TESTBENCH Class; Instantiates topmodule, keep track of cycles elapsed, handles VCD trace generation.
+ * @brief TESTBENCH Class; Instantiates topmodule, keep track of cycles elapsed, handles VCD/FST trace generation.
  * 
  * @tparam VTop module to be instantiated
  */
@@ -28,11 +51,25 @@ public:
 	/**
 	 * @brief Open/create a trace file
      * 
-	 * @param vcdname name of vcd file
+	 * @param vcdname name of vcd/fst file
 	 */
 	virtual	void openTrace(const char *vcdname);
 
 
+	/**
+	 * @brief Pause/resume dumping to an open trace file
+	 * 
+	 * @param enable true to dump every cycle
+	 */
+	void setTraceDump(bool enable)  { m_trace_dump = enable; }
+
+
+	/**
+	 * @brief Flush trace file
+	 */
+	void flushTrace(void);
+
+
 	/**
 	 * @brief Close a trace file
 	 */
@@ -51,12 +88,37 @@ public:
 	virtual void reset(void);
 
 
+	/**
+	 * @brief Re-evaluate model (without a clock edge) after signals 
+	 * were modified from outside
+	 */
+	void eval(void)     { m_core->eval(); }
+
+
 	/**
 	 * @brief Run for one cycle
 	 */
 	virtual void tick(void);
 
 
+	/**
+	 * @brief Run for up to n cycles
+	 * @details Runs a tight loop without returning to the caller between 
+	 * cycles. Stops early if verilator encounters $finish or stop() returns 
+	 * true.
+	 * 
+	 * @param n maximum number of cycles to run
+	 * @param pre_tick callable invoked before every cycle
+	 * @param skip callable invoked before every cycle with the number of 
+	 * cycles left; returns number of cycles it fast-forwarded the model 
+	 * over (0: simulate the cycle)
+	 * @param stop callable invoked after every cycle; returns true to stop
+	 * @return uint64_t number of cycles run (including skipped cycles)
+	 */
+	template <class PreTickFn, class SkipFn, class StopFn>
+	uint64_t tick_n(uint64_t n, PreTickFn pre_tick, SkipFn skip, StopFn stop);
+
+
 	/**
 	 * @brief Check if simulation ended
 	 * 
@@ -81,6 +143,23 @@ public:
      */
     virtual uint64_t get_total_tickcount()  { return m_tickcount_total; }
 
+#ifdef ATOMSIM_SAVABLE
+    /**
+     * @brief Save state of topmodule & tick counters
+     * 
+     * @param os serializer to write to
+     */
+    virtual void save(VerilatedSerialize &os);
+
+
+    /**
+     * @brief Restore state of topmodule & tick counters
+     * 
+     * @param is deserializer to read from
+     */
+    virtual void restore(VerilatedDeserialize &is);
+#endif
+
 private:
     /**
      * @brief topmodule ptr
@@ -90,7 +169,12 @@ private:
     /**
      * @brief trace obj ptr
      */
-	VerilatedVcdC	* m_trace = NULL;
+	VerilatedTrace_t	* m_trace = NULL;
+
+    /**
+     * @brief Dump to trace every cycle (if trace is open)
+     */
+    bool            m_trace_dump = true;
 
     /**
      * @brief TickCounter to count clock cycles fom last reset
@@ -111,7 +195,9 @@ template <class VTop>
 Testbench<VTop>::Testbench(void)
 {
     m_core = new VTop;
+#ifndef ATOMSIM_NO_TRACE
     Verilated::traceEverOn(true);
+#endif
     m_tickcount = 0l;
 }
 
@@ -129,23 +215,40 @@ Testbench<VTop>::~Testbench(void)
 template <class VTop>
 void Testbench<VTop>::openTrace(const char *vcdname) 
 {
+#ifndef ATOMSIM_NO_TRACE
     if (m_trace==NULL)
     {
-        m_trace = new VerilatedVcdC;
+        m_trace = new VerilatedTrace_t;
         m_core->trace(m_trace, 99);
         m_trace->open(vcdname);
+        m_trace_dump = true;
     }
+#else
+    throw Atomsim_exception("tracing is not supported in this build of atomsim (rebuild with FLAVOR=default)");
+#endif
 }
 
 
 template <class VTop>
 void Testbench<VTop>::closeTrace(void) 
 {
+#ifndef ATOMSIM_NO_TRACE
     if (m_trace!=NULL)
     {
         m_trace->close();
         delete m_trace;
     }
+#endif
+}
+
+
+template <class VTop>
+void Testbench<VTop>::flushTrace(void) 
+{
+#ifndef ATOMSIM_NO_TRACE
+    if (m_trace!=NULL)
+        m_trace->flush();
+#endif
 }
 
 
@@ -179,11 +282,14 @@ void Testbench<VTop>::tick(void)
     m_core -> clk_i = 0;
     m_core -> eval();
 
-    //	Dump values to our trace file before clock edge
-    if(m_trace) 
-    {
-        m_trace->dump(10*m_tickcount-2);
-    }
+#ifndef ATOMSIM_NO_TRACE
+    //	Dump values to our trace file before clock edge (clock low & 
+    //  inputs set for this cycle); timestamps use total tickcount so 
+    //  that they keep increasing across resets
+    const bool dump = m_trace && m_trace_dump;
+    if(dump) 
+        m_trace->dump(10*m_tickcount_total-5);
+#endif
 
     // ---------- Toggle the clock ------------
 
@@ -191,26 +297,51 @@ void Testbench<VTop>::tick(void)
     m_core -> clk_i = 1;
     m_core -> eval();
 
+#ifndef ATOMSIM_NO_TRACE
     //	Dump values to our trace file after clock edge
-    if(m_trace) m_trace->dump(10*m_tickcount);
+    if(dump)
+    {
+        m_trace->dump(10*m_tickcount_total);
+
+        // Flush in batches rather than every cycle
+        if((m_tickcount_total & (TRACE_FLUSH_INTERVAL-1)) == 0)
+            m_trace->flush();
+    }
+#endif
 
 
     // Falling edge
     m_core -> clk_i = 0;
     m_core -> eval();
+}
 
 
-    if (m_trace) {
-        // This portion, though, is a touch different.
-        // After dumping our values as they exist on the
-        // negative clock edge ...
-        m_trace->dump(10*m_tickcount+5);
-        //
-        // We'll also need to make sure we flush any I/O to
-        // the trace file, so that we can use the assert()
-        // function between now and the next tick if we want to.
-        m_trace->flush();
+template <class VTop>
+template <class PreTickFn, class SkipFn, class StopFn>
+uint64_t Testbench<VTop>::tick_n(uint64_t n, PreTickFn pre_tick, SkipFn skip, StopFn stop)
+{
+    uint64_t i = 0;
+    while(i < n && !done())
+    {
+        uint64_t skipped = skip(n - i);
+        if(skipped)
+        {
+            // model was advanced by skip(), just account for the cycles
+            m_tickcount += skipped;
+            m_tickcount_total += skipped;
+            i += skipped;
+        }
+        else
+        {
+            pre_tick();
+            tick();
+            i++;
+        }
+
+        if(stop())
+            break;
     }
+    return i;
 }
 
 
@@ -219,3 +350,21 @@ bool Testbench<VTop>::done(void)
 {
     return (Verilated::gotFinish()); 
 }
+
+
+#ifdef ATOMSIM_SAVABLE
+template <class VTop>
+void Testbench<VTop>::save(VerilatedSerialize &os)
+{
+    os << m_tickcount << m_tickcount_total;
+    os << *m_core;
+}
+
+
+template <class VTop>
+void Testbench<VTop>::restore(VerilatedDeserialize &is)
+{
+    is >> m_tickcount >> m_tickcount_total;
+    is >> *m_core;
+}
+#endif
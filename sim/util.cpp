@@ -6,6 +6,8 @@
 #include <cstdlib>
 #include "except.hpp"
 
+#include "elfio/elfio.hpp"
+
 // declared in main.cpp
 extern bool NO_COLOR_OUTPUT;
 
@@ -137,23 +139,16 @@ std::string resolve_envvar_in_path(std::string path) {
 
 std::vector<char> fReadBin(std::string filepath)
 {        
-    std::vector<char> fcontents;
-    std::ifstream f (filepath, std::ios::out | std::ios::binary);
+    std::ifstream f (filepath, std::ios::in | std::ios::binary | std::ios::ate);
     
     if(!f)
     {
         throw Atomsim_exception("file access failed: "+filepath);
     }
-    try
-    {
-        while(!f.eof())
-        {    
-            char byte;
-            f.read((char *) &byte, 1);
-            fcontents.push_back(byte);
-        }
-    }
-    catch(...)
+
+    std::vector<char> fcontents((size_t) f.tellg());
+    f.seekg(0);
+    if(!f.read(fcontents.data(), fcontents.size()))
     {
         throw Atomsim_exception("file reading failed: "+filepath);
     }
@@ -220,77 +215,47 @@ std::string GetStdoutFromCommand(std::string cmd, bool get_output = true) {
 }
 
 
-void getDisassembly(std::map<uint32_t, DisassembledLine> *dis, std::string filename)
+void forEachElfSymbol(const std::string &filename, const std::function<bool(const ElfSymbol_t &)> &fn)
 {
-	std::string command = "";
-	#ifdef RV32_COMPILER
-		command +="riscv32-unknown-elf-objdump -d ";
-	#else
-		command += "riscv64-unknown-elf-objdump -d ";
-	#endif
-	command+=filename;
-
-	// Get command output
-	std::string output = GetStdoutFromCommand(command);
-	
-	std::stringstream s(output);
-	
-	std::string line;
-    bool in_disassembly = false;
-	while(std::getline(s, line))
-	{
-        line = strip(line);
-
-        // Skip blank lines
-        if(line.length() == 0)
-            continue;
-
-        // replace tabs with spaces
-        const int spacesPerTab = 2;
-        for(size_t pos = 0; (pos = line.find('\t', pos)) != std::string::npos; pos += spacesPerTab) {
-            // Replace each tab with spaces
-            line.replace(pos, 1, spacesPerTab, ' ');
-        }
+    ELFIO::elfio reader;
+    if (!reader.load(filename))
+        throw Atomsim_exception("Can't find or process ELF file : " + filename);
 
-        if(!in_disassembly) {
-            if(line.find("Disassembly of section") != std::string::npos)
-                in_disassembly = true;
+    for (int i = 0; i < reader.sections.size(); i++)
+    {
+        ELFIO::section *sec = reader.sections[i];
+        if (sec->get_type() != SHT_SYMTAB)
             continue;
-        }
 
-        if(line == "...")
-            break;
-
-
-        // Tokenize
-        std::stringstream ss(line);
-        std::string tmp;
-        std::vector<std::string> tok;
-        while (ss >> tmp)
-            tok.push_back(tmp);
-
-        // Dism if tok 0's last char == ':'
-        if(tok[0].back() == ':')
+        const ELFIO::symbol_section_accessor symbols(reader, sec);
+        for (unsigned j = 0; j < symbols.get_symbols_num(); j++)
         {
-            // remove colon from 1st token
-            tok[0] = tok[0].substr(0, tok[0].length()-1);
-            uint32_t addr = std::stoul(tok[0], 0, 16);
-            uint32_t instrn = std::stoul(tok[1], 0, 16);
-            std::string dism = strip(line.substr(line.find(tok[2])));
-
-            DisassembledLine dl = {
-                .instr = instrn,
-                .disassembly = dism
-            };
-
-            // insert if not already present
-            if(dis->count(addr) == 0) {
-                dis->insert({addr, dl});
-            }
-        }
-        else {
-            // Parse the rest
-            // printf("Unk[%s]\n", line.c_str());
+            std::string name;
+            ELFIO::Elf64_Addr value = 0;
+            ELFIO::Elf_Xword size = 0;
+            unsigned char bind = 0, type = 0, other = 0;
+            ELFIO::Elf_Half section_index = 0;
+            if (!symbols.get_symbol(j, name, value, size, bind, type, section_index, other))
+                continue;
+
+            bool defined = section_index != SHN_UNDEF && section_index < reader.sections.size();
+            bool code = defined && (reader.sections[section_index]->get_flags() & SHF_EXECINSTR);
+            if (!fn({name, (uint32_t)value, (uint32_t)size, bind, type, defined, code}))
+                return;
         }
     }
-}
\ No newline at end of file
+}
+
+
+bool getSymbolAddr(std::string filename, std::string symbol, uint32_t &addr)
+{
+    bool found = false;
+    forEachElfSymbol(filename, [&](const ElfSymbol_t &sym) {
+        if (sym.name != symbol)
+            return true;
+        addr = sym.value;
+        found = true;
+        return false;
+    });
+    return found;
+}
@@ -4,6 +4,7 @@
 #include <vector>
 #include <map>
 #include <cstdint>
+#include <functional>
 
 //////////////////////////////////////////////////////////////////////////////
 // Color codes for output formatting
@@ -174,17 +175,34 @@ void fWrite (std::vector<std::string> data, std::string filepath);
 std::string GetStdoutFromCommand(std::string cmd, bool get_output);
 
 
-struct DisassembledLine
+/**
+ * @brief Symbol from the symbol table of an ELF file
+ */
+struct ElfSymbol_t
 {
-    uint32_t instr;
-    std::string disassembly;
+    std::string name;
+    uint32_t value;
+    uint32_t size;
+    unsigned char bind;     // STB_*
+    unsigned char type;     // STT_*
+    bool defined;           // in a section of the file (not SHN_UNDEF/SHN_ABS/..)
+    bool code;              // in an executable section
 };
 
+/**
+ * @brief Call a function for each symbol in the symbol table(s) of an ELF file
+ * 
+ * @param filename ELF filename
+ * @param fn called with each symbol, returns false to stop iterating
+ */
+void forEachElfSymbol(const std::string &filename, const std::function<bool(const ElfSymbol_t &)> &fn);
 
 /**
- * @brief Get the Disassembly of input file using riscv objdump
+ * @brief Get address of a symbol from the symbol table of an ELF file
  * 
- * @param dis std::map<uint32_t, std::string> map of disassembly
- * @param filename input filename
+ * @param filename ELF filename
+ * @param symbol symbol name
+ * @param addr address of symbol (output)
+ * @return true if symbol was found
  */
-void getDisassembly(std::map<uint32_t, DisassembledLine> *dis, std::string filename);
\ No newline at end of file
+bool getSymbolAddr(std::string filename, std::string symbol, uint32_t &addr);
\ No newline at end of file
@@ -1,129 +1,194 @@
 #include "vuart.hpp"
+#include "except.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
 
 #include <string>
+#include <chrono>
+
+#define VUART_RING_SIZE     4096    // bytes
+#define VUART_POLL_MS       1       // max latency of tx data
+#define VUART_DRAIN_TIMEOUT_MS  100 // max wait for port to accept tx data when stopping
 
 // Helper functions
-inline void Vuart::_openPort()
+void Vuart::_openPort()
 {
-    port->Open();
-    isopen = true;
+    fd_ = open(portname_.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if(fd_ < 0)
+        throw Atomsim_exception("can't open vuart port "+portname_+": "+strerror(errno));
+
+    termios tty;
+    if(tcgetattr(fd_, &tty) != 0)
+    {
+        int err = errno;
+        _closePort();
+        throw Atomsim_exception("can't configure vuart port "+portname_+": "+strerror(err));
+    }
+    cfmakeraw(&tty);
+    tty.c_cflag |= CLOCAL | CREAD;
+    tty.c_cc[VMIN] = 0;
+    tty.c_cc[VTIME] = 0;
+    tcsetattr(fd_, TCSANOW, &tty);
+    _applyBaud();
 }
 
 
-inline void Vuart::_closePort()
+void Vuart::_closePort()
 {
-    port->Close();
-    isopen = false;
+    close(fd_);
+    fd_ = -1;
 }
 
 
-Vuart::Vuart(std::string portname, int baud)
+void Vuart::_applyBaud()
 {
-    // set baud rate
-    setbaud(baud);
+    speed_t speed;
+    switch(baud_)
+    {
+        case 9600:      speed = B9600; break;
+        case 19200:     speed = B19200; break;
+        case 38400:     speed = B38400; break;
+        case 57600:     speed = B57600; break;
+        case 115200:    speed = B115200; break;
+        case 230400:    speed = B230400; break;
+        case 460800:    speed = B460800; break;
+        default:
+            throw Atomsim_exception("Invalid baud rate: "+std::to_string(baud_));
+    }
 
-    // create a new port object
-    port = new mn::CppLinuxSerial::SerialPort(portname, port_baudrate);
+    if(fd_ < 0)
+        return;
+
+    // termios calls are safe to make while I/O thread is using the port
+    termios tty;
+    if(tcgetattr(fd_, &tty) == 0)
+    {
+        cfsetispeed(&tty, speed);
+        cfsetospeed(&tty, speed);
+        tcsetattr(fd_, TCSANOW, &tty);
+    }
+}
 
-    /* Set timeout to 0: i.e. Non blocking Mode
-        This (paired with 1 byte recieve buffer of the library) enables the latest pressed key 
-        on the keyboard to be returned while calling recieve().
-    */
-    port->SetTimeout(0);
+
+Vuart::Vuart(std::string portname, int baud):
+    portname_(portname),
+    baud_(baud),
+    rx_(VUART_RING_SIZE),
+    tx_(VUART_RING_SIZE)
+{
+    _applyBaud();   // validate baud rate
 
     // Open port
     _openPort();
+
+    thread_ = std::thread(&Vuart::io_thread, this);
 }
 
 
 Vuart::~Vuart()
 {
+    // stop I/O thread (it writes out pending tx data first)
+    done_.store(true, std::memory_order_release);
+    thread_.join();
+
     // close port
     _closePort();
-
-    // destroy port object
-    delete port;
 }
 
 
 void Vuart::setbaud(unsigned int baud)
 {
-    switch(baud)
+    unsigned int old = baud_;
+    baud_ = baud;
+    try
     {
-        case 9600:
-            port_baudrate=mn::CppLinuxSerial::BaudRate::B_9600; break;
-        case 19200:
-            port_baudrate=mn::CppLinuxSerial::BaudRate::B_19200; break;
-        case 115200:
-            port_baudrate=mn::CppLinuxSerial::BaudRate::B_115200; break;
-        
-        default:
-            throw "Invalid baud rate";
+        _applyBaud();
     }
-
-    // if already opened
-    if(isopen)
+    catch(const Atomsim_exception &)
     {
-        // Close port, change baudrate, and reopen
-        _closePort();
-
-        port->SetBaudRate(port_baudrate);
-        
-        _openPort();
+        baud_ = old;
+        throw;
     }
 }
 
 
-
 unsigned int Vuart::getbaud()
 {
-    switch(port_baudrate)
-    {
-        case mn::CppLinuxSerial::BaudRate::B_9600:
-            return 9600;
-        case mn::CppLinuxSerial::BaudRate::B_19200:
-            return 19200;
-        case mn::CppLinuxSerial::BaudRate::B_115200:
-            return 115200;
-        
-        default: 
-            return -1;  // unknown baud
-    }
+    return baud_;
 }
 
 
 bool Vuart::isOpen()
 {
-    return isopen;
+    return fd_ >= 0;
 }
 
 
-void Vuart::send(char c)
+void Vuart::clean_recieve_buffer()
 {
-    std::vector<uint8_t> vec;
-    vec.push_back((uint8_t) c);
-    port->WriteBinary(vec);
-}
-
-
-int Vuart::recieve()
-{        
-    std::vector<uint8_t> vec;
-    port->ReadBinary(vec);
+    tcflush(fd_, TCIFLUSH);
 
-    if(vec.size()==0)
-        return (int) -1;
-    else
-        return (int) vec[0];
+    uint8_t buf[256];
+    while(rx_.pop(buf, sizeof(buf)) > 0)
+        ;   // dump garbage
 }
 
 
-void Vuart::clean_recieve_buffer()
+void Vuart::io_thread()
 {
-    char c;
-    do
+    uint8_t rxbuf[256], txbuf[256];
+    size_t rx_len = 0, rx_off = 0;  // read from port, not yet in rx ring
+    size_t tx_len = 0, tx_off = 0;  // popped from tx ring, not yet written
+
+    while(true)
     {
-        c = recieve();  // dump garbage
-    } while(c != -1);
+        // check done flag before popping, so that data sent before it was set is written out
+        bool done = done_.load(std::memory_order_acquire);
+        if(tx_off == tx_len)
+        {
+            tx_off = 0;
+            tx_len = tx_.pop(txbuf, sizeof(txbuf));
+        }
+        if(done && tx_off == tx_len)
+            break;
+
+        // stop reading port while rx ring is full (data stays in kernel buffer)
+        pollfd pfd = {fd_, 0, 0};
+        if(rx_off == rx_len && !done)
+            pfd.events |= POLLIN;
+        if(tx_off < tx_len)
+            pfd.events |= POLLOUT;
+
+        int rc = poll(&pfd, 1, done ? VUART_DRAIN_TIMEOUT_MS : VUART_POLL_MS);
+        if((rc < 0 && errno != EINTR) || (done && rc == 0))
+            break;  // port error, or port not draining while stopping
+
+        if(pfd.revents & POLLIN)
+        {
+            ssize_t r = read(fd_, rxbuf, sizeof(rxbuf));
+            if(r > 0)
+            {
+                rx_off = 0;
+                rx_len = r;
+            }
+        }
+        while(rx_off < rx_len && rx_.push(rxbuf[rx_off]))
+            rx_off++;
+
+        if(pfd.revents & POLLOUT)
+        {
+            ssize_t w = write(fd_, txbuf + tx_off, tx_len - tx_off);
+            if(w > 0)
+                tx_off += w;
+        }
+
+        // other end of a pty closed; avoid spinning until it is reopened
+        if((pfd.revents & (POLLHUP | POLLERR)) && !(pfd.revents & POLLIN))
+            std::this_thread::sleep_for(std::chrono::milliseconds(VUART_POLL_MS));
+    }
 }
-
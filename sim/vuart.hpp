@@ -1,28 +1,34 @@
 #pragma once
 
-#include "CppLinuxSerial/include/SerialPort.hpp"
+#include "spsc_queue.hpp"
+
+#include <stdint.h>
+#include <string>
+#include <atomic>
+#include <thread>
 
 #define DEFAULT_BAUDRATE    9600
 
 /**
  * @brief Vuart Class
- * @details Encapsulates the functionality of a virtual uart port with the help of the a modified version of 
- * the CppLinuxSerial Library. The library has been modified to use only a 1 byte recieve buffer in 
- * order to enable character by character send/recieve rather than string by string.
- * @see https://github.com/gbmhunter/CppLinuxSerial
+ * @details Encapsulates the functionality of a virtual uart port (a serial
+ * device or pty). All port I/O is done by a dedicated I/O thread, which
+ * polls the port and moves data between it and a pair of lock-free rx/tx
+ * rings; send() and recieve() only touch the rings, so they can be called
+ * every simulated cycle without making any syscalls.
  */
 class Vuart
-{    
+{
 public:
     /**
-     * @brief Construct a new Vuart object
+     * @brief Construct a new Vuart object, open the port & start I/O thread
      * @param portname name of the port
      * @param baud baud-rate (bps)
      */
     Vuart(std::string portname, int baud=DEFAULT_BAUDRATE);
 
     /**
-     * @brief Destroy the Vuart object
+     * @brief Destroy the Vuart object; flushes pending tx data & closes port
      */
     ~Vuart();
 
@@ -40,24 +46,33 @@ public:
 
     /**
      * @brief Returns current state of the port
-     * @return true if open 
+     * @return true if open
      * @return false if closed
      */
     bool isOpen();
 
     /**
      * @brief Send a charactr to uvart
+     * @details Queued in tx ring; written to port by I/O thread
      * @param c character
      */
-    void send(char c);
+    void send(char c)
+    {
+        while(!tx_.push((uint8_t)c))
+            std::this_thread::yield();  // I/O thread is behind
+    }
 
     /**
      * @brief get char in buffer
-     * @details Immediately returns the char present in the recieve buffer
+     * @details Immediately returns the oldest char in the recieve ring,
      * if no chr present returns (int)-1
      * @return char character
      */
-    int recieve();
+    int recieve()
+    {
+        uint8_t c;
+        return rx_.pop(&c, 1) ? (int)c : (int)-1;
+    }
 
     /**
      * @brief Clean any garbage in the recieve buffer
@@ -66,32 +81,55 @@ public:
 
 private:
     /**
-     * @brief pointer to the serial port object
+     * @brief name of the port
      */
-    mn::CppLinuxSerial::SerialPort * port;
+    std::string portname_;
 
     /**
      * @brief Serial port Baudrate
      */
-    mn::CppLinuxSerial::BaudRate port_baudrate;
+    unsigned int baud_;
+
+    /**
+     * @brief file descriptor of the port (-1 if closed)
+     */
+    int fd_ = -1;
 
     /**
-     * @brief current state of the port
+     * @brief data recieved from port (I/O thread -> simulation)
      */
-    bool isopen = false;
+    SpscQueue<uint8_t> rx_;
+
+    /**
+     * @brief data to send to port (simulation -> I/O thread)
+     */
+    SpscQueue<uint8_t> tx_;
+
+    /**
+     * @brief I/O thread & its stop flag
+     */
+    std::thread thread_;
+    std::atomic<bool> done_ {false};
+
+    /**
+     * @brief I/O thread
+     */
+    void io_thread();
 
     // Helper functions
 
     /**
-     * @brief Open serial port
-     * @param verbose set true to print acknowledgement message
+     * @brief Open serial port & configure it (raw mode)
      */
-    inline void _openPort();
+    void _openPort();
 
     /**
      * @brief Close serial port
-     * @param verbose set true to print acknowledgement message
      */
-    inline void _closePort();
+    void _closePort();
 
-};
\ No newline at end of file
+    /**
+     * @brief Apply baud_ to open port
+     */
+    void _applyBaud();
+};
@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+
+// Semihosting operations
+#define SYS_OPEN            0x01
+#define SYS_CLOSE           0x02
+#define SYS_WRITEC          0x03
+#define SYS_WRITE0          0x04
+#define SYS_WRITE           0x05
+#define SYS_READ            0x06
+#define SYS_READC           0x07
+#define SYS_CLOCK           0x10
+#define SYS_TIME            0x11
+#define SYS_EXIT            0x18
+#define SYS_EXIT_EXTENDED   0x20
+
+#define ADP_Stopped_ApplicationExit 0x20026
+
+// Host file handles of console
+#define SEMIHOST_STDIN      0
+#define SEMIHOST_STDOUT     1
+#define SEMIHOST_STDERR     2
+
+/**
+ * @brief Make a semihosting call (serviced by simulator/debugger)
+ *
+ * @param op operation
+ * @param arg argument (usually pointer to parameter block)
+ * @return long result
+ */
+long semihost_call(long op, long arg);
+
+/**
+ * @brief Write buffer to a host file
+ *
+ * @param fd host file handle
+ * @param buf buffer
+ * @param n number of chars
+ * @return long number of chars not written
+ */
+long semihost_write(long fd, const char *buf, uint32_t n);
+
+/**
+ * @brief Read from a host file into buffer
+ *
+ * @param fd host file handle
+ * @param buf buffer
+ * @param n max number of chars
+ * @return long number of chars not read
+ */
+long semihost_read(long fd, char *buf, uint32_t n);
+
+/**
+ * @brief Get time since start of execution (in centiseconds)
+ * @return long
+ */
+long semihost_clock();
+
+/**
+ * @brief Request host to end execution
+ *
+ * @param code exit code
+ */
+void semihost_exit(int code);
@@ -22,8 +22,10 @@ int __serial_write(char * bf, uint32_t sz){
 void serial_init(uint32_t baud_rate)
 {
     // Not required for BFM UART
+    #ifndef SEMIHOSTING    // stdio stays on semihosting
     stddev[DEV_STDOUT].read=__serial_read;
     stddev[DEV_STDOUT].write=__serial_write;
+    #endif
 }
 
 void serial_set_config(Serial_Config *cfg)
@@ -2,7 +2,20 @@
 #include <assert.h>
 #include <file.h>
 
+#ifdef SEMIHOSTING
+int __semihost_stdin_read(char * bf, uint32_t sz);
+int __semihost_stdout_write(char * bf, uint32_t sz);
+int __semihost_stderr_write(char * bf, uint32_t sz);
+
+// stdio is served by the host through semihosting calls
+Device_t stddev[N_STDDEV] = {
+    [DEV_STDIN]  = {.write=0, .read=__semihost_stdin_read},
+    [DEV_STDOUT] = {.write=__semihost_stdout_write, .read=0},
+    [DEV_STDERR] = {.write=__semihost_stderr_write, .read=0}
+};
+#else
 Device_t stddev[N_STDDEV];
+#endif
 
 int dev_write(const Device_t *dev, char *buf, uint32_t n){
     assert(dev);
@@ -49,8 +49,10 @@ void serial_init(uint32_t baud_rate)
     uart_config.baud = baud_rate;
     serial_set_config(&uart_config);
 
+    #ifndef SEMIHOSTING    // stdio stays on semihosting
     stddev[DEV_STDIN].read=__serial_read;
     stddev[DEV_STDOUT].write=__serial_write;
+    #endif
 }
 
 void serial_set_config(Serial_Config *cfg)
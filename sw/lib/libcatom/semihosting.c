@@ -0,0 +1,70 @@
+#include <stdint.h>
+#include <semihosting.h>
+
+long __attribute__ ((noinline)) semihost_call(long op, long arg)
+{
+    register long a0 asm("a0") = op;
+    register long a1 asm("a1") = arg;
+
+    // host recognizes the call by this sequence, it must not be compressed
+    asm volatile (
+        ".option push       \n"
+        ".option norvc      \n"
+        "slli x0, x0, 0x1f  \n"
+        "ebreak             \n"
+        "srai x0, x0, 7     \n"
+        ".option pop        \n"
+        : "+r"(a0)
+        : "r"(a1)
+        : "memory"
+    );
+    return a0;
+}
+
+
+long semihost_write(long fd, const char *buf, uint32_t n)
+{
+    long params[3] = {fd, (long)buf, n};
+    return semihost_call(SYS_WRITE, (long)params);
+}
+
+
+long semihost_read(long fd, char *buf, uint32_t n)
+{
+    long params[3] = {fd, (long)buf, n};
+    return semihost_call(SYS_READ, (long)params);
+}
+
+
+long semihost_clock()
+{
+    return semihost_call(SYS_CLOCK, 0);
+}
+
+
+void semihost_exit(int code)
+{
+    long params[2] = {ADP_Stopped_ApplicationExit, code};
+    semihost_call(SYS_EXIT_EXTENDED, (long)params);
+}
+
+
+#ifdef SEMIHOSTING
+// Device handlers used for stdio (see file.c)
+int __semihost_stdin_read(char * bf, uint32_t sz){
+    // retry till at least one char is read
+    while(semihost_read(SEMIHOST_STDIN, bf, sz) == sz)
+        ;
+    return 0;
+}
+
+int __semihost_stdout_write(char * bf, uint32_t sz){
+    semihost_write(SEMIHOST_STDOUT, bf, sz);
+    return 0;
+}
+
+int __semihost_stderr_write(char * bf, uint32_t sz){
+    semihost_write(SEMIHOST_STDERR, bf, sz);
+    return 0;
+}
+#endif
@@ -69,12 +69,13 @@ class ReturnCodes(enum.Enum):
 
     EXEC_ERR=2
     EXEC_SUCCESS=3
+    EXEC_DIVERGED=4
 
-    VERIF_ASSERTION_FILE_DOES_NOT_EXIST=4
-    VERIF_NO_ASSERTION=5
-    VERIF_SOME_ASSERTIONS_FAILED=6
-    VERIF_SOME_ASSERTIONS_IGNORED=7
-    VERIF_ALL_ASSERTIONS_PASSED=8
+    VERIF_ASSERTION_FILE_DOES_NOT_EXIST=5
+    VERIF_NO_ASSERTION=6
+    VERIF_SOME_ASSERTIONS_FAILED=7
+    VERIF_SOME_ASSERTIONS_IGNORED=8
+    VERIF_ALL_ASSERTIONS_PASSED=9
 
 
 
@@ -139,6 +140,8 @@ def execute_test(test:dict, compile_outputs:dict, mute=True):
 
     EXEC = 'atomsim'
     EXEC_FLAGS = ['--ebreak-dump', '--no-banner', '--maxitr', '100000', '--trace-file', VCD_FILE, '--dump-file', DUMP_FILE, '-v']
+    if LOCKSTEP:
+        EXEC_FLAGS += ['--lockstep']
     # -----------------------------------
 
     # Execute test
@@ -147,7 +150,12 @@ def execute_test(test:dict, compile_outputs:dict, mute=True):
         print(" ".join(exec_cmd))
     
     dump = run_cmd(exec_cmd, print_dumps=VERBOSE)
-    if (dump.returncode != 0):
+    if LOCKSTEP and 'Lockstep divergence' in dump.stdout:
+        print(Color.RED+"RTL diverged from reference ISS!"+Color.RESET)
+        if not VERBOSE:
+            print(dump.stdout[dump.stdout.find('Lockstep divergence'):])
+        return ReturnCodes.EXEC_DIVERGED, None
+    elif (dump.returncode != 0):
         print(Color.RED+"Execution error!"+Color.RESET)
         return ReturnCodes.EXEC_ERR, None
     elif len(dump.stderr) != 0:
@@ -237,13 +245,15 @@ if __name__ == "__main__":
     parser.add_argument('-w', '--workdir', help='Specify work directory', type=str, default='work')
     parser.add_argument('-o', '--output', help='Specify report output file', type=str, default='work/scartest.report')
     parser.add_argument('--nocolor', help='Disable colors', action='store_true')
+    parser.add_argument('--lockstep', help='Run tests with RTL in lockstep with reference ISS', action='store_true')
 
     parser.add_argument('json', help='provide a json file containing tests list', type=str)
     args = parser.parse_args()
 
-    global VERBOSE, WORKDIR
+    global VERBOSE, WORKDIR, LOCKSTEP
     VERBOSE = args.verbose
     WORKDIR = args.workdir
+    LOCKSTEP = args.lockstep
 
     if args.nocolor or not sys.stdout.isatty():
         Color.disable_colors()
@@ -284,7 +294,7 @@ if __name__ == "__main__":
 
         # Verify test
         print(Color.PURPLE + 'Verifying..' + Color.RESET)
-        verify_rc = verify_test(test, compile_outputs, execute_outputs)
+        verify_rc = verify_test(test, compile_outputs, execute_outputs) if execute_rc == ReturnCodes.EXEC_SUCCESS else None
 
         test_db += [{
             "name": test["name"],
@@ -321,6 +331,10 @@ if __name__ == "__main__":
                 reason = 'Execute Error'
                 test_status = f'{Color.YELLOW}Ignored{Color.RESET}'
                 ignored_tests += [test["name"]]
+            elif test["execute_rc"] == ReturnCodes.EXEC_DIVERGED:
+                reason = 'Lockstep Divergence'
+                test_status = f'{Color.RED}Failed{Color.RESET}'
+                failed_tests += [test["name"]]
             elif test["execute_rc"] == ReturnCodes.EXEC_SUCCESS:
                 if test["verify_rc"] == ReturnCodes.VERIF_ASSERTION_FILE_DOES_NOT_EXIST:
                     reason = 'Assertion File Doesn\'t Exist'